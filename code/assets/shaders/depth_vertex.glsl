@@ -0,0 +1,15 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 projectionMatrix;
+uniform mat4 viewMatrix;
+uniform mat4 worldMatrix;
+
+// Must produce bit for bit the depth of textured_vertex.glsl, so the colour pass can test with GL_EQUAL.
+invariant gl_Position;
+
+void main()
+{
+    vec3 fragPos = vec3(worldMatrix * vec4(aPos, 1.0));
+    gl_Position = projectionMatrix * viewMatrix * vec4(fragPos, 1.0);
+}
@@ -1,16 +1,24 @@
 #version 330 core
 
+// Feature flags, defined by the shader loader right after #version to build cheaper permutations:
+// NO_SHADOWS skips the shadow lookup, SHADOW_SINGLE_TAP samples the shadow map once instead of 3x3 and NO_NORMAL_MAP lights with the vertex normal.
+
 in VS_OUT {
     vec3 FragPos;
     vec3 Normal;
     vec2 TexCoords;
-    vec4 FragPosLightSpace;
+    float ViewDepth;
     vec4 FragPosLight2Space;
 } fs_in;
 
 //
 
-uniform sampler2D shadowMap;
+// Two depth layers per cascade, static casters in layer i and dynamic ones in layer cascadeCount + i.
+// Each cascade has its light view projection and the view depth where it ends.
+uniform sampler2DArray shadowMap;
+uniform mat4 cascadeMatrices[4];
+uniform float cascadeSplits[4];
+uniform int cascadeCount;
 
 uniform sampler2D textureSamplerA;
 uniform sampler2D textureSamplerB;
@@ -68,12 +76,38 @@ float specular(vec3 lightDir, vec3 sourceNormal)
 	return shadingSpecularStrength * pow(max(dot(reflectLightDirection, viewDirection), 0.0f), shadingSpecularPower) * 2;
 }
 
-float shadowCalculation(vec4 fragPosLightSpace)
+// Shadows.
+
+// The cascade covering the fragment, or -1 past the last one.
+int selectCascade()
+{
+	for (int i = 0; i < cascadeCount; i++)
+	{
+		if (fs_in.ViewDepth < cascadeSplits[i])
+			return i;
+	}
+	return -1;
+}
+
+// Nearest occluder depth of the static and dynamic layers of a cascade.
+float shadowDepth(vec2 coords, int cascade)
+{
+	float staticDepth = texture(shadowMap, vec3(coords, cascade)).r;
+	float dynamicDepth = texture(shadowMap, vec3(coords, cascadeCount + cascade)).r;
+	return min(staticDepth, dynamicDepth);
+}
+
+float shadowCalculation(vec3 fragPos)
 {
+	int cascade = selectCascade();
+	if (cascade < 0)
+		return 0.0;
+
+	vec4 fragPosLightSpace = cascadeMatrices[cascade] * vec4(fragPos, 1.0);
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
     projCoords = projCoords * 0.5 + 0.5;
 	
-    float closestDepth = texture(shadowMap, projCoords.xy).r; 
+    float closestDepth = shadowDepth(projCoords.xy, cascade); 
     float currentDepth = projCoords.z;
 
     float bias = 0.001f;
@@ -82,25 +116,26 @@ float shadowCalculation(vec4 fragPosLightSpace)
     return shadow;
 }
 
-float shadowCalculationFiltered(vec4 fragPosLightSpace)
+float shadowCalculationFiltered(vec3 fragPos)
 {
+	int cascade = selectCascade();
+	if (cascade < 0)
+		return 0.0;
+
+	vec4 fragPosLightSpace = cascadeMatrices[cascade] * vec4(fragPos, 1.0);
 	vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
     projCoords = projCoords * 0.5 + 0.5;
 	
-    float closestDepth = texture(shadowMap, projCoords.xy).r; 
     float currentDepth = projCoords.z;
-	
-    vec3 normal = normalize(fs_in.Normal);
-    vec3 lightDir = normalize(light_position - fs_in.FragPos);
     float bias = 0.005f;
 
     float shadow = 0.0;
-    vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowMap, 0).xy);
     for(int x = -1; x <= 1; x++)
     {
         for(int y = -1; y <= 1; y++)
         {
-            float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r; 
+            float pcfDepth = shadowDepth(projCoords.xy + vec2(x, y) * texelSize, cascade); 
             shadow += currentDepth - bias > pcfDepth  ? 1.0 : 0.0;        
         }    
     }
@@ -169,20 +204,30 @@ void main()
 	// Height Blending.
 	vec3 textureColorA = texture(textureSamplerA, fs_in.TexCoords).rgb;
 	float textureDepthA = texture(depthSamplerA, fs_in.TexCoords).r;
-	vec3 textureNormalA = handleNormalMap(normalSamplerA);
 	
 	vec3 textureColorB = texture(textureSamplerB, fs_in.TexCoords).rgb;
 	float textureDepthB = texture(depthSamplerB, fs_in.TexCoords).r;
-	vec3 textureNormalB = handleNormalMap(normalSamplerB);
 	
 	vec3 textureMix = heightlerp(textureColorA, textureDepthA, textureColorB, textureDepthB, fs_in.FragPos.y);
+#ifdef NO_NORMAL_MAP
+	vec3 normalMix = fs_in.Normal;
+#else
+	vec3 textureNormalA = handleNormalMap(normalSamplerA);
+	vec3 textureNormalB = handleNormalMap(normalSamplerB);
 	vec3 normalMix = heightlerp(textureNormalA, textureDepthA, textureNormalB, textureDepthB, fs_in.FragPos.y);
+#endif
 	
 	
 	// Lighting.
 	float diffuseLighting = diffuse(light_direction, normalMix);
 	//float specularLighting = specular(light_direction, normalMix); // Specular lighting doesn't look very good or logical on terrain.
-	float shadow = 1.0f - shadowCalculationFiltered(fs_in.FragPosLightSpace);
+#if defined(NO_SHADOWS)
+	float shadow = 1.0f;
+#elif defined(SHADOW_SINGLE_TAP)
+	float shadow = 1.0f - shadowCalculation(fs_in.FragPos);
+#else
+	float shadow = 1.0f - shadowCalculationFiltered(fs_in.FragPos);
+#endif
 
 	//vec3 combinedLighting = ambient_colour + light_color * shadow * (diffuseLighting + specularLighting);
 	vec3 combinedLighting = ambient_colour + light_color * shadow * (diffuseLighting);
@@ -0,0 +1,27 @@
+#version 330 core
+
+// Renders an object into a cell of the impostor atlas: its unlit colour, and its world normal packed into [0, 1].
+// Texels it does not cover keep the cleared alpha of 0.
+
+layout (location = 0) out vec4 Colour;
+layout (location = 1) out vec4 Normal;
+
+in VS_OUT {
+    vec3 FragPos;
+    vec3 Normal;
+    vec2 TexCoords;
+    float ViewDepth;
+    vec4 FragPosLight2Space;
+} fs_in;
+
+uniform sampler2D textureSampler;
+
+void main()
+{
+	vec4 textureColor = texture(textureSampler, fs_in.TexCoords);
+	if (textureColor.a < 0.01)
+		discard;
+
+	Colour = vec4(textureColor.rgb, 1.0f);
+	Normal = vec4(normalize(fs_in.Normal) * 0.5f + 0.5f, 1.0f);
+}
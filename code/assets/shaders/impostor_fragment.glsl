@@ -0,0 +1,31 @@
+#version 330 core
+
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D colourSampler;
+uniform sampler2D normalSampler;
+
+uniform vec3 ambient_colour;
+uniform vec3 light_color;
+uniform vec3 light_direction;
+
+const float shadingDiffuseStrength = 0.95;
+
+void main()
+{
+	// Mipmaps average the edges out, half coverage keeps the silhouette the same size at every level.
+	vec4 colour = texture(colourSampler, TexCoords);
+	if (colour.a < 0.5)
+		discard;
+
+	// Diffuse lighting from the baked normals, as textured_fragment.glsl does without normal map. Impostors receive no shadows.
+	// Both textures are averaged with the empty texels around the object in the smaller levels, dividing by the alpha undoes it.
+	vec4 packedNormal = texture(normalSampler, TexCoords);
+	vec3 normal = normalize(packedNormal.rgb / packedNormal.a * 2.0f - 1.0f);
+	vec3 invertedLightDir = vec3(-light_direction.x, light_direction.y, -light_direction.z);
+	float diffuse = shadingDiffuseStrength * max(dot(normal, normalize(invertedLightDir)), 0.0f);
+
+	FragColor = vec4(colour.rgb / colour.a * (ambient_colour + light_color * diffuse), 1.0f);
+}
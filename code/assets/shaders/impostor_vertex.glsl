@@ -0,0 +1,36 @@
+#version 330 core
+
+// A quad of the impostor atlas per instance, turned about its vertical axis towards the eye.
+// It shows the baked view taken from the direction nearest to the one it is seen from.
+layout (location = 0) in vec2 aCorner;
+// Base of the object and its atlas row.
+layout (location = 1) in vec4 aBaseVariant;
+// Width and height in the world.
+layout (location = 2) in vec2 aSize;
+
+out vec2 TexCoords;
+
+uniform mat4 viewProjectionMatrix;
+uniform vec3 eyePosition;
+// Views per row and variants, the columns and rows of the atlas.
+uniform vec2 atlasCells;
+
+const float PI = 3.1415926535897932384626433832795;
+
+void main()
+{
+	vec3 base = aBaseVariant.xyz;
+	vec2 toEye = eyePosition.xz - base.xz;
+	vec2 facing = dot(toEye, toEye) > 0.000001f ? normalize(toEye) : vec2(1.0f, 0.0f);
+
+	// Screen right of a camera looking at the axis from the facing direction, as when baking.
+	vec3 right = vec3(facing.y, 0.0f, -facing.x);
+	vec3 position = base + right * (aCorner.x * aSize.x) + vec3(0.0f, aCorner.y * aSize.y, 0.0f);
+
+	// View i was baked from the angle 2 pi i / views.
+	float angle = atan(facing.y, facing.x);
+	float view = mod(round(angle / (2.0f * PI) * atlasCells.x), atlasCells.x);
+	TexCoords = (vec2(view, aBaseVariant.w) + vec2(aCorner.x + 0.5f, aCorner.y)) / atlasCells;
+
+	gl_Position = viewProjectionMatrix * vec4(position, 1.0);
+}
@@ -1,18 +1,27 @@
 #version 330 core
+
+// Feature flags, defined by the shader loader right after #version to build cheaper permutations:
+// NO_SHADOWS skips the shadow lookup, SHADOW_SINGLE_TAP samples the shadow map once instead of 3x3 and NO_NORMAL_MAP lights with the vertex normal.
+
 out vec4 FragColor;
 
 in VS_OUT {
     vec3 FragPos;
     vec3 Normal;
     vec2 TexCoords;
-    vec4 FragPosLightSpace;
+    float ViewDepth;
     vec4 FragPosLight2Space;
 } fs_in;
 
 //
 
 uniform sampler2D textureSampler;
-uniform sampler2D shadowMap;
+// Two depth layers per cascade, static casters in layer i and dynamic ones in layer cascadeCount + i.
+// Each cascade has its light view projection and the view depth where it ends.
+uniform sampler2DArray shadowMap;
+uniform mat4 cascadeMatrices[4];
+uniform float cascadeSplits[4];
+uniform int cascadeCount;
 uniform sampler2D normalSampler;
 
 uniform vec3 colour = vec3(1.0f, 1.0f, 1.0f);
@@ -64,12 +73,38 @@ float specular(vec3 lightDir, vec3 sourceNormal)
 }
 
 
-float shadowCalculation(vec4 fragPosLightSpace)
+// Shadows.
+
+// The cascade covering the fragment, or -1 past the last one.
+int selectCascade()
+{
+	for (int i = 0; i < cascadeCount; i++)
+	{
+		if (fs_in.ViewDepth < cascadeSplits[i])
+			return i;
+	}
+	return -1;
+}
+
+// Nearest occluder depth of the static and dynamic layers of a cascade.
+float shadowDepth(vec2 coords, int cascade)
+{
+	float staticDepth = texture(shadowMap, vec3(coords, cascade)).r;
+	float dynamicDepth = texture(shadowMap, vec3(coords, cascadeCount + cascade)).r;
+	return min(staticDepth, dynamicDepth);
+}
+
+float shadowCalculation(vec3 fragPos)
 {
+	int cascade = selectCascade();
+	if (cascade < 0)
+		return 0.0;
+
+	vec4 fragPosLightSpace = cascadeMatrices[cascade] * vec4(fragPos, 1.0);
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
     projCoords = projCoords * 0.5 + 0.5;
 	
-    float closestDepth = texture(shadowMap, projCoords.xy).r; 
+    float closestDepth = shadowDepth(projCoords.xy, cascade); 
     float currentDepth = projCoords.z;
 
     float bias = 0.001f;
@@ -78,25 +113,26 @@ float shadowCalculation(vec4 fragPosLightSpace)
     return shadow;
 }
 
-float shadowCalculationFiltered(vec4 fragPosLightSpace)
+float shadowCalculationFiltered(vec3 fragPos)
 {
+	int cascade = selectCascade();
+	if (cascade < 0)
+		return 0.0;
+
+	vec4 fragPosLightSpace = cascadeMatrices[cascade] * vec4(fragPos, 1.0);
 	vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
     projCoords = projCoords * 0.5 + 0.5;
 	
-    float closestDepth = texture(shadowMap, projCoords.xy).r; 
     float currentDepth = projCoords.z;
-	
-    vec3 normal = normalize(fs_in.Normal);
-    vec3 lightDir = normalize(light_position - fs_in.FragPos);
     float bias = 0.001f;
 
     float shadow = 0.0;
-    vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowMap, 0).xy);
     for(int x = -1; x <= 1; x++)
     {
         for(int y = -1; y <= 1; y++)
         {
-            float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r; 
+            float pcfDepth = shadowDepth(projCoords.xy + vec2(x, y) * texelSize, cascade); 
             shadow += currentDepth - bias > pcfDepth  ? 1.0 : 0.0;        
         }    
     }
@@ -141,12 +177,22 @@ vec3 handleNormalMap(sampler2D currentNormalSampler)
 
 void main()
 {           
+#ifdef NO_NORMAL_MAP
+    vec3 normals = fs_in.Normal;
+#else
     vec3 normals = handleNormalMap(normalSampler);
+#endif
 	
 	// Main light.
 	float diffuseLighting = diffuse(light_direction, normals);
 	float specularLighting = specular(light_direction, normals);
-	float shadow = 1.0f - shadowCalculationFiltered(fs_in.FragPosLightSpace);
+#if defined(NO_SHADOWS)
+	float shadow = 1.0f;
+#elif defined(SHADOW_SINGLE_TAP)
+	float shadow = 1.0f - shadowCalculation(fs_in.FragPos);
+#else
+	float shadow = 1.0f - shadowCalculationFiltered(fs_in.FragPos);
+#endif
 	vec3 lightingMain = light_color * shadow * (diffuseLighting + specularLighting);
 	
 	vec3 allLighting = ambient_colour + lightingMain;
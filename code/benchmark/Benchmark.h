@@ -0,0 +1,48 @@
+#pragma once
+
+// Minimal self contained timing harness shared by the benchmark executables.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Keep the optimizer from discarding a computed value.
+template <class T>
+inline void DoNotOptimize(const T& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	// The address escapes into an asm statement that may read any memory, so the value has to be stored before it.
+	asm volatile("" : : "r"(&value) : "memory");
+#else
+	[[maybe_unused]] static volatile const void* sink;
+	sink = &value;
+#endif
+}
+
+// Run the function a few times and return the median duration of one run, in nanoseconds.
+template <class Function>
+double MeasureMedianNanoseconds(Function function, int repetitions = 7)
+{
+	// Warm caches and lazy initialization up first.
+	function();
+
+	std::vector<double> durations;
+	for (int i = 0; i < repetitions; i++)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		function();
+		auto end = std::chrono::high_resolution_clock::now();
+		durations.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+	}
+
+	std::sort(durations.begin(), durations.end());
+	return durations[durations.size() / 2];
+}
+
+// One line per measurement: "name  parameter  value unit", easy to read and to diff between builds.
+inline void ReportBenchmark(const std::string& name, const std::string& parameter, double value, const std::string& unit)
+{
+	std::printf("%-40s %-16s %14.2f %s\n", name.c_str(), parameter.c_str(), value, unit.c_str());
+}
@@ -0,0 +1,122 @@
+//
+// Job system microbenchmark.
+//
+// Measures the scheduling overhead of empty jobs, dependency chains and parallel for,
+// then how a compute bound parallel for scales with the number of workers.
+//
+
+#include "Benchmark.h"
+#include "JobSystem.h"
+
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Enough floating point work per item for scaling to be measurable.
+static float computeItem(unsigned int index)
+{
+	float value = (float)index;
+	for (int i = 0; i < 64; i++)
+		value = sqrtf(value * 1.0001f + 1.0f);
+	return value;
+}
+
+static void benchmarkOverhead(JobSystem& jobSystem)
+{
+	const int jobCount = 10000;
+	string threads = to_string(jobSystem.GetThreadCount()) + " threads";
+
+	// Schedule empty jobs then wait for all of them.
+	double nanoseconds = MeasureMedianNanoseconds([&]()
+		{
+			vector<JobSystem::JobHandle> jobs;
+			jobs.reserve(jobCount);
+			for (int i = 0; i < jobCount; i++)
+				jobs.push_back(jobSystem.Schedule([]() {}));
+			jobSystem.Wait(jobs);
+		});
+	ReportBenchmark("Schedule and wait, empty job", threads, nanoseconds / jobCount, "ns/job");
+
+	// A chain where every job depends on the previous one, so nothing runs in parallel.
+	const int chainLength = 1000;
+	nanoseconds = MeasureMedianNanoseconds([&]()
+		{
+			JobSystem::JobHandle previous = jobSystem.Schedule([]() {});
+			for (int i = 1; i < chainLength; i++)
+				previous = jobSystem.Schedule([]() {}, { previous });
+			jobSystem.Wait(previous);
+		});
+	ReportBenchmark("Dependency chain, empty job", threads, nanoseconds / chainLength, "ns/job");
+
+	// Parallel for with a grain of one item per job, the worst case.
+	atomic<unsigned int> counter(0);
+	nanoseconds = MeasureMedianNanoseconds([&]()
+		{
+			jobSystem.ParallelFor(jobCount, 1, [&](unsigned int begin, unsigned int end) { counter.fetch_add(end - begin, memory_order_relaxed); });
+		});
+	ReportBenchmark("Parallel for, grain 1", threads, nanoseconds / jobCount, "ns/item");
+}
+
+static void benchmarkScaling()
+{
+	const unsigned int itemCount = 1 << 20;
+	const unsigned int grainSize = 4096;
+	vector<float> results(itemCount);
+
+	unsigned int hardwareThreads = max(1u, thread::hardware_concurrency());
+
+	double singleThreadNanoseconds = MeasureMedianNanoseconds([&]()
+		{
+			for (unsigned int i = 0; i < itemCount; i++)
+				results[i] = computeItem(i);
+		}, 3);
+	DoNotOptimize(results[itemCount / 2]);
+	ReportBenchmark("Serial loop", "1 thread", singleThreadNanoseconds / 1.0e6, "ms");
+
+	// Powers of two, then every hardware thread.
+	vector<unsigned int> threadCounts;
+	for (unsigned int threadCount = 1; threadCount < hardwareThreads; threadCount *= 2)
+		threadCounts.push_back(threadCount);
+	threadCounts.push_back(hardwareThreads);
+
+	for (unsigned int threadCount : threadCounts)
+	{
+		JobSystem jobSystem(threadCount > 1 ? threadCount - 1 : 1);
+		// One worker is still created when asking for a single thread, keep it out of the measurement by using grain = count.
+		unsigned int grain = threadCount == 1 ? itemCount : grainSize;
+
+		double nanoseconds = MeasureMedianNanoseconds([&]()
+			{
+				jobSystem.ParallelFor(itemCount, grain, [&](unsigned int begin, unsigned int end)
+					{
+						for (unsigned int i = begin; i < end; i++)
+							results[i] = computeItem(i);
+					});
+			}, 3);
+		DoNotOptimize(results[itemCount / 2]);
+
+		string threads = to_string(threadCount) + " threads";
+		ReportBenchmark("Parallel for, 1M items", threads, nanoseconds / 1.0e6, "ms");
+		ReportBenchmark("Parallel for speedup", threads, singleThreadNanoseconds / nanoseconds, "x");
+	}
+}
+
+int main()
+{
+	cout << "Job system benchmark, " << thread::hardware_concurrency() << " hardware threads.\n\n";
+
+	{
+		JobSystem jobSystem;
+		benchmarkOverhead(jobSystem);
+	}
+
+	cout << "\n";
+	benchmarkScaling();
+
+	return 0;
+}
@@ -0,0 +1,217 @@
+//
+// Model microbenchmark.
+//
+// Measures the CPU side of scene creation and the per object math of a frame: terrain generation and its
+// stages, sphere vertex building as a triangle list and indexed, vertex cache optimization and the simulated
+// cache misses before and after it, loading the terrain from a mapped mesh container, ground height queries,
+// cube containment tests and world matrices.
+// Nothing here touches OpenGL, so it runs without a GPU or a window.
+//
+
+#include "Benchmark.h"
+#include "CubeModel.h"
+#include "GroundModel.h"
+#include "MeshCache.h"
+#include "MeshContainer.h"
+#include "MeshOptimizer.h"
+#include "SphereModel.h"
+
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Fixed so that runs compare the same terrain and the same objects.
+static const unsigned int SEED = 42069u;
+
+// The terrain prints its noise seed while generating, keep it out of the report.
+template <class Function>
+static double measureQuietly(Function function, int repetitions = 7)
+{
+	cout.setstate(ios::failbit);
+	double nanoseconds = MeasureMedianNanoseconds(function, repetitions);
+	cout.clear();
+	return nanoseconds;
+}
+
+static void reportVertexCache(const string& mesh, const string& parameter, const MeshOptimizer::VertexCacheStatistics& generated, const MeshOptimizer::VertexCacheStatistics& optimized)
+{
+	ReportBenchmark(mesh + " ACMR, generated", parameter, generated.acmr, "misses/triangle");
+	ReportBenchmark(mesh + " ACMR, optimized", parameter, optimized.acmr, "misses/triangle");
+	ReportBenchmark(mesh + " ATVR, generated", parameter, generated.atvr, "misses/vertex");
+	ReportBenchmark(mesh + " ATVR, optimized", parameter, optimized.atvr, "misses/vertex");
+}
+
+static void benchmarkTerrain(unsigned int size)
+{
+	string parameter = to_string(size) + "x" + to_string(size);
+	double vertexCount = (double)(size + 1) * (size + 1);
+
+	// One perlin noise sample, as done for every vertex of the grid.
+	GroundModel sampler;
+	float height = 0.0f;
+	double nanoseconds = MeasureMedianNanoseconds([&]()
+		{
+			for (unsigned int z = 0; z <= size; z++)
+			{
+				for (unsigned int x = 0; x <= size; x++)
+					height += sampler.generateHeightCoord(x, z, 0.05f, SEED);
+			}
+		}, 3);
+	DoNotOptimize(height);
+	ReportBenchmark("Terrain generateHeightCoord", parameter, nanoseconds / vertexCount, "ns/vertex");
+
+	// Everything the constructor does when it does not create the buffers.
+	nanoseconds = measureQuietly([&]()
+		{
+			GroundModel ground(size, size, 8.0f, false, SEED);
+			DoNotOptimize(ground.GetVertexCount());
+		}, 3);
+	ReportBenchmark("Terrain generation, whole", parameter, nanoseconds / 1.0e6, "ms");
+
+	cout.setstate(ios::failbit);
+	GroundModel* ground = new GroundModel(size, size, 8.0f, false, SEED);
+	cout.clear();
+
+	nanoseconds = MeasureMedianNanoseconds([&]() { ground->generateVertexNormals(size, size); }, 3);
+	ReportBenchmark("Terrain generateVertexNormals", parameter, nanoseconds / 1.0e6, "ms");
+
+	nanoseconds = MeasureMedianNanoseconds([&]() { ground->createGroundVertexVector(ground->GetVertexMap(), size, size); }, 3);
+	ReportBenchmark("Terrain createGroundVertexVector", parameter, nanoseconds / 1.0e6, "ms");
+	reportVertexCache("Terrain", parameter, ground->GetGeneratedCacheStatistics(), ground->GetOptimizedCacheStatistics());
+
+	// What a baked terrain costs to load instead: mapping and checking the file, then touching every page as the upload would.
+	string path = "model_benchmark_terrain" + string(MeshContainer::Extension);
+	if (MeshCache::WriteMesh(path, ground->GetVertices(), ground->GetIndices()))
+	{
+		nanoseconds = MeasureMedianNanoseconds([&]()
+			{
+				MeshContainer container;
+				container.Open(path);
+				container.Prefetch();
+				DoNotOptimize(container.GetVertexCount());
+			});
+		ReportBenchmark("Terrain mesh container load", parameter, nanoseconds / 1.0e6, "ms");
+		remove(path.c_str());
+	}
+
+	// Random points strictly inside the grid, points on the far edges would add vertices to the map.
+	const int queryCount = 10000;
+	mt19937 random(SEED);
+	uniform_real_distribution<float> coordinate(0.0f, (float)size - 1.0f);
+	vector<vec2> points(queryCount);
+	for (vec2& point : points)
+		point = vec2(coordinate(random), coordinate(random));
+
+	nanoseconds = MeasureMedianNanoseconds([&]()
+		{
+			for (const vec2& point : points)
+				height += ground->returnHeightAtPoint(point);
+		});
+	DoNotOptimize(height);
+	ReportBenchmark("Terrain returnHeightAtPoint", parameter, nanoseconds / queryCount, "ns/query");
+
+	delete ground;
+}
+
+static void benchmarkSphere(int subdivisions)
+{
+	string parameter = to_string(subdivisions) + "x" + to_string(subdivisions);
+
+	size_t vertexCount = 0;
+	double nanoseconds = MeasureMedianNanoseconds([&]()
+		{
+			vector<Model::TexturedColoredNormalVertex> vertices = SphereModel::SphereVertices(1.0f, 0.0f, subdivisions, subdivisions);
+			vertexCount = vertices.size();
+			DoNotOptimize(vertices.data());
+		});
+	ReportBenchmark("Sphere vertices", parameter, nanoseconds / 1.0e3, "us");
+	ReportBenchmark("Sphere vertices, per vertex", parameter, nanoseconds / vertexCount, "ns/vertex");
+
+	// The indexed sphere of the mesh cache, per vertex of the triangle list above to compare the two.
+	vector<Model::TexturedColoredNormalVertex> vertices;
+	vector<unsigned int> indices;
+	nanoseconds = MeasureMedianNanoseconds([&]()
+		{
+			MeshCache::BuildSphere(1.0f, 0.0f, subdivisions, subdivisions, vertices, indices);
+			DoNotOptimize(indices.data());
+		});
+	ReportBenchmark("Sphere indexed", parameter, nanoseconds / 1.0e3, "us");
+	ReportBenchmark("Sphere indexed, per vertex", parameter, nanoseconds / vertexCount, "ns/vertex");
+	ReportBenchmark("Sphere indexed, unique vertices", parameter, (double)vertices.size(), "vertices");
+
+	// Triangle reordering alone, on a fresh copy of the generated indices every time.
+	double triangleCount = (double)(indices.size() / 3);
+	vector<unsigned int> optimized;
+	nanoseconds = MeasureMedianNanoseconds([&]()
+		{
+			optimized = indices;
+			MeshOptimizer::OptimizeVertexCache(optimized, (int)vertices.size());
+			DoNotOptimize(optimized.data());
+		});
+	ReportBenchmark("Sphere OptimizeVertexCache", parameter, nanoseconds / triangleCount, "ns/triangle");
+	reportVertexCache("Sphere", parameter, MeshOptimizer::AnalyzeVertexCache(indices, (int)vertices.size()), MeshOptimizer::AnalyzeVertexCache(optimized, (int)vertices.size()));
+}
+
+static void benchmarkObjects(int objectCount)
+{
+	string parameter = to_string(objectCount) + " objects";
+
+	// Placed and sized like the tree trunks of the scene.
+	mt19937 random(SEED);
+	uniform_real_distribution<float> position(-100.0f, 100.0f);
+	uniform_real_distribution<float> angle(0.0f, 90.0f);
+	uniform_real_distribution<float> size(1.0f, 8.0f);
+	vector<CubeModel> cubes;
+	cubes.reserve(objectCount);
+	for (int i = 0; i < objectCount; i++)
+		cubes.emplace_back(vec3(position(random), 0.0f, position(random)), vec3(0.0f, angle(random), 0.0f), vec3(size(random) / 4.0f, size(random), size(random) / 4.0f));
+
+	vec3 point(0.0f, 1.0f, 0.0f);
+	int inside = 0;
+	double nanoseconds = MeasureMedianNanoseconds([&]()
+		{
+			for (CubeModel& cube : cubes)
+				inside += cube.ContainsPoint(point) ? 1 : 0;
+		});
+	DoNotOptimize(inside);
+	ReportBenchmark("Cube ContainsPoint, oriented", parameter, nanoseconds / objectCount, "ns/object");
+
+	nanoseconds = MeasureMedianNanoseconds([&]()
+		{
+			for (CubeModel& cube : cubes)
+				inside += cube.ContainsPoint(point, 1.0f) ? 1 : 0;
+		});
+	DoNotOptimize(inside);
+	ReportBenchmark("Cube ContainsPoint, axis aligned", parameter, nanoseconds / objectCount, "ns/object");
+
+	mat4 sum(0.0f);
+	nanoseconds = MeasureMedianNanoseconds([&]()
+		{
+			for (const CubeModel& cube : cubes)
+				sum += cube.GetWorldMatrix();
+		});
+	DoNotOptimize(sum);
+	ReportBenchmark("Model GetWorldMatrix", parameter, nanoseconds / objectCount, "ns/object");
+}
+
+int main()
+{
+	cout << "Model benchmark.\n\n";
+
+	for (unsigned int size : { 32u, 64u, 128u, 256u })
+		benchmarkTerrain(size);
+
+	cout << "\n";
+	for (int subdivisions : { 8, 24, 64 })
+		benchmarkSphere(subdivisions);
+
+	cout << "\n";
+	for (int objectCount : { 1000, 10000, 100000 })
+		benchmarkObjects(objectCount);
+
+	return 0;
+}
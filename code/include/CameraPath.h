@@ -0,0 +1,35 @@
+#pragma once
+
+#include "Model.h"
+
+#include <string>
+#include <vector>
+
+// A scripted camera: keyframes of a position and a point looked at, joined by Catmull-Rom splines.
+// Files hold one keyframe per line, "time x y z lookAtX lookAtY lookAtZ" with the time in seconds, increasing.
+// Empty lines and lines starting with '#' are skipped.
+class CameraPath
+{
+public:
+	struct Keyframe
+	{
+		float time;
+		vec3 position;
+		vec3 lookAt;
+	};
+
+	// False, with the reason printed, when the file is missing or holds fewer than two keyframes.
+	bool Load(const std::string& path);
+	// A closed circle around the center at the given height, looking at the center, once over the duration.
+	static CameraPath Orbit(vec3 center, float radius, float height, float duration);
+
+	void AddKeyframe(float time, vec3 position, vec3 lookAt);
+	// Times before the first keyframe or after the last one hold that keyframe.
+	void Sample(float time, vec3& position, vec3& lookAt) const;
+
+	float GetDuration() const { return mKeyframes.empty() ? 0.0f : mKeyframes.back().time; }
+	size_t GetKeyframeCount() const { return mKeyframes.size(); }
+
+private:
+	std::vector<Keyframe> mKeyframes;
+};
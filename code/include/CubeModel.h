@@ -22,7 +22,10 @@ public:
 
 	virtual bool isSphere() { return false; } //This is not at all object-oriented, but somewhat necessary due to need for a simple double-dispatch mechanism
 
-	unsigned int static CubeModelVAO();
+	// Triangle list of the unit cube, as uploaded by CubeModelVAO.
+	static std::vector<TexturedColoredNormalVertex> CubeVertices();
+	// shadowVAO, when given, receives a position only VAO of the same cube, and shadowVBO its buffer, which the caller deletes with it.
+	unsigned int static CubeModelVAO(unsigned int* shadowVAO = nullptr, unsigned int* shadowVBO = nullptr);
 private:
 	unsigned int mVAO;
 	unsigned int mVBO;
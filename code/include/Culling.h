@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Model.h"
+
+#include <vector>
+
+// Six normalized planes (xyz = normal pointing inside, w = distance) extracted from a view projection matrix.
+// Works for both the camera's perspective projection and the light's orthographic one.
+struct Frustum
+{
+	vec4 planes[6];
+
+	static Frustum FromMatrix(const mat4& viewProjection);
+};
+
+// Bounding spheres of every renderable, stored as structure of arrays so they can be tested four at a time.
+class CullingSystem
+{
+public:
+	CullingSystem();
+
+	// Returns the index of the new sphere, used to look up its visibility after culling.
+	unsigned int Add(vec3 center, float radius);
+	unsigned int Add(const mat4& worldMatrix, vec3 localCenter, float localRadius);
+	void Update(unsigned int index, vec3 center, float radius);
+	void Update(unsigned int index, const mat4& worldMatrix, vec3 localCenter, float localRadius);
+	void Clear();
+
+	unsigned int GetCount() const { return mCount; }
+	// xyz = center, w = radius.
+	vec4 GetSphere(unsigned int index) const { return vec4(mCenterX[index], mCenterY[index], mCenterZ[index], mRadius[index]); }
+
+	// Sets visibility[i] to 1 for every sphere at least partially inside the frustum, 0 otherwise. Returns the visible count.
+	unsigned int Cull(const Frustum& frustum, std::vector<unsigned char>& visibility) const;
+
+	// Transform a mesh space bounding sphere by a world matrix, the radius grows with the largest axis scale.
+	static vec4 TransformSphere(const mat4& worldMatrix, vec3 localCenter, float localRadius);
+
+private:
+	void Resize(unsigned int count);
+
+	// Padded to a multiple of four with spheres that are never visible.
+	std::vector<float> mCenterX;
+	std::vector<float> mCenterY;
+	std::vector<float> mCenterZ;
+	std::vector<float> mRadius;
+
+	unsigned int mCount;
+};
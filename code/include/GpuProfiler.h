@@ -0,0 +1,51 @@
+#pragma once
+
+#include "GpuTimer.h"
+
+#include <string>
+#include <vector>
+
+// Named sections of the frame, each measured by its own GpuTimer.
+// GL_TIME_ELAPSED queries cannot nest, so sections are sequential: beginning one ends the one running.
+// Every section should be begun at most once per frame, its statistics are per measurement.
+class GpuProfiler
+{
+public:
+	// The render queue packs section + 1 into 4 bits of its sort key.
+	static const int MaxSections = 15;
+
+	GpuProfiler();
+	~GpuProfiler();
+
+	GpuProfiler(const GpuProfiler&) = delete;
+	GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+	// Index of the new section, or -1 past MaxSections.
+	int AddSection(const std::string& name);
+	// A section of -1 is ignored.
+	void Begin(int section);
+	void End();
+
+	bool IsSupported() const;
+	const std::string& GetSectionName(int section) const { return mSections[section].name; }
+	const GpuTimer& GetTimer(int section) const { return *mSections[section].timer; }
+	int GetSectionCount() const { return (int)mSections.size(); }
+	void Reset();
+
+	// Last, rolling minimum, average and 99th percentile of every section, and their sums.
+	void PrintSummary() const;
+	// The format follows the extension: .json, anything else is CSV. False if the file could not be written.
+	bool Write(const std::string& path) const;
+	bool WriteCsv(const std::string& path) const;
+	bool WriteJson(const std::string& path) const;
+
+private:
+	struct Section
+	{
+		std::string name;
+		GpuTimer* timer;
+	};
+
+	std::vector<Section> mSections;
+	int mRunning;
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Model.h"
+
+#include <vector>
+
+// Measures the GPU time of a section of the frame with GL_TIME_ELAPSED queries (ARB_timer_query).
+// Queries rotate through a small ring and are read back frames later, so the CPU does not wait on the GPU.
+// Only one timer may be between Begin and End at a time.
+class GpuTimer
+{
+public:
+	static const int QueryCount = 4;
+	// Measurements kept for the rolling statistics.
+	static const int HistorySize = 240;
+
+	GpuTimer();
+	~GpuTimer();
+
+	GpuTimer(const GpuTimer&) = delete;
+	GpuTimer& operator=(const GpuTimer&) = delete;
+
+	void Begin();
+	void End();
+
+	// False when the driver has no timer queries, Begin and End then do nothing.
+	bool IsSupported() const { return mSupported; }
+
+	// Latest measurement read back, and the average of every measurement since the last reset.
+	double GetLastMilliseconds() const { return mLastMilliseconds; }
+	double GetAverageMilliseconds() const { return mSampleCount > 0 ? mTotalMilliseconds / mSampleCount : 0.0; }
+	unsigned int GetSampleCount() const { return mSampleCount; }
+	void ResetAverage();
+
+	// Over the last HistorySize measurements at most.
+	double GetRollingMinimumMilliseconds() const;
+	double GetRollingAverageMilliseconds() const;
+	// Percentile between 0 and 100, nearest rank.
+	double GetRollingPercentileMilliseconds(double percentile) const;
+	size_t GetRollingSampleCount() const { return mHistory.size(); }
+
+private:
+	// Read back every finished query. When wait is set, also block on the query in slot.
+	void Collect(bool wait, int slot);
+	void Read(int slot);
+
+	bool mSupported;
+	GLuint mQueries[QueryCount];
+	bool mPending[QueryCount];
+	int mNext;
+	bool mRunning;
+
+	double mLastMilliseconds;
+	double mTotalMilliseconds;
+	unsigned int mSampleCount;
+
+	// Ring of the latest measurements, oldest at mHistoryNext once full.
+	std::vector<double> mHistory;
+	size_t mHistoryNext;
+};
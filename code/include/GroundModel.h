@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Model.h"
+#include "MeshOptimizer.h"
 
 #include <vector>
 #include <map>
@@ -19,7 +20,8 @@ class GroundModel : public Model
 {
 public:
 	GroundModel();
-	GroundModel(unsigned int sizeX, unsigned int sizeZ, float uvTiling); // Return a GroundModel with its own VAO
+	// The seed drives the noise and the height variations, the same seed gives the same terrain.
+	GroundModel(unsigned int sizeX, unsigned int sizeZ, float uvTiling, bool createBuffers = true, unsigned int seed = (unsigned int)time(0)); // Return a GroundModel with its own VAO
 	virtual ~GroundModel();
 
 	virtual void Update(float dt);
@@ -33,11 +35,36 @@ public:
 
 	float returnHeightAtPoint(vec2 pointCoords, bool debug = false);
 
+	// Upload the vertices and create the VAOs. Generating the terrain needs no GL context, so it can run on any thread
+	// when the constructor is told not to create the buffers, as long as this is then called on the context's thread.
+	void CreateBuffers();
+
+	// Both vertex arrays draw with the same indices, GetIndexCount of them.
+	unsigned int GetVAO() const { return mVAO; }
+	// Positions only, for the shadow pass.
+	unsigned int GetShadowVAO() const { return mShadowVAO; }
+	int GetVertexCount() const { return (int)vertexVector.size(); }
+	int GetIndexCount() const { return (int)indexVector.size(); }
+	// The optimized grid as drawn, for writing it out.
+	const std::vector<TexturedColoredNormalVertex>& GetVertices() const { return vertexVector; }
+	const std::vector<unsigned int>& GetIndices() const { return indexVector; }
+	// Simulated vertex cache efficiency of the grid in row order, and in the optimized order it is drawn in.
+	const MeshOptimizer::VertexCacheStatistics& GetGeneratedCacheStatistics() const { return generatedCache; }
+	const MeshOptimizer::VertexCacheStatistics& GetOptimizedCacheStatistics() const { return optimizedCache; }
+
+	// Indexed grid with a vertex every step units, in mesh space. Each vertex takes the lowest height around it,
+	// so the coarse surface never rises above the real one and can stand in for it as an occluder.
+	void BuildOccluderMesh(unsigned int step, std::vector<vec3>& positions, std::vector<unsigned int>& indices) const;
+
 	float generateHeightCoord(unsigned int xCoord, unsigned int zCoord, float noiseScaling, uint randomizedSeed = 42069u);
 	vec2 generateUVCoords(unsigned int posX, unsigned int posZ, float uvTiling);
 	vec3 generateFaceNormals(vec3 pointAPos, vec3 pointBPos, vec3 pointCPos);
 	void createGroundVertexVector(std::map<vec2, TexturedColoredNormalVertex, CompareVec2> terrainVertexMap, unsigned int sizeX, unsigned int sizeZ);
-	void createGroundVertexMap(unsigned int sizeX, unsigned int sizeZ, float uvTiling = 1);
+	void createGroundVertexMap(unsigned int sizeX, unsigned int sizeZ, float uvTiling = 1, unsigned int seed = (unsigned int)time(0));
+	// Smooth normals from the heights already in the vertex map, the vertices at the edges of the grid keep theirs.
+	void generateVertexNormals(unsigned int sizeX, unsigned int sizeZ);
+
+	const std::map<vec2, TexturedColoredNormalVertex, CompareVec2>& GetVertexMap() const { return terrainVertexMap; }
 
 private:
 	float sizeX;
@@ -45,7 +72,13 @@ private:
 
 	unsigned int mVAO;
 	unsigned int mVBO;
+	unsigned int mShadowVAO;
+	unsigned int mShadowVBO;
+	unsigned int mEBO;
 
 	std::map<vec2, TexturedColoredNormalVertex, CompareVec2> terrainVertexMap;
 	std::vector<TexturedColoredNormalVertex> vertexVector;
+	std::vector<unsigned int> indexVector;
+	MeshOptimizer::VertexCacheStatistics generatedCache;
+	MeshOptimizer::VertexCacheStatistics optimizedCache;
 };
\ No newline at end of file
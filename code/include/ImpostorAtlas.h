@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Model.h"
+
+#include <vector>
+
+class StreamingBuffer;
+
+// Pictures of an object from ViewCount directions around its vertical axis, rendered once into a texture atlas,
+// to draw far away copies of it as a single quad. The atlas has a column per view and a row per variant of the object.
+// Each cell stores the colour, with an alpha of 0 where the object is not, and the world normal packed into [0, 1].
+// Textures live as long as the atlas, which must be destroyed while its GL context is current.
+class ImpostorAtlas
+{
+public:
+	static const int ViewCount = 8;
+
+	// One quad: the base of the object, its size in the world and the atlas row it shows.
+	struct Instance
+	{
+		vec3 position;
+		float variant;
+		vec2 size;
+	};
+
+	ImpostorAtlas(int variantCount, int cellWidth, int cellHeight);
+	~ImpostorAtlas();
+
+	ImpostorAtlas(const ImpostorAtlas&) = delete;
+	ImpostorAtlas& operator=(const ImpostorAtlas&) = delete;
+
+	// False when the driver rejected the attachments, nothing is baked or drawn then.
+	bool IsComplete() const { return mComplete; }
+
+	// Baking binds the atlas framebuffer and clears it, then each cell is selected in turn and drawn into.
+	// Writes go to two outputs: 0 the colour, 1 the normal. EndBake builds the mipmaps and unbinds the framebuffer.
+	void BeginBake();
+	void BindCell(int view, int variant);
+	void EndBake();
+
+	// The orthographic camera of a view, for an object standing on the vertical axis within radius of it, from bottom to top.
+	// It looks at the axis from the direction (cos a, 0, sin a), a = 2 pi view / ViewCount, and frames [-radius, radius] x [bottom, top].
+	static void GetViewMatrices(int view, float radius, float bottom, float top, mat4& viewMatrix, mat4& projectionMatrix);
+
+	// Draws the instances as quads turned about their vertical axis towards eyePosition, each showing the view nearest to
+	// the direction it is seen from. The program reads the atlas on texture units 0 and 1.
+	// The instances are copied to the streaming buffer, nothing is drawn when they do not fit in this frame's region.
+	void Draw(GLuint shaderProgram, const mat4& viewProjectionMatrix, vec3 eyePosition, const std::vector<Instance>& instances, StreamingBuffer& buffer);
+
+	int GetVariantCount() const { return mVariantCount; }
+	GLuint GetColourTexture() const { return mColourTexture; }
+	GLuint GetNormalTexture() const { return mNormalTexture; }
+
+private:
+	int mVariantCount;
+	int mCellWidth;
+	int mCellHeight;
+
+	GLuint mFramebuffer;
+	GLuint mColourTexture;
+	GLuint mNormalTexture;
+	GLuint mDepthBuffer;
+	bool mComplete;
+
+	// Corners of the quad, per vertex, then the instances, per instance, from the streaming buffer.
+	GLuint mVertexArray;
+	GLuint mCornerBuffer;
+
+	// Uniform locations of the last program drawn with, looked up again only when the program changes.
+	GLuint mProgram;
+	GLint mViewProjectionLocation;
+	GLint mEyePositionLocation;
+};
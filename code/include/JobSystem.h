@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A small work-stealing task scheduler.
+// Every worker, plus the thread that created the system, owns a Chase-Lev deque: it pushes and pops its own jobs at the bottom
+// while idle threads steal from the top of the others. Waiting threads keep running jobs instead of blocking.
+class JobSystem
+{
+public:
+	struct Job;
+	typedef std::shared_ptr<Job> JobHandle;
+	typedef std::function<void()> JobFunction;
+	typedef std::function<void(unsigned int begin, unsigned int end)> RangeFunction;
+
+	// A worker count of 0 uses one worker per hardware thread, minus the creating thread.
+	JobSystem(unsigned int workerCount = 0);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// Run the function on any thread, once every dependency has finished.
+	JobHandle Schedule(JobFunction function);
+	JobHandle Schedule(JobFunction function, std::initializer_list<JobHandle> dependencies);
+	JobHandle Schedule(JobFunction function, const std::vector<JobHandle>& dependencies);
+
+	// Block until the job is done, running other jobs in the meantime.
+	void Wait(const JobHandle& job);
+	void Wait(const std::vector<JobHandle>& jobs);
+	bool IsFinished(const JobHandle& job) const;
+
+	// Split [0, count) into ranges of at most grainSize items and run them in parallel. Returns once all ranges are done.
+	void ParallelFor(unsigned int count, unsigned int grainSize, RangeFunction function);
+
+	// Worker threads, not counting the creating thread which also runs jobs while it waits.
+	unsigned int GetWorkerCount() const { return (unsigned int)mWorkers.size(); }
+	unsigned int GetThreadCount() const { return (unsigned int)mQueues.size(); }
+
+	// Index of the calling thread within this system: 0 for the creating thread, 1 and up for workers, -1 for others.
+	int GetCurrentThreadIndex() const;
+
+private:
+	// Chase-Lev deque, as corrected for weak memory models by Le, Pop, Cohen and Zappa Nardelli (PPoPP 2013).
+	class WorkStealingQueue
+	{
+	public:
+		WorkStealingQueue();
+
+		bool Push(Job* job); // Owner only. Fails when the queue is full.
+		Job* Pop();          // Owner only.
+		Job* Steal();        // Any thread.
+
+	private:
+		static const int64_t Capacity = 4096;
+
+		std::atomic<int64_t> mTop;
+		std::atomic<int64_t> mBottom;
+		std::atomic<Job*> mJobs[Capacity];
+	};
+
+	void WorkerLoop(unsigned int threadIndex);
+	void Enqueue(Job* job);
+	Job* FindJob();
+	bool RunOneJob();
+	void Execute(Job* job);
+
+	std::vector<std::unique_ptr<WorkStealingQueue>> mQueues;
+	std::vector<std::thread> mWorkers;
+
+	// Jobs scheduled from threads that do not belong to the system.
+	std::mutex mInjectionMutex;
+	std::deque<Job*> mInjectionQueue;
+
+	// Idle workers sleep until jobs are queued.
+	std::mutex mSleepMutex;
+	std::condition_variable mSleepCondition;
+	std::atomic<int> mQueuedJobs;
+	std::atomic<int> mSleepingWorkers;
+	std::atomic<bool> mStopping;
+};
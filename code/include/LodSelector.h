@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Model.h"
+
+#include <vector>
+
+// Picks a level of detail per instance from the radius its bounding sphere covers on screen, in pixels.
+// Level i is used down to thresholds[i] pixels, below the last threshold the last level is used.
+// A level is only left once the radius is past its thresholds by the hysteresis fraction,
+// so an object sitting at a threshold distance does not switch back and forth every frame.
+class LodSelector
+{
+public:
+	LodSelector() : mHysteresis(0.0f) {}
+	// Thresholds decrease, there is one level more than thresholds.
+	LodSelector(const std::vector<float>& thresholds, float hysteresis);
+
+	// New instances start at the last level.
+	void Resize(size_t instanceCount);
+	int Select(size_t instance, float pixelRadius);
+	int GetLevel(size_t instance) const { return mLevels[instance]; }
+	int GetLevelCount() const { return (int)mThresholds.size() + 1; }
+
+	// Radius on screen, in pixels, of a sphere seen through a perspective projection. Closer than the radius counts as at the radius.
+	static float ProjectedRadius(float radius, float distance, const mat4& projection, int viewportHeight);
+
+private:
+	std::vector<float> mThresholds;
+	float mHysteresis;
+	std::vector<unsigned char> mLevels;
+};
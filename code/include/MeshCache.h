@@ -0,0 +1,99 @@
+#pragma once
+
+#include "Model.h"
+#include "MeshOptimizer.h"
+
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Primitive meshes built once, indexed, and shared: asking twice for the same primitive and parameters returns the same mesh.
+// Spheres come in SphereLodCount levels of detail with fewer subdivisions each, for distant objects.
+// Every mesh is reordered for the vertex cache by MeshOptimizer before it is uploaded. A mesh baked offline into a MeshContainer
+// (see the Bake functions and mesh_baker) is mapped and uploaded as it is instead of being built and optimized.
+// Meshes live as long as the cache, which must be destroyed while its GL context is current.
+class MeshCache
+{
+public:
+	static constexpr int SphereLodCount = 4;
+	// Subdivisions never go below this, whatever the level of detail.
+	static constexpr int MinimumSubdivisions = 4;
+
+	struct Mesh
+	{
+		GLuint vertexArray;
+		// Positions only with the same indices, for passes that read nothing else such as the shadow pass.
+		GLuint positionVertexArray;
+		GLuint vertexBuffer;
+		GLuint positionBuffer;
+		GLuint indexBuffer;
+		int vertexCount;
+		int indexCount;
+		// GL_UNSIGNED_INT for built meshes, GL_UNSIGNED_SHORT for baked ones with few enough vertices.
+		GLenum indexType;
+		// Loaded from a baked file. Its statistics were taken by the baker, they are not kept.
+		bool baked;
+		// Simulated vertex cache efficiency of the triangle order as generated, and as uploaded.
+		MeshOptimizer::VertexCacheStatistics generatedCache;
+		MeshOptimizer::VertexCacheStatistics optimizedCache;
+	};
+
+	// Baked meshes are looked for in the directory, a path ending in a separator. Empty to always build them.
+	explicit MeshCache(const std::string& bakedDirectory = "") : mBakedDirectory(bakedDirectory) {}
+	~MeshCache();
+
+	MeshCache(const MeshCache&) = delete;
+	MeshCache& operator=(const MeshCache&) = delete;
+
+	// The unit cube of CubeModel and the unit quad of QuadModel, their identical vertices merged.
+	const Mesh& GetCube();
+	const Mesh& GetQuad();
+	// Same surface, texture coordinates and winding as SphereModel::SphereVertices, with every vertex stored once.
+	const Mesh& GetSphere(float radius, float heightOffset, int radialSubdivisions, int verticalSubdivisions);
+	// Level 0 is the sphere as asked for, each following level has fewer subdivisions, see LodSubdivisions.
+	const Mesh& GetSphereLod(float radius, float heightOffset, int radialSubdivisions, int verticalSubdivisions, int lod);
+
+	static int LodSubdivisions(int subdivisions, int lod);
+
+	// Building the meshes needs no GL context.
+	static void BuildSphere(float radius, float heightOffset, int radialSubdivisions, int verticalSubdivisions, std::vector<Model::TexturedColoredNormalVertex>& vertices, std::vector<unsigned int>& indices);
+	// Index a triangle list, bitwise identical vertices are stored once.
+	static void Weld(const std::vector<Model::TexturedColoredNormalVertex>& triangles, std::vector<Model::TexturedColoredNormalVertex>& vertices, std::vector<unsigned int>& indices);
+
+	// Build, optimize and write a primitive to the directory, under the name the cache looks for. No GL context needed.
+	static bool BakeCube(const std::string& directory);
+	static bool BakeQuad(const std::string& directory);
+	static bool BakeSphere(const std::string& directory, float radius, float heightOffset, int radialSubdivisions, int verticalSubdivisions);
+	// Write vertices of the models' layout, attributes 0 to 3, as they are: optimizing them is left to the caller.
+	static bool WriteMesh(const std::string& path, const std::vector<Model::TexturedColoredNormalVertex>& vertices, const std::vector<unsigned int>& indices);
+
+	size_t GetMeshCount() const { return mMeshes.size(); }
+	void PrintStatistics() const;
+
+private:
+	enum EPrimitive
+	{
+		Cube,
+		Quad,
+		Sphere
+	};
+
+	// Primitive, radius, height offset, radial and vertical subdivisions.
+	typedef std::tuple<int, float, float, int, int> Key;
+
+	// The mesh of a key: already in the cache, baked, or built.
+	const Mesh& Get(const Key& key);
+	static void Build(const Key& key, std::vector<Model::TexturedColoredNormalVertex>& vertices, std::vector<unsigned int>& indices);
+	static bool Bake(const std::string& directory, const Key& key);
+	// File name of the baked mesh of a key, "sphere_r1_h0.5_24x24.mesh" for instance.
+	static std::string BakedName(const Key& key);
+
+	// Optimizes the vertices and indices in place, then uploads them.
+	const Mesh& Upload(const Key& key, std::vector<Model::TexturedColoredNormalVertex>& vertices, std::vector<unsigned int>& indices);
+	// Uploads the baked mesh from the mapped file. False, with nothing uploaded, when it has no 3 float positions at location 0.
+	bool UploadBaked(const Key& key, const std::string& path);
+
+	std::string mBakedDirectory;
+	std::map<Key, Mesh> mMeshes;
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// An indexed mesh stored as the bytes GL uploads: the vertex buffer, the index buffer, and the layout to point the attributes at.
+// Opening maps the file into memory, so loading costs no parsing and no copy before the upload.
+// Needs no GL context: the baker uses it on its own.
+class MeshContainer
+{
+public:
+	// Values of the matching GL enums, so they are handed to glVertexAttribPointer and glDrawElements as they are.
+	enum EComponentType : uint32_t
+	{
+		ComponentFloat = 0x1406 // GL_FLOAT
+	};
+
+	enum EIndexType : uint32_t
+	{
+		IndexUInt16 = 0x1403, // GL_UNSIGNED_SHORT
+		IndexUInt32 = 0x1405 // GL_UNSIGNED_INT
+	};
+
+	// One vertex attribute, offset bytes into every vertex.
+	struct Attribute
+	{
+		uint32_t location;
+		uint32_t componentCount;
+		uint32_t componentType;
+		uint32_t offset;
+	};
+
+	// A range of the index buffer that can be drawn on its own, with the bounds of the vertices it uses.
+	struct Submesh
+	{
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		float boundsMin[3];
+		float boundsMax[3];
+	};
+
+	static const char* const Extension;
+
+	// Attribute locations stop below this, as do the vertex attributes GL has to offer.
+	static const uint32_t MaxAttributeLocations = 16;
+
+	MeshContainer();
+	~MeshContainer();
+
+	MeshContainer(const MeshContainer&) = delete;
+	MeshContainer& operator=(const MeshContainer&) = delete;
+
+	// Map a container and check its header, its tables and its indices. False if it is missing or invalid.
+	bool Open(const std::string& path);
+	void Close();
+	bool IsOpen() const { return mData != nullptr; }
+
+	// Touch every page of the mapping, so the upload does not fault the file in on the context's thread.
+	void Prefetch() const;
+
+	uint32_t GetVertexCount() const { return mVertexCount; }
+	uint32_t GetVertexStride() const { return mVertexStride; }
+	uint32_t GetIndexCount() const { return mIndexCount; }
+	EIndexType GetIndexType() const { return mIndexType; }
+	uint32_t GetIndexSize() const { return mIndexType == IndexUInt16 ? 2 : 4; }
+	const std::vector<Attribute>& GetAttributes() const { return mAttributes; }
+	// The attribute at a location, nullptr when the vertices have none there.
+	const Attribute* FindAttribute(uint32_t location) const;
+	const std::vector<Submesh>& GetSubmeshes() const { return mSubmeshes; }
+	const float* GetBoundsMin() const { return mBoundsMin; }
+	const float* GetBoundsMax() const { return mBoundsMax; }
+
+	const unsigned char* GetVertexData() const { return mData + mVertexOffset; }
+	uint64_t GetVertexDataSize() const { return (uint64_t)mVertexCount * mVertexStride; }
+	const unsigned char* GetIndexData() const { return mData + mIndexOffset; }
+	uint64_t GetIndexDataSize() const { return (uint64_t)mIndexCount * GetIndexSize(); }
+
+	// Write vertices of the given stride and layout with their indices, as 16 bit indices when every vertex fits.
+	// The bounds are those of the 3 float positions at location 0, which the layout must have. Without submeshes,
+	// one covers every index; the bounds of the ones given are filled in.
+	static bool Write(const std::string& path, const void* vertices, uint32_t vertexCount, uint32_t vertexStride, const std::vector<Attribute>& attributes,
+		const std::vector<unsigned int>& indices, const std::vector<Submesh>& submeshes = std::vector<Submesh>());
+
+private:
+	const unsigned char* mData;
+	size_t mSize;
+	uint32_t mVertexCount;
+	uint32_t mVertexStride;
+	uint32_t mIndexCount;
+	EIndexType mIndexType;
+	uint64_t mVertexOffset;
+	uint64_t mIndexOffset;
+	float mBoundsMin[3];
+	float mBoundsMax[3];
+	std::vector<Attribute> mAttributes;
+	std::vector<Submesh> mSubmeshes;
+
+	// Platform handles of the mapping.
+	void* mFileHandle;
+	void* mMappingHandle;
+};
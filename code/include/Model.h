@@ -68,6 +68,10 @@ public:
 		TexturedColoredNormalVertex(TexturedColoredNormalVertex source, vec3 newNormals) : position(source.position), color(source.color), uv(source.uv), normals(newNormals) {}
 	};
 
+	// Creates a VAO over a tightly packed copy of the vertex positions, for passes that only read aPos such as the shadow pass.
+	// A quarter of the memory of the full vertices is fetched. positionBuffer, when given, receives the buffer so it can be freed.
+	unsigned int static PositionOnlyVAO(const TexturedColoredNormalVertex* vertices, int vertexCount, unsigned int* positionBuffer = nullptr);
+
 protected:
 	vec3 mPosition;
 	vec3 mScaling;
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Model.h"
+#include "Culling.h"
+#include "JobSystem.h"
+
+#include <vector>
+
+// Software occlusion culling. Everything runs on the CPU, so there is no GPU readback and it works on software GL implementations too.
+// Large occluders are rasterized into a small depth buffer, a band of rows per job and four pixels at a time. Each tile of the buffer
+// is then reduced to its farthest depth, and a bounding sphere is hidden when its nearest point is behind the farthest occluder of
+// every tile it covers on screen.
+// Depths are stored as 1/w: it interpolates linearly across the screen and keeps its precision far away. Larger is nearer.
+class OcclusionCuller
+{
+public:
+	static const int Width = 256;
+	static const int Height = 128;
+	static const int TileSize = 8;
+	static const int TilesX = Width / TileSize;
+	static const int TilesY = Height / TileSize;
+
+	OcclusionCuller();
+
+	// Occluders must be conservative: they may be smaller than the objects they stand for, never larger.
+	// Returns the index of the mesh, positions are in mesh space and every three indices make a triangle.
+	unsigned int AddMesh(const std::vector<vec3>& positions, const std::vector<unsigned int>& indices);
+	// The world space bounding sphere skips occluders that are off screen or too small on screen to hide anything.
+	void AddOccluder(unsigned int mesh, const mat4& worldMatrix, vec3 center, float radius);
+	void UpdateOccluder(unsigned int occluder, const mat4& worldMatrix, vec3 center, float radius);
+
+	// Rasterize the occluders as seen through viewProjection, splitting the work over the job system when there is one.
+	void Render(const mat4& viewProjection, JobSystem* jobSystem);
+
+	// Test against the last Render.
+	bool IsVisible(vec3 center, float radius) const;
+	// Clears visibility[i] of every visible sphere that is hidden. Returns the hidden count.
+	unsigned int Cull(const CullingSystem& bounds, std::vector<unsigned char>& visibility) const;
+
+	// Statistics of the last Render.
+	unsigned int GetOccludersRendered() const { return mOccludersRendered; }
+	unsigned int GetTrianglesRendered() const { return (unsigned int)mTriangles.size(); }
+
+private:
+	struct Mesh
+	{
+		std::vector<vec3> positions;
+		std::vector<unsigned int> indices;
+	};
+
+	struct Occluder
+	{
+		unsigned int mesh;
+		mat4 worldMatrix;
+		vec4 sphere;
+	};
+
+	// A screen space triangle ready to rasterize. Each edge function and the depth are planes ax + by + c over pixel centers.
+	struct Triangle
+	{
+		int minX, minY, maxX, maxY;
+		vec3 edges[3];
+		vec3 depth;
+	};
+
+	// Clip a triangle against the near plane in clip space, then set up what is left.
+	void ClipTriangle(const vec4& a, const vec4& b, const vec4& c);
+	void SetupTriangle(const vec4& a, const vec4& b, const vec4& c);
+	// Rasterize every triangle touching a row of tiles, then reduce those tiles.
+	void RenderTileRow(int tileRow);
+
+	mat4 mViewProjection;
+
+	std::vector<Mesh> mMeshes;
+	std::vector<Occluder> mOccluders;
+	std::vector<vec4> mClipPositions;
+	std::vector<Triangle> mTriangles;
+	unsigned int mOccludersRendered;
+
+	// Nearest occluder of each pixel, 0 where there is none.
+	std::vector<float> mDepth;
+	// Farthest occluder of each tile.
+	std::vector<float> mTileDepth;
+};
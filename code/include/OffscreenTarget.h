@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Model.h"
+
+#include <string>
+#include <vector>
+
+// A framebuffer with its own colour and depth renderbuffers, to render without a visible window.
+// Frames can be read back and written as binary PPM images, which need no image library to write or view.
+class OffscreenTarget
+{
+public:
+	OffscreenTarget(int width, int height);
+	~OffscreenTarget();
+
+	OffscreenTarget(const OffscreenTarget&) = delete;
+	OffscreenTarget& operator=(const OffscreenTarget&) = delete;
+
+	// False when the driver rejected the attachments, nothing should be drawn into it then.
+	bool IsComplete() const { return mComplete; }
+	GLuint GetFramebuffer() const { return mFramebuffer; }
+	int GetWidth() const { return mWidth; }
+	int GetHeight() const { return mHeight; }
+
+	// Read the colour buffer back, waiting for the GPU, and write it top row first.
+	bool SaveFrame(const std::string& path);
+
+private:
+	GLuint mFramebuffer;
+	GLuint mColourBuffer;
+	GLuint mDepthBuffer;
+	int mWidth;
+	int mHeight;
+	bool mComplete;
+
+	std::vector<unsigned char> mPixels;
+};
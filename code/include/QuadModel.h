@@ -18,7 +18,10 @@ public:
 	virtual bool ContainsPoint(vec3 position);
 	virtual bool IntersectsPlane(vec3 planePoint, vec3 planeNormal);
 
-	unsigned int static QuadModelVAO();
+	// Triangle list of the unit quad, as uploaded by QuadModelVAO.
+	static std::vector<TexturedColoredNormalVertex> QuadVertices();
+	// shadowVAO, when given, receives a position only VAO of the same quad, and shadowVBO its buffer, which the caller deletes with it.
+	unsigned int static QuadModelVAO(unsigned int* shadowVAO = nullptr, unsigned int* shadowVBO = nullptr);
 private:
 	unsigned int mVAO;
 	unsigned int mVBO;
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "Model.h"
+
+#include <vector>
+#include <cstdint>
+
+class TextureManager;
+class GpuProfiler;
+
+// A set of textures bound together for a draw, each on its own texture unit.
+// The sampler uniforms of every program are expected to be pointed at these units once, at initialization.
+struct RenderMaterial
+{
+	static const int MaxTextures = 8;
+
+	GLuint textureUnits[MaxTextures];
+	GLuint textureIDs[MaxTextures];
+	int textureCount;
+
+	RenderMaterial() : textureCount(0) {}
+
+	void AddTexture(GLuint textureUnit, GLuint textureID)
+	{
+		if (textureCount < MaxTextures)
+		{
+			textureUnits[textureCount] = textureUnit;
+			textureIDs[textureCount] = textureID;
+			textureCount++;
+		}
+	}
+};
+
+// Collects the draws of a pass, sorts them by a packed 64 bit key and executes them while only applying the state that changed.
+// Key layout, from most to least significant bits: pass (4), profiler section (4), program (8), vertex array (12), material (16), depth (20).
+class RenderQueue
+{
+public:
+	enum EPass
+	{
+		Opaque = 0,
+		AlphaTested = 1
+	};
+
+	struct Statistics
+	{
+		unsigned int draws;
+		// Of the draws in GL_TRIANGLES mode.
+		unsigned int triangles;
+		unsigned int programBinds;
+		unsigned int programBindsAvoided;
+		unsigned int vertexArrayBinds;
+		unsigned int vertexArrayBindsAvoided;
+		unsigned int textureBinds;
+		unsigned int textureBindsAvoided;
+
+		Statistics() : draws(0), triangles(0), programBinds(0), programBindsAvoided(0), vertexArrayBinds(0), vertexArrayBindsAvoided(0), textureBinds(0), textureBindsAvoided(0) {}
+	};
+
+	RenderQueue();
+
+	// Programs and vertex arrays are given small ids so they fit in the sort key. Unknown ones are registered on submission.
+	unsigned int RegisterProgram(GLuint shaderProgram);
+	unsigned int RegisterVertexArray(GLuint vertexArray);
+
+	// Material 0 is always the empty material, used by passes that sample no textures (shadows).
+	unsigned int AddMaterial(const RenderMaterial& material);
+
+	// The section is the profiler section timing the draw, -1 for none.
+	void Submit(EPass pass, GLuint shaderProgram, GLuint vertexArray, unsigned int material, float depth, const mat4& worldMatrix, int vertexCount, GLenum renderingMode = GL_TRIANGLES, int section = -1);
+	// Draws indexCount indices of indexType (GL_UNSIGNED_SHORT or GL_UNSIGNED_INT) from the index buffer of the vertex array.
+	void SubmitIndexed(EPass pass, GLuint shaderProgram, GLuint vertexArray, unsigned int material, float depth, const mat4& worldMatrix, int indexCount, GLenum indexType, GLenum renderingMode = GL_TRIANGLES, int section = -1);
+	void Clear();
+	void Sort();
+	void Execute();
+	// Only the draws of one pass, so state such as the depth test can change between passes. Requires Sort.
+	void Execute(EPass pass);
+
+	// Textures of the draws Execute makes are marked as used in the manager, with their number of draws,
+	// which orders the textures it shrinks first. Draws culled before submission do not count.
+	void SetTextureManager(TextureManager* textureManager) { mTextureManager = textureManager; }
+
+	// With a profiler, draws are sorted by section within their pass and each run of a section is timed by it.
+	// Without one, sections are ignored and do not split the state sorting. Set before submitting.
+	void SetProfiler(GpuProfiler* profiler) { mProfiler = profiler; }
+
+	// Depths are quantized over [0, maxDepth]; anything further shares the last bucket.
+	void SetDepthRange(float maxDepth) { mMaxDepth = maxDepth; }
+
+	const Statistics& GetStatistics() const { return mStatistics; }
+	void ResetStatistics() { mStatistics = Statistics(); }
+	void PrintStatistics() const;
+
+	static uint64_t PackSortKey(unsigned int pass, unsigned int section, unsigned int program, unsigned int vertexArray, unsigned int material, unsigned int depth);
+
+private:
+	struct RenderCommand
+	{
+		GLuint shaderProgram;
+		GLint worldMatrixLocation;
+		GLuint vertexArray;
+		unsigned int material;
+		// Indices for indexed draws.
+		int vertexCount;
+		// Type of the indices, 0 for draws that are not indexed.
+		GLenum indexType;
+		GLenum renderingMode;
+		int section;
+		mat4 worldMatrix;
+	};
+
+	struct SortEntry
+	{
+		uint64_t key;
+		unsigned int command;
+	};
+
+	static const int MaxTextureUnits = 32;
+
+	void InvalidateState();
+	void ExecuteRange(size_t begin, size_t end);
+
+	std::vector<GLuint> mPrograms;
+	std::vector<GLint> mWorldMatrixLocations;
+	std::vector<GLuint> mVertexArrays;
+	std::vector<RenderMaterial> mMaterials;
+	// Draws per material in the range being executed, handed to the texture manager at its end.
+	std::vector<unsigned int> mMaterialDraws;
+
+	std::vector<RenderCommand> mCommands;
+	std::vector<SortEntry> mSortEntries;
+	std::vector<SortEntry> mSortScratch;
+
+	float mMaxDepth;
+	TextureManager* mTextureManager;
+	GpuProfiler* mProfiler;
+
+	// Cached GL state, only valid during Execute.
+	GLuint mCurrentProgram;
+	GLuint mCurrentVertexArray;
+	GLuint mCurrentTextureUnit;
+	GLuint mBoundTextures[MaxTextureUnits];
+
+	Statistics mStatistics;
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "Model.h"
+
+// Cascaded shadow maps for a directional light.
+// The camera frustum, up to a maximum shadow distance, is split along its depth with the practical split scheme: a blend of
+// logarithmic and uniform splits. Each slice gets its own orthographic light projection, fitted to the slice's bounding sphere
+// and snapped to whole texels so shadow edges do not shimmer as the camera moves.
+// Each cascade has two layers in one depth texture array. Static casters go in layer i and are cached: the slice centers move on a
+// coarse grid, so the light projection and the cached depth only change once the camera has moved far enough. Dynamic casters are
+// drawn every frame into layer GetCascadeCount() + i. Shaders take the nearest of both depths.
+class ShadowCascades
+{
+public:
+	static const int MaxCascades = 4;
+
+	enum ELayer
+	{
+		StaticLayer,
+		DynamicLayer
+	};
+
+	ShadowCascades(int cascadeCount, unsigned int resolution);
+	~ShadowCascades();
+
+	ShadowCascades(const ShadowCascades&) = delete;
+	ShadowCascades& operator=(const ShadowCascades&) = delete;
+
+	// Fit the cascades to a camera with a perspective projection.
+	// lightDirection points toward the light. casterDistance is how far toward the light from a slice shadow casters are still captured.
+	void Update(const mat4& view, const mat4& projection, float shadowDistance, vec3 lightDirection, float casterDistance);
+
+	// Target one depth layer of a cascade and size the viewport to it.
+	void BindCascade(int cascade, ELayer layer) const;
+
+	// The static layer must be re-rendered when its light projection changed since it was last rendered, or after InvalidateStaticLayers.
+	bool IsStaticLayerStale(int cascade) const;
+	void MarkStaticLayerRendered(int cascade);
+	// Call when static casters are added, removed or moved.
+	void InvalidateStaticLayers();
+
+	// Static layers rendered since creation.
+	unsigned int GetStaticLayerRenderCount() const { return mStaticLayerRenderCount; }
+
+	int GetCascadeCount() const { return mCascadeCount; }
+	unsigned int GetResolution() const { return mResolution; }
+	GLuint GetTexture() const { return mTexture; }
+
+	// Light view projection of each cascade.
+	const mat4& GetMatrix(int cascade) const { return mMatrices[cascade]; }
+	const mat4* GetMatrices() const { return mMatrices; }
+
+	// View depth where each cascade ends. Fragments further than the last one are not shadowed.
+	const float* GetSplitDistances() const { return mSplitDistances; }
+
+	// Where the light's orthographic camera sits for a cascade, used to sort shadow casters.
+	vec3 GetLightPosition(int cascade) const { return mLightPositions[cascade]; }
+
+	// 0 gives uniform splits, 1 logarithmic ones.
+	void SetSplitLambda(float lambda) { mSplitLambda = lambda; }
+
+private:
+	int mCascadeCount;
+	unsigned int mResolution;
+	float mSplitLambda;
+
+	GLuint mTexture;
+	GLuint mFramebuffer;
+
+	mat4 mMatrices[MaxCascades];
+	float mSplitDistances[MaxCascades];
+	vec3 mLightPositions[MaxCascades];
+
+	// Light projection each static layer was rendered with.
+	mat4 mStaticMatrices[MaxCascades];
+	bool mStaticLayerValid[MaxCascades];
+	unsigned int mStaticLayerRenderCount;
+};
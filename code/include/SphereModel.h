@@ -2,6 +2,8 @@
 
 #include "Model.h"
 
+#include <vector>
+
 class SphereModel : public Model
 {
 public:
@@ -19,7 +21,10 @@ public:
     virtual bool ContainsPoint(vec3 position);
     virtual bool IntersectsPlane(vec3 planePoint, vec3 planeNormal);
 
-    unsigned int static SphereModelVAO(float radius, float heightOffset, int radialSubdivisions, int verticalSubdivisions, int& numOfVertices);
+    // Triangle list of a UV sphere, built on the CPU only.
+    static std::vector<TexturedColoredNormalVertex> SphereVertices(float radius, float heightOffset, int radialSubdivisions, int verticalSubdivisions);
+    // shadowVAO, when given, receives a position only VAO of the same sphere, and shadowVBO its buffer, which the caller deletes with it.
+    unsigned int static SphereModelVAO(float radius, float heightOffset, int radialSubdivisions, int verticalSubdivisions, int& numOfVertices, unsigned int* shadowVAO = nullptr, unsigned int* shadowVBO = nullptr);
 private:
     unsigned int mVAO;
     unsigned int mVBO;
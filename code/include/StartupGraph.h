@@ -0,0 +1,83 @@
+#pragma once
+
+#include "JobSystem.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Startup work as a dependency graph. Worker tasks go to the job system as soon as their dependencies are done. Context tasks,
+// the GL uploads and program links, run on the thread owning the GL context, in the order their inputs complete.
+// Every task is timed, so the report can compare the time to the longest chain of dependent tasks.
+class StartupGraph
+{
+public:
+	enum EThread
+	{
+		WorkerThread,
+		ContextThread
+	};
+
+	typedef unsigned int TaskId;
+	typedef std::function<void()> TaskFunction;
+
+	// Without workers, worker tasks run on the context thread as well.
+	StartupGraph(JobSystem* jobSystem);
+
+	StartupGraph(const StartupGraph&) = delete;
+	StartupGraph& operator=(const StartupGraph&) = delete;
+
+	// Dependencies must have been added first, which also keeps the graph free of cycles.
+	TaskId Add(const std::string& name, EThread thread, TaskFunction function, std::initializer_list<TaskId> dependencies = {});
+	TaskId Add(const std::string& name, EThread thread, TaskFunction function, const std::vector<TaskId>& dependencies);
+
+	// Run every task and return once they are all done. Call once, from the context thread.
+	void Run();
+
+	// Start, duration and thread of every task, then the total against the longest chain.
+	void PrintReport() const;
+
+	double GetWallMilliseconds() const { return mWallMilliseconds; }
+	// Sum of the durations along the longest chain of dependent tasks, the best any schedule could do.
+	double GetCriticalPathMilliseconds() const;
+
+private:
+	struct Task
+	{
+		std::string name;
+		// The name as a CPU profiler zone.
+		const char* profileName;
+		EThread thread;
+		TaskFunction function;
+		std::vector<TaskId> dependencies;
+		std::vector<TaskId> dependents;
+		unsigned int remainingDependencies;
+
+		double startMilliseconds;
+		double durationMilliseconds;
+		int threadIndex;
+	};
+
+	// Run a task, then release the dependents it was the last dependency of.
+	void Execute(TaskId task);
+	void Dispatch(const std::vector<TaskId>& readyTasks);
+	// Longest chain ending with each task, and the task before it on that chain.
+	void ComputeCriticalPaths(std::vector<double>& chainMilliseconds, std::vector<int>& previousTask) const;
+
+	JobSystem* mJobSystem;
+	std::vector<Task> mTasks;
+
+	std::chrono::steady_clock::time_point mStartTime;
+	double mWallMilliseconds;
+
+	// Guards the remaining dependency counts, the context queue and the finished count.
+	std::mutex mMutex;
+	std::condition_variable mCondition;
+	std::deque<TaskId> mContextQueue;
+	unsigned int mFinishedCount;
+};
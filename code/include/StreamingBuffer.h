@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Model.h"
+
+// A ring buffer for data rewritten every frame (instance transforms, culled lists, particles...).
+// The buffer holds FrameCount regions. Each frame sub-allocates linearly from its own region, then a fence is placed.
+// A region is only reused once the GPU has signaled its fence, so writes never wait on draws still in flight.
+// With ARB_buffer_storage the whole buffer is mapped once, persistently. Otherwise every allocation maps its range
+// unsynchronized, which is safe for the same reason.
+class StreamingBuffer
+{
+public:
+	static const int FrameCount = 3;
+
+	StreamingBuffer(GLsizeiptr frameSize, bool allowPersistentMapping = true);
+	~StreamingBuffer();
+
+	StreamingBuffer(const StreamingBuffer&) = delete;
+	StreamingBuffer& operator=(const StreamingBuffer&) = delete;
+
+	// Waits, if needed, until the GPU is done with the region of this frame.
+	void BeginFrame();
+	// Fences the region of this frame and moves on to the next one.
+	void EndFrame();
+
+	// Reserves size bytes in the current frame's region and returns a write only pointer to them, nullptr when the region is full.
+	// offset receives the position of the data in the buffer, to use with glBindBufferRange or the attribute pointers.
+	// Call Unmap before any draw reads the data.
+	void* Map(GLsizeiptr size, GLintptr& offset, GLsizeiptr alignment = 16);
+	void Unmap();
+
+	GLuint GetBuffer() const { return mBuffer; }
+	GLsizeiptr GetFrameSize() const { return mFrameSize; }
+	bool IsPersistent() const { return mPersistentPointer != nullptr; }
+
+	// Bytes allocated this frame, frames that had to wait on the GPU and allocations that did not fit.
+	GLsizeiptr GetUsedBytes() const { return mFrameOffset; }
+	unsigned int GetStallCount() const { return mStallCount; }
+	unsigned int GetOverflowCount() const { return mOverflowCount; }
+	void PrintStatistics() const;
+
+private:
+	GLuint mBuffer;
+	GLsizeiptr mFrameSize;
+	GLsync mFences[FrameCount];
+	int mFrame;
+
+	// Offset of the next allocation, relative to the start of the current frame's region.
+	GLsizeiptr mFrameOffset;
+
+	unsigned char* mPersistentPointer;
+	bool mMapped;
+
+	unsigned int mStallCount;
+	unsigned int mOverflowCount;
+};
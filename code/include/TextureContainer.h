@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A texture with its whole mip chain filtered offline, stored as the bytes GL uploads.
+// Opening maps the file into memory, so loading costs no decoding and no copy before the upload.
+// Needs no GL context: the converter uses it on its own and the game opens files on worker threads.
+class TextureContainer
+{
+public:
+	enum EFormat : uint32_t
+	{
+		FormatR8 = 1,
+		FormatRGB8 = 3,
+		FormatRGBA8 = 4,
+		FormatBC1 = 16 // DXT1, 8 bytes per 4x4 block, for opaque textures.
+	};
+
+	struct Level
+	{
+		uint32_t width;
+		uint32_t height;
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	static const char* const Extension;
+
+	TextureContainer();
+	~TextureContainer();
+
+	TextureContainer(const TextureContainer&) = delete;
+	TextureContainer& operator=(const TextureContainer&) = delete;
+
+	// Map a container and check its header and level table. False if it is missing or invalid.
+	bool Open(const std::string& path);
+	void Close();
+	bool IsOpen() const { return mData != nullptr; }
+
+	// Touch every page of the mapping, so the upload does not fault the file in on the context's thread.
+	void Prefetch() const;
+
+	uint32_t GetWidth() const { return mLevels.empty() ? 0 : mLevels[0].width; }
+	uint32_t GetHeight() const { return mLevels.empty() ? 0 : mLevels[0].height; }
+	EFormat GetFormat() const { return mFormat; }
+	bool IsCompressed() const { return mFormat == FormatBC1; }
+	unsigned int GetLevelCount() const { return (unsigned int)mLevels.size(); }
+	const Level& GetLevel(unsigned int level) const { return mLevels[level]; }
+	const unsigned char* GetLevelData(unsigned int level) const { return mData + mLevels[level].offset; }
+
+	// Sum of the sizes of every level, what the texture costs once uploaded.
+	uint64_t GetTotalSize() const;
+
+	// Filter the full mip chain of an image and write it. Compression only applies to 3 component images.
+	static bool Write(const std::string& path, const unsigned char* pixels, int width, int height, int components, bool compress);
+
+	// Path of the container built from an image: the same path with the container's extension.
+	static std::string GetContainerPath(const std::string& imagePath);
+
+	// Number of levels down to 1x1, and the size of a level of the given format.
+	static unsigned int GetMipLevelCount(uint32_t width, uint32_t height);
+	static uint64_t GetLevelSize(EFormat format, uint32_t width, uint32_t height);
+
+	// Halve an image with a 2x2 box filter, the same filter glGenerateMipmap uses.
+	static void Downsample(const unsigned char* source, uint32_t width, uint32_t height, int components, std::vector<unsigned char>& destination);
+
+	// Block compression, and its inverse for drivers without S3TC.
+	static void CompressBC1(const unsigned char* rgb, uint32_t width, uint32_t height, std::vector<unsigned char>& blocks);
+	static void DecompressBC1(const unsigned char* blocks, uint32_t width, uint32_t height, std::vector<unsigned char>& rgb);
+
+private:
+	const unsigned char* mData;
+	size_t mSize;
+	EFormat mFormat;
+	std::vector<Level> mLevels;
+
+	// Platform handles of the mapping.
+	void* mFileHandle;
+	void* mMappingHandle;
+};
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "JobSystem.h"
+#include "TextureContainer.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Every texture of the scene, keyed by path. Loading a path twice gives back the same texture with one more reference,
+// and a texture is deleted when its last reference is released.
+// The GPU size of every texture is tracked. Over budget, textures lose their top mip level, one level at a time, until the total
+// fits again: first those not drawn with for RecentFrames frames, least recently used first, then the ones in use, least drawn first.
+// Streamed textures start as a placeholder texel and are decoded on the job system, then their levels are uploaded
+// from the smallest up, a few per frame, so the first frames do not wait for them.
+class TextureManager
+{
+public:
+	// Pixels of an image file, decoded but not uploaded yet.
+	// When texture_converter built a container for the image, that is mapped instead and nothing is decoded.
+	struct DecodedTexture
+	{
+		std::string path;
+		int width = 0;
+		int height = 0;
+		int components = 0;
+		unsigned char* data = nullptr;
+		TextureContainer* container = nullptr;
+	};
+
+	// Textures are never shrunk below this size on their larger side.
+	static const int MinimumDroppedSize = 32;
+	// Textures drawn with in this many last frames are in use.
+	static const unsigned int RecentFrames = 60;
+
+	// A budget of 0 means no budget. Without a job system, streamed textures are decoded by Update, one per frame.
+	TextureManager(uint64_t budgetBytes = 0, JobSystem* jobSystem = nullptr);
+	// Waits for the decodes still running.
+	~TextureManager();
+
+	TextureManager(const TextureManager&) = delete;
+	TextureManager& operator=(const TextureManager&) = delete;
+
+	// Decoding needs no GL context, so it can run on any thread.
+	static DecodedTexture Decode(const std::string& path);
+	// Drop decoded pixels that will not be uploaded.
+	static void Free(DecodedTexture& decoded);
+
+	// Upload decoded pixels and take a reference to the texture. If the path was loaded already, the pixels are only freed.
+	// A file that could not be read becomes a 1x1 texture of the placeholder colour, so it is visible rather than black.
+	GLuint Upload(DecodedTexture& decoded, const glm::vec4& placeholder = glm::vec4(1.0f));
+	// Take a reference to the texture of a path, decoding and uploading it first if needed.
+	GLuint Acquire(const std::string& path, const glm::vec4& placeholder = glm::vec4(1.0f));
+	// Take a reference to the texture of a path right away. Until its levels stream in, it is a texel of the placeholder colour.
+	GLuint Stream(const std::string& path, const glm::vec4& placeholder = glm::vec4(1.0f));
+	void Release(GLuint texture);
+
+	// Mark a texture as used this frame by drawCount draws, for the order textures are shrunk in.
+	void Touch(GLuint texture, unsigned int drawCount = 1);
+	// Call once per frame: advance the frame count, upload streamed levels within the upload budget and enforce the memory budget.
+	void Update();
+
+	void SetBudget(uint64_t budgetBytes);
+	uint64_t GetBudget() const { return mBudgetBytes; }
+	uint64_t GetResidentBytes() const { return mResidentBytes; }
+	size_t GetTextureCount() const { return mEntries.size(); }
+
+	// Streamed bytes and time spent uploading per frame. At least one level is uploaded per frame, whatever its size.
+	void SetUploadBudget(uint64_t bytesPerFrame, double millisecondsPerFrame);
+	// Textures still waiting for a decode or for some of their levels.
+	unsigned int GetStreamingCount() const { return mStreamingCount; }
+	void PrintStatistics() const;
+
+private:
+	// One level ready to be uploaded. The data lives in the stream: in its decoded image, its own mips or its container.
+	struct StreamLevel
+	{
+		uint32_t width;
+		uint32_t height;
+		const unsigned char* data;
+		uint64_t size;
+	};
+
+	struct StreamingTexture
+	{
+		GLuint texture;
+		std::string path;
+		DecodedTexture decoded;
+		TextureContainer::EFormat format;
+		std::vector<StreamLevel> levels;
+		std::vector<std::vector<unsigned char>> mips;
+		// Next level to upload, counting down to 0.
+		int nextLevel;
+		bool cancelled;
+	};
+
+	struct Entry
+	{
+		std::string path;
+		unsigned int references;
+		uint64_t bytes;
+		// Levels from base to base + count - 1 are resident. Only streamed textures have a base above 0, until they finish.
+		unsigned int baseLevel;
+		unsigned int levelCount;
+		unsigned int droppedLevels;
+		uint64_t lastUsedFrame;
+		// Draws this frame, and their running average over the last frames.
+		unsigned int frameDraws;
+		float averageDraws;
+		bool placeholder;
+		StreamingTexture* stream;
+	};
+
+	GLuint CreateTexture(DecodedTexture& decoded, const glm::vec4& placeholder, bool& isPlaceholder);
+	// Move every level of the bound texture up by one, reading them back from the GPU. False if it is already small.
+	bool DropTopLevel(Entry& entry);
+	// Size of the given levels of the bound texture.
+	static uint64_t MeasureBytes(unsigned int baseLevel, unsigned int levelCount);
+
+	// Decode a stream and lay out its levels. Runs on the job system.
+	static void PrepareStream(StreamingTexture* stream);
+	// Take the streams decoded since the last frame, then upload levels until the upload budget is spent.
+	void UpdateStreams();
+	// Upload the next level of a stream. True once the stream is complete, or failed to load.
+	bool UploadNextLevel(StreamingTexture* stream);
+	void FinishStream(StreamingTexture* stream);
+
+	std::unordered_map<std::string, GLuint> mTexturesByPath;
+	std::unordered_map<GLuint, Entry> mEntries;
+
+	uint64_t mBudgetBytes;
+	uint64_t mResidentBytes;
+	uint64_t mFrame;
+
+	JobSystem* mJobSystem;
+	uint64_t mUploadBytesPerFrame;
+	double mUploadMillisecondsPerFrame;
+	// Streams left for Update to decode when there are no workers, then decoded streams waiting for their levels.
+	std::vector<StreamingTexture*> mPendingStreams;
+	std::vector<StreamingTexture*> mActiveStreams;
+	std::vector<JobSystem::JobHandle> mStreamJobs;
+	// Guards the decoded streams handed from the job system to Update.
+	std::mutex mStreamMutex;
+	std::vector<StreamingTexture*> mDecodedStreams;
+	unsigned int mStreamingCount;
+
+	unsigned int mDuplicateLoads;
+	unsigned int mLevelsDropped;
+	unsigned int mLevelsStreamed;
+	uint64_t mBytesStreamed;
+	bool mBudgetWarningShown;
+};
@@ -4,10 +4,187 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <map>
+#include <algorithm>
+#include <iterator>
+#include <filesystem>
+#include <system_error>
 using namespace std;
 
-int loadSHADER(string vertex_file_path, string fragment_file_path, string geometry_file_path = "") 
+// Insert a #define for each feature flag right after the #version line, which must stay the first directive.
+// A #line directive follows so compiler messages keep the line numbers of the file.
+string injectShaderDefines(const string& source, const vector<string>& defines)
 {
+	if (defines.empty())
+		return source;
+
+	string defineLines;
+	for (const string& define : defines)
+		defineLines += "#define " + define + "\n";
+
+	size_t versionPosition = source.find("#version");
+	size_t lineEnd = versionPosition == string::npos ? string::npos : source.find('\n', versionPosition);
+	if (lineEnd == string::npos)
+		return defineLines + "#line 1\n" + source;
+
+	return source.substr(0, lineEnd + 1) + defineLines + "#line 2\n" + source.substr(lineEnd + 1);
+}
+
+// Linked programs are saved here with glGetProgramBinary and loaded back on later runs instead of being compiled.
+// An empty directory disables the cache.
+string shaderBinaryCacheDirectory = "shader_cache/";
+
+// How the programs of this run were obtained, to tell cold and warm startups apart.
+struct ShaderLoadStatistics
+{
+	unsigned int compiled = 0;
+	unsigned int loadedFromCache = 0;
+	unsigned int rejectedFromCache = 0;
+};
+
+ShaderLoadStatistics& shaderLoadStatistics()
+{
+	static ShaderLoadStatistics statistics;
+	return statistics;
+}
+
+bool isShaderBinaryCacheSupported()
+{
+	if (shaderBinaryCacheDirectory.empty() || !(GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary))
+		return false;
+
+	// Some drivers expose the entry points without a single binary format.
+	GLint FormatCount = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &FormatCount);
+	return FormatCount > 0;
+}
+
+// 64 bit FNV-1a.
+unsigned long long hashShaderKey(const string& key)
+{
+	unsigned long long hash = 14695981039346656037ull;
+	for (char character : key)
+	{
+		hash ^= (unsigned char)character;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// Cache file of a program. Any change to the sources, the defines or the driver leads to another file.
+// Returns an empty path when the cache is unavailable or a source cannot be read.
+string shaderBinaryCachePath(const string& vertex_file_path, const string& fragment_file_path, const string& geometry_file_path, const vector<string>& defines)
+{
+	if (!isShaderBinaryCacheSupported())
+		return "";
+
+	string Key;
+	for (const string& path : { vertex_file_path, fragment_file_path, geometry_file_path })
+	{
+		if (path == "")
+			continue;
+
+		std::ifstream SourceStream(path, std::ios::in | std::ios::binary);
+		if (!SourceStream.is_open())
+			return "";
+
+		std::stringstream sstr;
+		sstr << SourceStream.rdbuf();
+		Key += path + '\0' + sstr.str() + '\0';
+	}
+
+	for (const string& define : defines)
+		Key += define + '\0';
+
+	for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+	{
+		const GLubyte* value = glGetString(name);
+		Key += string(value ? (const char*)value : "") + '\0';
+	}
+
+	char FileName[32];
+	snprintf(FileName, sizeof(FileName), "%016llx.bin", hashShaderKey(Key));
+	return shaderBinaryCacheDirectory + FileName;
+}
+
+// Returns 0 when there is no cached binary or the driver rejects it.
+GLuint loadShaderProgramBinary(const string& cache_path)
+{
+	if (cache_path == "")
+		return 0;
+
+	std::ifstream BinaryStream(cache_path, std::ios::in | std::ios::binary);
+	if (!BinaryStream.is_open())
+		return 0;
+
+	GLenum Format = 0;
+	BinaryStream.read((char*)&Format, sizeof(Format));
+	std::vector<char> Binary((std::istreambuf_iterator<char>(BinaryStream)), std::istreambuf_iterator<char>());
+	BinaryStream.close();
+
+	GLint Result = GL_FALSE;
+	GLuint ProgramID = 0;
+	if (!Binary.empty())
+	{
+		ProgramID = glCreateProgram();
+		glProgramBinary(ProgramID, Format, &Binary[0], (GLsizei)Binary.size());
+		glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+	}
+
+	// Drivers may refuse a binary at any time, after an update for instance. Drop it and compile from source.
+	if (Result != GL_TRUE)
+	{
+		if (ProgramID != 0)
+			glDeleteProgram(ProgramID);
+		std::remove(cache_path.c_str());
+		shaderLoadStatistics().rejectedFromCache++;
+		return 0;
+	}
+
+	shaderLoadStatistics().loadedFromCache++;
+	return ProgramID;
+}
+
+void saveShaderProgramBinary(GLuint ProgramID, const string& cache_path)
+{
+	if (cache_path == "")
+		return;
+
+	GLint BinaryLength = 0;
+	glGetProgramiv(ProgramID, GL_PROGRAM_BINARY_LENGTH, &BinaryLength);
+	if (BinaryLength <= 0)
+		return;
+
+	std::vector<char> Binary(BinaryLength);
+	GLenum Format = 0;
+	glGetProgramBinary(ProgramID, BinaryLength, NULL, &Format, &Binary[0]);
+
+	std::error_code Error;
+	std::filesystem::create_directories(shaderBinaryCacheDirectory, Error);
+
+	// Write next to the final file and rename, so an interrupted run never leaves a truncated binary behind.
+	string TemporaryPath = cache_path + ".tmp";
+	std::ofstream BinaryStream(TemporaryPath, std::ios::out | std::ios::binary);
+	if (!BinaryStream.is_open())
+		return;
+
+	BinaryStream.write((const char*)&Format, sizeof(Format));
+	BinaryStream.write(&Binary[0], Binary.size());
+	BinaryStream.close();
+
+	if (BinaryStream.fail())
+		std::filesystem::remove(TemporaryPath, Error);
+	else
+		std::filesystem::rename(TemporaryPath, cache_path, Error);
+}
+
+int loadSHADER(string vertex_file_path, string fragment_file_path, string geometry_file_path = "", const vector<string>& defines = vector<string>())
+{
+	// Use the binary linked by an earlier run when there is one.
+	string BinaryCachePath = shaderBinaryCachePath(vertex_file_path, fragment_file_path, geometry_file_path, defines);
+	GLuint CachedProgramID = loadShaderProgramBinary(BinaryCachePath);
+	if (CachedProgramID != 0)
+		return CachedProgramID;
 
 	// Create the shaders.
 	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
@@ -22,7 +199,7 @@ int loadSHADER(string vertex_file_path, string fragment_file_path, string geomet
 	if (VertexShaderStream.is_open()) {
 		std::stringstream sstr;
 		sstr << VertexShaderStream.rdbuf();
-		VertexShaderCode = sstr.str();
+		VertexShaderCode = injectShaderDefines(sstr.str(), defines);
 		VertexShaderStream.close();
 	}
 	else {
@@ -37,7 +214,7 @@ int loadSHADER(string vertex_file_path, string fragment_file_path, string geomet
 	if (FragmentShaderStream.is_open()) {
 		std::stringstream sstr;
 		sstr << FragmentShaderStream.rdbuf();
-		FragmentShaderCode = sstr.str();
+		FragmentShaderCode = injectShaderDefines(sstr.str(), defines);
 		FragmentShaderStream.close();
 	}
 
@@ -84,7 +261,7 @@ int loadSHADER(string vertex_file_path, string fragment_file_path, string geomet
 		if (GeometryShaderStream.is_open()) {
 			std::stringstream sstr;
 			sstr << GeometryShaderStream.rdbuf();
-			GeometryShaderCode = sstr.str();
+			GeometryShaderCode = injectShaderDefines(sstr.str(), defines);
 			GeometryShaderStream.close();
 		}
 
@@ -112,7 +289,10 @@ int loadSHADER(string vertex_file_path, string fragment_file_path, string geomet
 	glAttachShader(ProgramID, FragmentShaderID);
 	if (geometry_file_path != "")
 		glAttachShader(ProgramID, GeometryShaderID);
+	if (BinaryCachePath != "")
+		glProgramParameteri(ProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(ProgramID);
+	shaderLoadStatistics().compiled++;
 
 	// Check the program
 	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
@@ -123,6 +303,9 @@ int loadSHADER(string vertex_file_path, string fragment_file_path, string geomet
 		printf("%s\n", &ProgramErrorMessage[0]);
 	}
 
+	if (Result == GL_TRUE)
+		saveShaderProgramBinary(ProgramID, BinaryCachePath);
+
 	glDetachShader(ProgramID, VertexShaderID);
 	glDetachShader(ProgramID, FragmentShaderID);
 
@@ -136,4 +319,33 @@ int loadSHADER(string vertex_file_path, string fragment_file_path, string geomet
 	}
 
 	return ProgramID;
-}
\ No newline at end of file
+}
+
+// Programs built by loadShaderPermutation, keyed by their source files and sorted defines.
+map<string, GLuint>& shaderPermutationCache()
+{
+	static map<string, GLuint> cache;
+	return cache;
+}
+
+// The program built from the files with the given feature flags defined. Each permutation is only compiled once,
+// asking for it again returns the same program. The order of the defines does not matter.
+int loadShaderPermutation(string vertex_file_path, string fragment_file_path, vector<string> defines, string geometry_file_path = "")
+{
+	sort(defines.begin(), defines.end());
+	defines.erase(unique(defines.begin(), defines.end()), defines.end());
+
+	string key = vertex_file_path + "|" + fragment_file_path + "|" + geometry_file_path;
+	for (const string& define : defines)
+		key += "|" + define;
+
+	map<string, GLuint>::iterator cached = shaderPermutationCache().find(key);
+	if (cached != shaderPermutationCache().end())
+		return cached->second;
+
+	int program = loadSHADER(vertex_file_path, fragment_file_path, geometry_file_path, defines);
+	if (program != 0)
+		shaderPermutationCache()[key] = program;
+
+	return program;
+}
@@ -0,0 +1,112 @@
+#include "CameraPath.h"
+
+#include <glm/gtc/constants.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+namespace
+{
+	// Uniform Catmull-Rom between b and c, u from 0 to 1.
+	vec3 CatmullRom(const vec3& a, const vec3& b, const vec3& c, const vec3& d, float u)
+	{
+		float u2 = u * u;
+		float u3 = u2 * u;
+		return 0.5f * ((2.0f * b) + (c - a) * u + (2.0f * a - 5.0f * b + 4.0f * c - d) * u2 + (3.0f * b - a - 3.0f * c + d) * u3);
+	}
+}
+
+bool CameraPath::Load(const string& path)
+{
+	ifstream file(path);
+	if (!file)
+	{
+		cout << "Could not open the camera path " << path << ".\n";
+		return false;
+	}
+
+	mKeyframes.clear();
+	string line;
+	int lineNumber = 0;
+	while (getline(file, line))
+	{
+		lineNumber++;
+		size_t first = line.find_first_not_of(" \t\r");
+		if (first == string::npos || line[first] == '#')
+			continue;
+
+		istringstream values(line);
+		Keyframe keyframe;
+		if (!(values >> keyframe.time >> keyframe.position.x >> keyframe.position.y >> keyframe.position.z >> keyframe.lookAt.x >> keyframe.lookAt.y >> keyframe.lookAt.z))
+		{
+			cout << path << ":" << lineNumber << ": expected \"time x y z lookAtX lookAtY lookAtZ\".\n";
+			return false;
+		}
+		if (!mKeyframes.empty() && keyframe.time <= mKeyframes.back().time)
+		{
+			cout << path << ":" << lineNumber << ": keyframe times must increase.\n";
+			return false;
+		}
+		mKeyframes.push_back(keyframe);
+	}
+
+	if (mKeyframes.size() < 2)
+	{
+		cout << "The camera path " << path << " needs at least two keyframes.\n";
+		return false;
+	}
+	return true;
+}
+
+CameraPath CameraPath::Orbit(vec3 center, float radius, float height, float duration)
+{
+	// Enough keyframes for the spline to stay close to the circle.
+	const int keyframeCount = 16;
+
+	CameraPath path;
+	for (int i = 0; i <= keyframeCount; i++)
+	{
+		float angle = two_pi<float>() * i / keyframeCount;
+		vec3 position = center + vec3(radius * cos(angle), height, radius * sin(angle));
+		path.AddKeyframe(duration * i / keyframeCount, position, center);
+	}
+	return path;
+}
+
+void CameraPath::AddKeyframe(float time, vec3 position, vec3 lookAt)
+{
+	mKeyframes.push_back({ time, position, lookAt });
+}
+
+void CameraPath::Sample(float time, vec3& position, vec3& lookAt) const
+{
+	if (mKeyframes.empty())
+		return;
+
+	if (time <= mKeyframes.front().time || mKeyframes.size() == 1)
+	{
+		position = mKeyframes.front().position;
+		lookAt = mKeyframes.front().lookAt;
+		return;
+	}
+	if (time >= mKeyframes.back().time)
+	{
+		position = mKeyframes.back().position;
+		lookAt = mKeyframes.back().lookAt;
+		return;
+	}
+
+	// Segment from keyframe b to c, the end keyframes stand in for their missing neighbours.
+	size_t c = upper_bound(mKeyframes.begin(), mKeyframes.end(), time, [](float t, const Keyframe& keyframe) { return t < keyframe.time; }) - mKeyframes.begin();
+	size_t b = c - 1;
+	size_t a = b > 0 ? b - 1 : b;
+	size_t d = std::min(c + 1, mKeyframes.size() - 1);
+
+	float u = (time - mKeyframes[b].time) / (mKeyframes[c].time - mKeyframes[b].time);
+	position = CatmullRom(mKeyframes[a].position, mKeyframes[b].position, mKeyframes[c].position, mKeyframes[d].position, u);
+	lookAt = CatmullRom(mKeyframes[a].lookAt, mKeyframes[b].lookAt, mKeyframes[c].lookAt, mKeyframes[d].lookAt, u);
+}
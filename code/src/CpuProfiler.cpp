@@ -0,0 +1,132 @@
+#include "CpuProfiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+
+atomic<bool> CpuProfiler::sRecording(false);
+
+namespace
+{
+	struct ZoneRecord
+	{
+		const char* name;
+		uint64_t start;
+		uint64_t end;
+	};
+
+	// Written by its thread only. The count is published after the record, so a reader sees whole records below it.
+	struct ThreadBuffer
+	{
+		ZoneRecord records[CpuProfiler::RingSize];
+		atomic<uint64_t> count{ 0 };
+		unsigned int threadId = 0;
+		string name;
+	};
+
+	// Buffers are never freed, threads may exit before the export.
+	mutex sRegistryMutex;
+	vector<unique_ptr<ThreadBuffer>> sBuffers;
+	unordered_set<string> sInternedNames;
+
+	thread_local ThreadBuffer* tBuffer = nullptr;
+
+	ThreadBuffer* GetThreadBuffer()
+	{
+		if (!tBuffer)
+		{
+			lock_guard<mutex> lock(sRegistryMutex);
+			sBuffers.push_back(make_unique<ThreadBuffer>());
+			tBuffer = sBuffers.back().get();
+			tBuffer->threadId = (unsigned int)sBuffers.size();
+			tBuffer->name = "thread " + to_string(tBuffer->threadId);
+		}
+		return tBuffer;
+	}
+
+	void WriteJsonString(ofstream& file, const char* text)
+	{
+		file << '"';
+		for (const char* c = text; *c; c++)
+		{
+			if (*c == '"' || *c == '\\')
+				file << '\\';
+			file << *c;
+		}
+		file << '"';
+	}
+}
+
+void CpuProfiler::SetThreadName(const string& name)
+{
+	ThreadBuffer* buffer = GetThreadBuffer();
+	lock_guard<mutex> lock(sRegistryMutex);
+	buffer->name = name;
+}
+
+const char* CpuProfiler::Intern(const string& name)
+{
+	lock_guard<mutex> lock(sRegistryMutex);
+	return sInternedNames.insert(name).first->c_str();
+}
+
+void CpuProfiler::Record(const char* name, uint64_t startNanoseconds, uint64_t endNanoseconds)
+{
+	ThreadBuffer* buffer = GetThreadBuffer();
+	uint64_t index = buffer->count.load(memory_order_relaxed);
+	buffer->records[index & (RingSize - 1)] = { name, startNanoseconds, endNanoseconds };
+	buffer->count.store(index + 1, memory_order_release);
+}
+
+bool CpuProfiler::WriteChromeTrace(const string& path)
+{
+	ofstream file(path, ios::trunc);
+	if (!file)
+		return false;
+
+	lock_guard<mutex> lock(sRegistryMutex);
+
+	// Timestamps start at the first zone recorded.
+	uint64_t origin = UINT64_MAX;
+	for (const unique_ptr<ThreadBuffer>& buffer : sBuffers)
+	{
+		uint64_t count = buffer->count.load(memory_order_acquire);
+		for (uint64_t i = count > RingSize ? count - RingSize : 0; i < count; i++)
+			origin = std::min(origin, buffer->records[i & (RingSize - 1)].start);
+	}
+
+	// Complete events ("X") in microseconds, then the thread names as metadata events.
+	// Fixed notation down to the nanosecond: the default 6 significant digits would round starts past a second of capture.
+	file << fixed << setprecision(3);
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool first = true;
+	for (const unique_ptr<ThreadBuffer>& buffer : sBuffers)
+	{
+		uint64_t count = buffer->count.load(memory_order_acquire);
+		for (uint64_t i = count > RingSize ? count - RingSize : 0; i < count; i++)
+		{
+			const ZoneRecord& record = buffer->records[i & (RingSize - 1)];
+			file << (first ? "\n" : ",\n") << "{\"name\":";
+			WriteJsonString(file, record.name);
+			file << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId << ",\"ts\":" << (record.start - origin) / 1000.0
+				<< ",\"dur\":" << (record.end - record.start) / 1000.0 << "}";
+			first = false;
+		}
+	}
+	for (const unique_ptr<ThreadBuffer>& buffer : sBuffers)
+	{
+		file << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId << ",\"args\":{\"name\":";
+		WriteJsonString(file, buffer->name.c_str());
+		file << "}}";
+		first = false;
+	}
+	file << "\n]}\n";
+
+	return (bool)file;
+}
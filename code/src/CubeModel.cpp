@@ -8,7 +8,7 @@
 
 using namespace glm;
 
-unsigned int CubeModel::CubeModelVAO()
+std::vector<Model::TexturedColoredNormalVertex> CubeModel::CubeVertices()
 {
 	TexturedColoredNormalVertex texturedCubeVertexArray[] = {
 			TexturedColoredNormalVertex(vec3(-0.5f, 0.0f, 0.5f),	vec3(1.0f, 0.0f, 0.0f),	 vec2(0.0f, 0.0f),	vec3(0.0f, 0.0f, 1.0f)),
@@ -60,6 +60,13 @@ unsigned int CubeModel::CubeModelVAO()
 			TexturedColoredNormalVertex(vec3(-0.5f, 0.0f, -0.5f),	vec3(1.0f, 0.0f, 1.0f),	 vec2(1.0f, 0.0f),	vec3(-1.0f, 0.0f, 0.0f))
 	};
 
+	return std::vector<TexturedColoredNormalVertex>(texturedCubeVertexArray, texturedCubeVertexArray + sizeof(texturedCubeVertexArray) / sizeof(TexturedColoredNormalVertex));
+}
+
+unsigned int CubeModel::CubeModelVAO(unsigned int* shadowVAO, unsigned int* shadowVBO)
+{
+	std::vector<TexturedColoredNormalVertex> vertices = CubeVertices();
+
 	// Create a vertex array
 	GLuint vertexArrayObject;
 	glGenVertexArrays(1, &vertexArrayObject);
@@ -69,7 +76,7 @@ unsigned int CubeModel::CubeModelVAO()
 	GLuint vertexBufferObject;
 	glGenBuffers(1, &vertexBufferObject);
 	glBindBuffer(GL_ARRAY_BUFFER, vertexBufferObject);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(texturedCubeVertexArray), texturedCubeVertexArray, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(TexturedColoredNormalVertex), vertices.data(), GL_STATIC_DRAW);
 
 	glVertexAttribPointer(0,                   // attribute 0 matches aPos in Vertex Shader
 		3,                   // size
@@ -108,14 +115,20 @@ unsigned int CubeModel::CubeModelVAO()
 	);
 	glEnableVertexAttribArray(3);
 
+	if (shadowVAO)
+	{
+		*shadowVAO = PositionOnlyVAO(vertices.data(), (int)vertices.size(), shadowVBO);
+		glBindVertexArray(vertexArrayObject);
+	}
+
 	return vertexArrayObject;
 }
 
-CubeModel::CubeModel() : Model() { }
+CubeModel::CubeModel() : Model(), mVAO(0), mVBO(0) { }
 
-CubeModel::CubeModel(vec3 position, vec3 rotation, vec3 scale) : Model(position, rotation, scale) { }
+CubeModel::CubeModel(vec3 position, vec3 rotation, vec3 scale) : Model(position, rotation, scale), mVAO(0), mVBO(0) { }
 
-CubeModel::CubeModel(vec3 position, vec3 rotation, vec3 scale, mat4 parent) : Model(position, rotation, scale, parent) { }
+CubeModel::CubeModel(vec3 position, vec3 rotation, vec3 scale, mat4 parent) : Model(position, rotation, scale, parent), mVAO(0), mVBO(0) { }
 
 CubeModel::CubeModel(vec3 size) : Model()
 {
@@ -228,6 +241,10 @@ CubeModel::CubeModel(vec3 size) : Model()
 
 CubeModel::~CubeModel()
 {
+	// Only cubes with their own VAO hold GPU objects, the others may live without a GL context.
+	if (mVAO == 0)
+		return;
+
 	// Free the GPU from the Vertex Buffer
 	glDeleteBuffers(1, &mVBO);
 	glDeleteVertexArrays(1, &mVAO);
@@ -0,0 +1,165 @@
+#include "Culling.h"
+
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CULLING_USE_SSE 1
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+using namespace glm;
+
+// Padding spheres sit far away with a negative radius so no plane can ever accept them.
+const float PADDING_RADIUS = -1.0e30f;
+
+// Based on Gribb & Hartmann, "Fast Extraction of Viewing Frustum Planes from the World-View-Projection Matrix".
+Frustum Frustum::FromMatrix(const mat4& viewProjection)
+{
+	// glm matrices are column major, so row i is (m[0][i], m[1][i], m[2][i], m[3][i]).
+	vec4 row0 = vec4(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+	vec4 row1 = vec4(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+	vec4 row2 = vec4(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+	vec4 row3 = vec4(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+	Frustum frustum;
+	frustum.planes[0] = row3 + row0; // Left.
+	frustum.planes[1] = row3 - row0; // Right.
+	frustum.planes[2] = row3 + row1; // Bottom.
+	frustum.planes[3] = row3 - row1; // Top.
+	frustum.planes[4] = row3 + row2; // Near.
+	frustum.planes[5] = row3 - row2; // Far.
+
+	// Normalize so the plane distances can be compared with sphere radii.
+	for (int i = 0; i < 6; i++)
+	{
+		float length = glm::length(vec3(frustum.planes[i]));
+		if (length > 0.0f)
+			frustum.planes[i] /= length;
+	}
+
+	return frustum;
+}
+
+CullingSystem::CullingSystem() : mCount(0) { }
+
+void CullingSystem::Resize(unsigned int count)
+{
+	mCount = count;
+
+	unsigned int paddedCount = (count + 3) & ~3u;
+	mCenterX.resize(paddedCount, 0.0f);
+	mCenterY.resize(paddedCount, 0.0f);
+	mCenterZ.resize(paddedCount, 0.0f);
+	mRadius.resize(paddedCount, PADDING_RADIUS);
+}
+
+unsigned int CullingSystem::Add(vec3 center, float radius)
+{
+	unsigned int index = mCount;
+	Resize(mCount + 1);
+	Update(index, center, radius);
+	return index;
+}
+
+unsigned int CullingSystem::Add(const mat4& worldMatrix, vec3 localCenter, float localRadius)
+{
+	vec4 sphere = TransformSphere(worldMatrix, localCenter, localRadius);
+	return Add(vec3(sphere), sphere.w);
+}
+
+void CullingSystem::Update(unsigned int index, vec3 center, float radius)
+{
+	mCenterX[index] = center.x;
+	mCenterY[index] = center.y;
+	mCenterZ[index] = center.z;
+	mRadius[index] = radius;
+}
+
+void CullingSystem::Update(unsigned int index, const mat4& worldMatrix, vec3 localCenter, float localRadius)
+{
+	vec4 sphere = TransformSphere(worldMatrix, localCenter, localRadius);
+	Update(index, vec3(sphere), sphere.w);
+}
+
+void CullingSystem::Clear()
+{
+	mCenterX.clear();
+	mCenterY.clear();
+	mCenterZ.clear();
+	mRadius.clear();
+	mCount = 0;
+}
+
+vec4 CullingSystem::TransformSphere(const mat4& worldMatrix, vec3 localCenter, float localRadius)
+{
+	vec3 center = vec3(worldMatrix * vec4(localCenter, 1.0f));
+
+	float scaleX = length(vec3(worldMatrix[0]));
+	float scaleY = length(vec3(worldMatrix[1]));
+	float scaleZ = length(vec3(worldMatrix[2]));
+	float radius = localRadius * std::max(scaleX, std::max(scaleY, scaleZ));
+
+	return vec4(center, radius);
+}
+
+unsigned int CullingSystem::Cull(const Frustum& frustum, vector<unsigned char>& visibility) const
+{
+	unsigned int paddedCount = (unsigned int)mRadius.size();
+	visibility.resize(paddedCount);
+
+	unsigned int visibleCount = 0;
+
+#ifdef CULLING_USE_SSE
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (int p = 0; p < 6; p++)
+	{
+		planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+		planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+		planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+		planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+	}
+
+	for (unsigned int i = 0; i < paddedCount; i += 4)
+	{
+		__m128 centerX = _mm_loadu_ps(&mCenterX[i]);
+		__m128 centerY = _mm_loadu_ps(&mCenterY[i]);
+		__m128 centerZ = _mm_loadu_ps(&mCenterZ[i]);
+		__m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&mRadius[i]));
+
+		// A sphere is outside as soon as it is entirely behind one plane.
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < 6; p++)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], centerX), _mm_mul_ps(planeY[p], centerY)),
+				_mm_add_ps(_mm_mul_ps(planeZ[p], centerZ), planeW[p]));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		for (int lane = 0; lane < 4; lane++)
+		{
+			unsigned char visible = (mask >> lane) & 1;
+			visibility[i + lane] = visible;
+			visibleCount += visible;
+		}
+	}
+#else
+	for (unsigned int i = 0; i < paddedCount; i++)
+	{
+		bool inside = true;
+		for (int p = 0; p < 6 && inside; p++)
+		{
+			const vec4& plane = frustum.planes[p];
+			float distance = plane.x * mCenterX[i] + plane.y * mCenterY[i] + plane.z * mCenterZ[i] + plane.w;
+			inside = distance >= -mRadius[i];
+		}
+
+		visibility[i] = inside ? 1 : 0;
+		visibleCount += inside ? 1 : 0;
+	}
+#endif
+
+	return visibleCount;
+}
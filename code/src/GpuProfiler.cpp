@@ -0,0 +1,128 @@
+#include "GpuProfiler.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+
+GpuProfiler::GpuProfiler() : mRunning(-1)
+{
+}
+
+GpuProfiler::~GpuProfiler()
+{
+	for (Section& section : mSections)
+		delete section.timer;
+}
+
+int GpuProfiler::AddSection(const string& name)
+{
+	if ((int)mSections.size() >= MaxSections)
+	{
+		cout << "GpuProfiler: too many sections, " << name << " is not measured.\n";
+		return -1;
+	}
+
+	mSections.push_back({ name, new GpuTimer() });
+	return (int)mSections.size() - 1;
+}
+
+void GpuProfiler::Begin(int section)
+{
+	if (section < 0 || section >= (int)mSections.size())
+		return;
+
+	End();
+	mSections[section].timer->Begin();
+	mRunning = section;
+}
+
+void GpuProfiler::End()
+{
+	if (mRunning < 0)
+		return;
+
+	mSections[mRunning].timer->End();
+	mRunning = -1;
+}
+
+bool GpuProfiler::IsSupported() const
+{
+	return !mSections.empty() && mSections[0].timer->IsSupported();
+}
+
+void GpuProfiler::Reset()
+{
+	for (Section& section : mSections)
+		section.timer->ResetAverage();
+}
+
+void GpuProfiler::PrintSummary() const
+{
+	if (!IsSupported())
+	{
+		cout << "GPU timers: not supported by the driver.\n";
+		return;
+	}
+
+	cout << "GPU timers, ms over the last " << GpuTimer::HistorySize << " frames at most:\n";
+	cout << "  " << left << setw(18) << "section" << right << setw(9) << "last" << setw(9) << "min" << setw(9) << "avg" << setw(9) << "p99" << "\n";
+	cout << fixed << setprecision(3);
+
+	double totalLast = 0.0, totalAverage = 0.0;
+	for (const Section& section : mSections)
+	{
+		const GpuTimer& timer = *section.timer;
+		cout << "  " << left << setw(18) << section.name << right << setw(9) << timer.GetLastMilliseconds() << setw(9) << timer.GetRollingMinimumMilliseconds()
+			<< setw(9) << timer.GetRollingAverageMilliseconds() << setw(9) << timer.GetRollingPercentileMilliseconds(99.0) << "\n";
+		totalLast += timer.GetLastMilliseconds();
+		totalAverage += timer.GetRollingAverageMilliseconds();
+	}
+	cout << "  " << left << setw(18) << "total" << right << setw(9) << totalLast << setw(9) << "" << setw(9) << totalAverage << "\n";
+
+	cout << defaultfloat << setprecision(6);
+}
+
+bool GpuProfiler::Write(const string& path) const
+{
+	bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+	return json ? WriteJson(path) : WriteCsv(path);
+}
+
+bool GpuProfiler::WriteCsv(const string& path) const
+{
+	ofstream file(path, ios::trunc);
+	if (!file)
+		return false;
+
+	file << "section,samples,last_ms,min_ms,avg_ms,p99_ms\n";
+	for (const Section& section : mSections)
+	{
+		const GpuTimer& timer = *section.timer;
+		file << section.name << "," << timer.GetRollingSampleCount() << "," << timer.GetLastMilliseconds() << "," << timer.GetRollingMinimumMilliseconds() << ","
+			<< timer.GetRollingAverageMilliseconds() << "," << timer.GetRollingPercentileMilliseconds(99.0) << "\n";
+	}
+
+	return (bool)file;
+}
+
+bool GpuProfiler::WriteJson(const string& path) const
+{
+	ofstream file(path, ios::trunc);
+	if (!file)
+		return false;
+
+	// Section names are plain words, nothing to escape.
+	file << "{\n\t\"supported\": " << (IsSupported() ? "true" : "false") << ",\n\t\"sections\": [";
+	for (size_t i = 0; i < mSections.size(); i++)
+	{
+		const GpuTimer& timer = *mSections[i].timer;
+		file << (i > 0 ? "," : "") << "\n\t\t{ \"name\": \"" << mSections[i].name << "\", \"samples\": " << timer.GetRollingSampleCount()
+			<< ", \"last_ms\": " << timer.GetLastMilliseconds() << ", \"min_ms\": " << timer.GetRollingMinimumMilliseconds()
+			<< ", \"avg_ms\": " << timer.GetRollingAverageMilliseconds() << ", \"p99_ms\": " << timer.GetRollingPercentileMilliseconds(99.0) << " }";
+	}
+	file << "\n\t]\n}\n";
+
+	return (bool)file;
+}
@@ -0,0 +1,118 @@
+#include "GpuTimer.h"
+
+#include <algorithm>
+#include <cmath>
+
+GpuTimer::GpuTimer() : mSupported(false), mNext(0), mRunning(false), mLastMilliseconds(0.0), mTotalMilliseconds(0.0), mSampleCount(0), mHistoryNext(0)
+{
+	for (int i = 0; i < QueryCount; i++)
+	{
+		mQueries[i] = 0;
+		mPending[i] = false;
+	}
+
+	mSupported = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+	if (mSupported)
+		glGenQueries(QueryCount, mQueries);
+}
+
+GpuTimer::~GpuTimer()
+{
+	if (mSupported)
+		glDeleteQueries(QueryCount, mQueries);
+}
+
+void GpuTimer::Begin()
+{
+	if (!mSupported || mRunning)
+		return;
+
+	// Only wait when every query of the ring is still in flight.
+	Collect(mPending[mNext], mNext);
+
+	glBeginQuery(GL_TIME_ELAPSED, mQueries[mNext]);
+	mRunning = true;
+}
+
+void GpuTimer::End()
+{
+	if (!mSupported || !mRunning)
+		return;
+
+	glEndQuery(GL_TIME_ELAPSED);
+	mPending[mNext] = true;
+	mNext = (mNext + 1) % QueryCount;
+	mRunning = false;
+}
+
+void GpuTimer::ResetAverage()
+{
+	mTotalMilliseconds = 0.0;
+	mSampleCount = 0;
+	mHistory.clear();
+	mHistoryNext = 0;
+}
+
+double GpuTimer::GetRollingMinimumMilliseconds() const
+{
+	return mHistory.empty() ? 0.0 : *std::min_element(mHistory.begin(), mHistory.end());
+}
+
+double GpuTimer::GetRollingAverageMilliseconds() const
+{
+	if (mHistory.empty())
+		return 0.0;
+
+	double total = 0.0;
+	for (double milliseconds : mHistory)
+		total += milliseconds;
+	return total / mHistory.size();
+}
+
+double GpuTimer::GetRollingPercentileMilliseconds(double percentile) const
+{
+	if (mHistory.empty())
+		return 0.0;
+
+	std::vector<double> sorted = mHistory;
+	size_t rank = (size_t)std::clamp(std::ceil(percentile / 100.0 * sorted.size()), 1.0, (double)sorted.size()) - 1;
+	std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+	return sorted[rank];
+}
+
+void GpuTimer::Collect(bool wait, int slot)
+{
+	// Oldest first, so the last measurement is the most recent one.
+	for (int i = 0; i < QueryCount; i++)
+	{
+		int index = (mNext + i) % QueryCount;
+		if (!mPending[index])
+			continue;
+
+		GLint available = 0;
+		glGetQueryObjectiv(mQueries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available || (wait && index == slot))
+			Read(index);
+	}
+}
+
+void GpuTimer::Read(int slot)
+{
+	GLuint64 nanoseconds = 0;
+	glGetQueryObjectui64v(mQueries[slot], GL_QUERY_RESULT, &nanoseconds);
+	mPending[slot] = false;
+
+	mLastMilliseconds = nanoseconds / 1.0e6;
+	mTotalMilliseconds += mLastMilliseconds;
+	mSampleCount++;
+
+	if (mHistory.size() < HistorySize)
+	{
+		mHistory.push_back(mLastMilliseconds);
+	}
+	else
+	{
+		mHistory[mHistoryNext] = mLastMilliseconds;
+		mHistoryNext = (mHistoryNext + 1) % HistorySize;
+	}
+}
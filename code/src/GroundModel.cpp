@@ -1,6 +1,7 @@
 #include "GroundModel.h"
 
 #include "PerlinNoise.h"
+#include "CpuProfiler.h"
 
 #include <iostream>
 #include <list>
@@ -8,6 +9,7 @@
 #include <algorithm>
 #include <map>
 #include <cmath>
+#include <cfloat>
 
 using namespace std;
 using namespace glm;
@@ -70,17 +72,27 @@ using namespace glm;
 //	return vertexArrayObject;
 //}
 
-GroundModel::GroundModel() { } 
+GroundModel::GroundModel() : mVAO(0), mVBO(0), mShadowVAO(0), mShadowVBO(0), mEBO(0) { } 
 
-GroundModel::GroundModel(unsigned int sizeX, unsigned int sizeZ, float uvTiling) : Model()
+GroundModel::GroundModel(unsigned int sizeX, unsigned int sizeZ, float uvTiling, bool createBuffers, unsigned int seed) : Model(), mVAO(0), mVBO(0), mShadowVAO(0), mShadowVBO(0), mEBO(0)
 {
 	this->sizeX = sizeX;
 	this->sizeZ = sizeZ;
 
+	// Center the ground on the origin. Draw does this again, but code drawing from GetVAO needs the final world matrix.
+	SetPosition(vec3(0 - (float)sizeX / 2, 0.0f, 0 - (float)sizeZ / 2));
+
 	// Generate vertices.
-	createGroundVertexMap(sizeX, sizeZ, uvTiling);
+	createGroundVertexMap(sizeX, sizeZ, uvTiling, seed);
 	createGroundVertexVector(terrainVertexMap, sizeX, sizeZ);
 
+	if (createBuffers)
+		CreateBuffers();
+}
+
+void GroundModel::CreateBuffers()
+{
+	PROFILE_ZONE("terrain buffers");
 	glGenVertexArrays(1, &mVAO);
 	glBindVertexArray(mVAO);
 
@@ -125,13 +137,30 @@ GroundModel::GroundModel(unsigned int sizeX, unsigned int sizeZ, float uvTiling)
 		(void*)(2 * sizeof(vec3) + sizeof(vec2))    // normals are offsetted by two vec3 and a vec2.
 	);
 	glEnableVertexAttribArray(3);
+
+	glGenBuffers(1, &mEBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexVector.size() * sizeof(unsigned int), indexVector.data(), GL_STATIC_DRAW);
+
+	// The index buffer binding belongs to the vertex array, the shadow one needs it too.
+	mShadowVAO = PositionOnlyVAO(vertexVector.data(), (int)vertexVector.size(), &mShadowVBO);
+	glBindVertexArray(mShadowVAO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEBO);
+	glBindVertexArray(mVAO);
 }
 
 GroundModel::~GroundModel()
 {
+	// Nothing was uploaded when the buffers were never created, and there may be no GL context.
+	if (mVAO == 0)
+		return;
+
 	// Free the GPU from the Vertex Buffer
 	glDeleteBuffers(1, &mVBO);
 	glDeleteVertexArrays(1, &mVAO);
+	glDeleteBuffers(1, &mShadowVBO);
+	glDeleteVertexArrays(1, &mShadowVAO);
+	glDeleteBuffers(1, &mEBO);
 }
 
 void GroundModel::Update(float dt)
@@ -153,7 +182,7 @@ void GroundModel::Draw(int shaderProgram, GLenum renderingModel)
 	GLuint worldMatrixLocation = glGetUniformLocation(shaderProgram, "worldMatrix");
 	glUniformMatrix4fv(worldMatrixLocation, 1, GL_FALSE, &GetWorldMatrix()[0][0]);
 
-	glDrawArrays(renderingModel, 0, 6 * sizeX * sizeZ);
+	glDrawElements(renderingModel, (GLsizei)indexVector.size(), GL_UNSIGNED_INT, 0);
 }
 
 //void GroundModel::Draw(int shaderProgram, int sizeX, int sizeZ, GLenum renderingModel) 
@@ -171,12 +200,13 @@ void GroundModel::Draw(int shaderProgram, GLenum renderingModel)
 //}
 
 // uvTiling = how many quads does the texture stretch across before being repeated?
-void GroundModel::createGroundVertexMap(unsigned int sizeX, unsigned int sizeZ, float uvTiling)
+void GroundModel::createGroundVertexMap(unsigned int sizeX, unsigned int sizeZ, float uvTiling, unsigned int seed)
 {
+	PROFILE_ZONE("terrain heights and normals");
 	//std::map<vec2, Model::TexturedColoredNormalVertex, CompareVec2> terrainVertexMap;
 
 	// Default/test noise seed: 42069u.
-	srand((unsigned int)time(0));
+	srand(seed);
 	uint perlinSeed = rand() % 10000 + 1;
 	cout << "The terrain's perlin noise seed is " << perlinSeed << ".\n";
 
@@ -206,6 +236,11 @@ void GroundModel::createGroundVertexMap(unsigned int sizeX, unsigned int sizeZ,
 		}
 	}
 
+	generateVertexNormals(sizeX, sizeZ);
+}
+
+void GroundModel::generateVertexNormals(unsigned int sizeX, unsigned int sizeZ)
+{
 	// Generate normals that account for the variable terrain height. Exclude the vertices at the very edges of the grid.
 	for (int z = 1; z < sizeZ - 1; z++) // Columns.
 	{
@@ -265,19 +300,94 @@ vec3 GroundModel::generateFaceNormals(vec3 pointAPos, vec3 pointBPos, vec3 point
 
 void  GroundModel::createGroundVertexVector(map<vec2, TexturedColoredNormalVertex, CompareVec2> terrainVertexMap, unsigned int sizeX, unsigned int sizeZ)
 {
-	for (int z = 0; z < sizeZ; z++) // Columns.
+	PROFILE_ZONE("terrain vertex vector");
+
+	// Each grid point once, row by row: the vertex of (x, z) is at z * (sizeX + 1) + x.
+	vertexVector.clear();
+	for (unsigned int z = 0; z <= sizeZ; z++)
 	{
-		for (int x = 0; x < sizeX; x++) // Rows.
+		for (unsigned int x = 0; x <= sizeX; x++)
+			vertexVector.push_back(terrainVertexMap[vec2(x, z)]);
+	}
+
+	unsigned int rowSize = sizeX + 1;
+	indexVector.clear();
+	indexVector.reserve(6 * sizeX * sizeZ);
+	for (unsigned int z = 0; z < sizeZ; z++) // Columns.
+	{
+		for (unsigned int x = 0; x < sizeX; x++) // Rows.
 		{
+			unsigned int corner = z * rowSize + x;
+
 			// Bottom triangle.
-			vertexVector.push_back(terrainVertexMap[vec2(x, z)]); // (0, 0).
-			vertexVector.push_back(terrainVertexMap[vec2(x, z + 1)]); // (0, 1).
-			vertexVector.push_back(terrainVertexMap[vec2(x + 1, z)]); // (1, 0).
+			indexVector.push_back(corner); // (0, 0).
+			indexVector.push_back(corner + rowSize); // (0, 1).
+			indexVector.push_back(corner + 1); // (1, 0).
 
 			// Top triangle.
-			vertexVector.push_back(terrainVertexMap[vec2(x + 1, z)]); // (1, 0).
-			vertexVector.push_back(terrainVertexMap[vec2(x, z + 1)]); // (0, 1).
-			vertexVector.push_back(terrainVertexMap[vec2(x + 1, z + 1)]); // (1, 1). 
+			indexVector.push_back(corner + 1); // (1, 0).
+			indexVector.push_back(corner + rowSize); // (0, 1).
+			indexVector.push_back(corner + rowSize + 1); // (1, 1).
+		}
+	}
+
+	// Row order misses the cache on most of the previous row, reorder once here rather than pay it every frame.
+	PROFILE_ZONE("terrain vertex cache optimization");
+	generatedCache = MeshOptimizer::AnalyzeVertexCache(indexVector, (int)vertexVector.size());
+	MeshOptimizer::Optimize(vertexVector, indexVector);
+	optimizedCache = MeshOptimizer::AnalyzeVertexCache(indexVector, (int)vertexVector.size());
+}
+
+void GroundModel::BuildOccluderMesh(unsigned int step, vector<vec3>& positions, vector<unsigned int>& indices) const
+{
+	int gridSizeX = (int)sizeX;
+	int gridSizeZ = (int)sizeZ;
+	int coarseStep = std::max(1, (int)step);
+
+	// Coarse columns and rows, the last one always lands on the edge of the ground.
+	vector<int> xCoords;
+	vector<int> zCoords;
+	for (int x = 0; x < gridSizeX; x += coarseStep)
+		xCoords.push_back(x);
+	xCoords.push_back(gridSizeX);
+	for (int z = 0; z < gridSizeZ; z += coarseStep)
+		zCoords.push_back(z);
+	zCoords.push_back(gridSizeZ);
+
+	positions.clear();
+	indices.clear();
+
+	// Every coarse cell touching a vertex lies within one step of it, so the vertex is below every fine vertex of those cells.
+	for (int z : zCoords)
+	{
+		for (int x : xCoords)
+		{
+			float lowest = FLT_MAX;
+			for (int fineZ = std::max(0, z - coarseStep); fineZ <= std::min(gridSizeZ, z + coarseStep); fineZ++)
+			{
+				for (int fineX = std::max(0, x - coarseStep); fineX <= std::min(gridSizeX, x + coarseStep); fineX++)
+					lowest = std::min(lowest, terrainVertexMap.find(vec2(fineX, fineZ))->second.position.y);
+			}
+
+			positions.push_back(vec3((float)x, lowest, (float)z));
+		}
+	}
+
+	// Same triangle split as the full resolution ground.
+	unsigned int columns = (unsigned int)xCoords.size();
+	for (unsigned int z = 0; z + 1 < zCoords.size(); z++)
+	{
+		for (unsigned int x = 0; x + 1 < columns; x++)
+		{
+			unsigned int corner = z * columns + x;
+
+			indices.push_back(corner);
+			indices.push_back(corner + columns);
+			indices.push_back(corner + 1);
+
+			indices.push_back(corner + 1);
+			indices.push_back(corner + columns);
+			indices.push_back(corner + columns + 1);
 		}
 	}
 }
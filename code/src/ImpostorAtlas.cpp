@@ -0,0 +1,179 @@
+#include "ImpostorAtlas.h"
+#include "StreamingBuffer.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+using namespace glm;
+
+ImpostorAtlas::ImpostorAtlas(int variantCount, int cellWidth, int cellHeight)
+	: mVariantCount(variantCount), mCellWidth(cellWidth), mCellHeight(cellHeight), mFramebuffer(0), mColourTexture(0), mNormalTexture(0), mDepthBuffer(0), mComplete(false), mVertexArray(0), mCornerBuffer(0),
+	mProgram(0), mViewProjectionLocation(-1), mEyePositionLocation(-1)
+{
+	int width = ViewCount * cellWidth;
+	int height = variantCount * cellHeight;
+
+	// Distant quads cover a few pixels, they read the atlas through its mipmaps.
+	GLuint* textures[] = { &mColourTexture, &mNormalTexture };
+	for (GLuint* texture : textures)
+	{
+		glGenTextures(1, texture);
+		glBindTexture(GL_TEXTURE_2D, *texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenRenderbuffers(1, &mDepthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, mDepthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &mFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mColourTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, mNormalTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mDepthBuffer);
+	GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, drawBuffers);
+
+	mComplete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	if (!mComplete)
+		cout << "Impostor atlas framebuffer incomplete.\n";
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	// A quad standing on its bottom edge, [-0.5, 0.5] x [0, 1], as a triangle strip.
+	const vec2 corners[] = { vec2(-0.5f, 0.0f), vec2(0.5f, 0.0f), vec2(-0.5f, 1.0f), vec2(0.5f, 1.0f) };
+
+	glGenVertexArrays(1, &mVertexArray);
+	glBindVertexArray(mVertexArray);
+
+	glGenBuffers(1, &mCornerBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, mCornerBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(vec2), (void*)0);
+	glEnableVertexAttribArray(0);
+
+	// The instance attributes are pointed at the streaming buffer by every draw.
+	glEnableVertexAttribArray(1);
+	glVertexAttribDivisor(1, 1);
+	glEnableVertexAttribArray(2);
+	glVertexAttribDivisor(2, 1);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+ImpostorAtlas::~ImpostorAtlas()
+{
+	GLuint textures[] = { mColourTexture, mNormalTexture };
+	glDeleteTextures(2, textures);
+	glDeleteRenderbuffers(1, &mDepthBuffer);
+	glDeleteFramebuffers(1, &mFramebuffer);
+	glDeleteBuffers(1, &mCornerBuffer);
+	glDeleteVertexArrays(1, &mVertexArray);
+}
+
+void ImpostorAtlas::BeginBake()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glViewport(0, 0, ViewCount * mCellWidth, mVariantCount * mCellHeight);
+
+	// Cleared through the buffers rather than glClearColor, which belongs to the scene.
+	const GLfloat transparent[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	const GLfloat farthest = 1.0f;
+	glClearBufferfv(GL_COLOR, 0, transparent);
+	glClearBufferfv(GL_COLOR, 1, transparent);
+	glClearBufferfv(GL_DEPTH, 0, &farthest);
+}
+
+void ImpostorAtlas::BindCell(int view, int variant)
+{
+	glViewport(view * mCellWidth, variant * mCellHeight, mCellWidth, mCellHeight);
+}
+
+void ImpostorAtlas::EndBake()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	GLuint textures[] = { mColourTexture, mNormalTexture };
+	for (GLuint texture : textures)
+	{
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void ImpostorAtlas::GetViewMatrices(int view, float radius, float bottom, float top, mat4& viewMatrix, mat4& projectionMatrix)
+{
+	const float PI = acos(-1.0f);
+	float angle = 2.0f * PI * view / ViewCount;
+	vec3 direction(cos(angle), 0.0f, sin(angle));
+
+	// Far enough out that the whole object is in front of the near plane.
+	float middle = (bottom + top) * 0.5f;
+	float cameraDistance = radius + 1.0f;
+	vec3 eye = direction * cameraDistance + vec3(0.0f, middle, 0.0f);
+	viewMatrix = lookAt(eye, vec3(0.0f, middle, 0.0f), vec3(0.0f, 1.0f, 0.0f));
+
+	float halfHeight = (top - bottom) * 0.5f;
+	projectionMatrix = ortho(-radius, radius, -halfHeight, halfHeight, cameraDistance - radius - 0.5f, cameraDistance + radius + 0.5f);
+}
+
+void ImpostorAtlas::Draw(GLuint shaderProgram, const mat4& viewProjectionMatrix, vec3 eyePosition, const vector<Instance>& instances, StreamingBuffer& buffer)
+{
+	if (instances.empty() || !mComplete)
+		return;
+
+	GLsizeiptr size = instances.size() * sizeof(Instance);
+	GLintptr offset = 0;
+	void* data = buffer.Map(size, offset);
+	if (!data)
+		return;
+	memcpy(data, instances.data(), size);
+	buffer.Unmap();
+
+	glUseProgram(shaderProgram);
+	if (shaderProgram != mProgram)
+	{
+		// The atlas layout and the texture units never change, they are set once per program.
+		mProgram = shaderProgram;
+		mViewProjectionLocation = glGetUniformLocation(shaderProgram, "viewProjectionMatrix");
+		mEyePositionLocation = glGetUniformLocation(shaderProgram, "eyePosition");
+		glUniform2f(glGetUniformLocation(shaderProgram, "atlasCells"), (float)ViewCount, (float)mVariantCount);
+		glUniform1i(glGetUniformLocation(shaderProgram, "colourSampler"), 0);
+		glUniform1i(glGetUniformLocation(shaderProgram, "normalSampler"), 1);
+	}
+	glUniformMatrix4fv(mViewProjectionLocation, 1, GL_FALSE, &viewProjectionMatrix[0][0]);
+	glUniform3fv(mEyePositionLocation, 1, &eyePosition[0]);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, mColourTexture);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, mNormalTexture);
+
+	glBindVertexArray(mVertexArray);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer.GetBuffer());
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(offset + offsetof(Instance, position)));
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(offset + offsetof(Instance, size)));
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// The quads face the eye whichever way their strip winds: they are drawn with culling off.
+	GLboolean culling = glIsEnabled(GL_CULL_FACE);
+	glDisable(GL_CULL_FACE);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)instances.size());
+	if (culling)
+		glEnable(GL_CULL_FACE);
+
+	glBindVertexArray(0);
+}
@@ -0,0 +1,357 @@
+#include "JobSystem.h"
+#include "CpuProfiler.h"
+
+#include <algorithm>
+
+using namespace std;
+
+struct JobSystem::Job
+{
+	JobFunction function;
+
+	// Unfinished dependencies, plus one held while the job is being scheduled.
+	atomic<int> pendingDependencies;
+	atomic<bool> finished;
+
+	// Jobs waiting on this one. Guarded so a dependency cannot finish while a continuation is being registered.
+	mutex continuationMutex;
+	vector<Job*> continuations;
+
+	// Keeps the job alive from the moment it is scheduled until it has run, whether or not the caller kept its handle.
+	JobHandle self;
+
+	Job(JobFunction _function) : function(std::move(_function)), pendingDependencies(1), finished(false) {}
+};
+
+// The system and index of the calling thread, so jobs scheduled from a worker land in its own deque.
+thread_local JobSystem* tCurrentSystem = nullptr;
+thread_local int tCurrentThreadIndex = -1;
+thread_local uint32_t tRandomState = 0x9E3779B9u;
+
+// Xorshift, used to pick steal victims.
+static uint32_t nextRandom()
+{
+	tRandomState ^= tRandomState << 13;
+	tRandomState ^= tRandomState >> 17;
+	tRandomState ^= tRandomState << 5;
+	return tRandomState;
+}
+
+
+// Work stealing queue.
+
+JobSystem::WorkStealingQueue::WorkStealingQueue() : mTop(0), mBottom(0)
+{
+	for (int64_t i = 0; i < Capacity; i++)
+		mJobs[i].store(nullptr, memory_order_relaxed);
+}
+
+bool JobSystem::WorkStealingQueue::Push(Job* job)
+{
+	int64_t bottom = mBottom.load(memory_order_relaxed);
+	int64_t top = mTop.load(memory_order_acquire);
+	if (bottom - top >= Capacity)
+		return false;
+
+	// The release store publishes the job to thieves reading mBottom with acquire.
+	mJobs[bottom & (Capacity - 1)].store(job, memory_order_relaxed);
+	mBottom.store(bottom + 1, memory_order_release);
+	return true;
+}
+
+JobSystem::Job* JobSystem::WorkStealingQueue::Pop()
+{
+	int64_t bottom = mBottom.load(memory_order_relaxed) - 1;
+	mBottom.store(bottom, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	int64_t top = mTop.load(memory_order_relaxed);
+
+	if (top > bottom)
+	{
+		// Empty.
+		mBottom.store(bottom + 1, memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job* job = mJobs[bottom & (Capacity - 1)].load(memory_order_relaxed);
+	if (top == bottom)
+	{
+		// Last job, race the thieves for it.
+		if (!mTop.compare_exchange_strong(top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+			job = nullptr;
+		mBottom.store(bottom + 1, memory_order_relaxed);
+	}
+	return job;
+}
+
+JobSystem::Job* JobSystem::WorkStealingQueue::Steal()
+{
+	int64_t top = mTop.load(memory_order_acquire);
+	atomic_thread_fence(memory_order_seq_cst);
+	int64_t bottom = mBottom.load(memory_order_acquire);
+
+	if (top >= bottom)
+		return nullptr;
+
+	Job* job = mJobs[top & (Capacity - 1)].load(memory_order_relaxed);
+	if (!mTop.compare_exchange_strong(top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+		return nullptr;
+	return job;
+}
+
+
+// Job system.
+
+JobSystem::JobSystem(unsigned int workerCount) : mQueuedJobs(0), mSleepingWorkers(0), mStopping(false)
+{
+	if (workerCount == 0)
+	{
+		unsigned int hardwareThreads = thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+
+	// Queue 0 belongs to the creating thread.
+	for (unsigned int i = 0; i <= workerCount; i++)
+		mQueues.push_back(make_unique<WorkStealingQueue>());
+
+	tCurrentSystem = this;
+	tCurrentThreadIndex = 0;
+
+	for (unsigned int i = 1; i <= workerCount; i++)
+		mWorkers.emplace_back(&JobSystem::WorkerLoop, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		lock_guard<mutex> lock(mSleepMutex);
+		mStopping.store(true);
+	}
+	mSleepCondition.notify_all();
+
+	for (thread& worker : mWorkers)
+		worker.join();
+
+	if (tCurrentSystem == this)
+	{
+		tCurrentSystem = nullptr;
+		tCurrentThreadIndex = -1;
+	}
+}
+
+int JobSystem::GetCurrentThreadIndex() const
+{
+	return tCurrentSystem == this ? tCurrentThreadIndex : -1;
+}
+
+JobSystem::JobHandle JobSystem::Schedule(JobFunction function)
+{
+	return Schedule(std::move(function), vector<JobHandle>());
+}
+
+JobSystem::JobHandle JobSystem::Schedule(JobFunction function, initializer_list<JobHandle> dependencies)
+{
+	return Schedule(std::move(function), vector<JobHandle>(dependencies));
+}
+
+JobSystem::JobHandle JobSystem::Schedule(JobFunction function, const vector<JobHandle>& dependencies)
+{
+	JobHandle job = make_shared<Job>(std::move(function));
+	job->self = job;
+
+	for (const JobHandle& dependency : dependencies)
+	{
+		if (!dependency)
+			continue;
+
+		lock_guard<mutex> lock(dependency->continuationMutex);
+		if (!dependency->finished.load(memory_order_acquire))
+		{
+			job->pendingDependencies.fetch_add(1, memory_order_relaxed);
+			dependency->continuations.push_back(job.get());
+		}
+	}
+
+	// Drop the scheduling guard. Whoever brings the count to zero queues the job.
+	if (job->pendingDependencies.fetch_sub(1, memory_order_acq_rel) == 1)
+		Enqueue(job.get());
+
+	return job;
+}
+
+void JobSystem::Enqueue(Job* job)
+{
+	mQueuedJobs.fetch_add(1, memory_order_release);
+
+	int threadIndex = GetCurrentThreadIndex();
+	if (threadIndex < 0 || !mQueues[threadIndex]->Push(job))
+	{
+		// Foreign thread or full deque.
+		lock_guard<mutex> lock(mInjectionMutex);
+		mInjectionQueue.push_back(job);
+	}
+
+	if (mSleepingWorkers.load(memory_order_acquire) > 0)
+	{
+		// Taking the lock ensures a worker about to sleep sees the new job or gets the notification.
+		lock_guard<mutex> lock(mSleepMutex);
+		mSleepCondition.notify_one();
+	}
+}
+
+JobSystem::Job* JobSystem::FindJob()
+{
+	int threadIndex = GetCurrentThreadIndex();
+
+	// Own deque first, most recent job first for cache locality.
+	if (threadIndex >= 0)
+	{
+		Job* job = mQueues[threadIndex]->Pop();
+		if (job)
+			return job;
+	}
+
+	{
+		lock_guard<mutex> lock(mInjectionMutex);
+		if (!mInjectionQueue.empty())
+		{
+			Job* job = mInjectionQueue.front();
+			mInjectionQueue.pop_front();
+			return job;
+		}
+	}
+
+	// Steal the oldest job of another thread, starting from a random victim.
+	unsigned int queueCount = (unsigned int)mQueues.size();
+	unsigned int start = nextRandom() % queueCount;
+	for (unsigned int i = 0; i < queueCount; i++)
+	{
+		unsigned int victim = (start + i) % queueCount;
+		if ((int)victim == threadIndex)
+			continue;
+
+		Job* job = mQueues[victim]->Steal();
+		if (job)
+			return job;
+	}
+
+	return nullptr;
+}
+
+void JobSystem::Execute(Job* job)
+{
+	mQueuedJobs.fetch_sub(1, memory_order_relaxed);
+
+	// Take over the job's self reference so it survives until its continuations are released.
+	JobHandle keepAlive = std::move(job->self);
+
+	if (job->function)
+		job->function();
+
+	vector<Job*> continuations;
+	{
+		lock_guard<mutex> lock(job->continuationMutex);
+		job->finished.store(true, memory_order_release);
+		continuations.swap(job->continuations);
+	}
+
+	for (Job* continuation : continuations)
+	{
+		if (continuation->pendingDependencies.fetch_sub(1, memory_order_acq_rel) == 1)
+			Enqueue(continuation);
+	}
+}
+
+bool JobSystem::RunOneJob()
+{
+	Job* job = FindJob();
+	if (!job)
+		return false;
+
+	Execute(job);
+	return true;
+}
+
+void JobSystem::WorkerLoop(unsigned int threadIndex)
+{
+	tCurrentSystem = this;
+	tCurrentThreadIndex = (int)threadIndex;
+	tRandomState ^= (threadIndex + 1) * 0x85EBCA6Bu;
+	PROFILE_THREAD_NAME("worker " + to_string(threadIndex));
+
+	const int spinsBeforeSleeping = 64;
+	int idleSpins = 0;
+
+	while (!mStopping.load(memory_order_acquire))
+	{
+		if (RunOneJob())
+		{
+			idleSpins = 0;
+			continue;
+		}
+
+		if (++idleSpins < spinsBeforeSleeping)
+		{
+			this_thread::yield();
+			continue;
+		}
+
+		// Nothing to do for a while, sleep until a job is queued. The timeout is a safety net only.
+		unique_lock<mutex> lock(mSleepMutex);
+		mSleepingWorkers.fetch_add(1, memory_order_acq_rel);
+		mSleepCondition.wait_for(lock, chrono::milliseconds(10), [this]()
+			{
+				return mStopping.load(memory_order_acquire) || mQueuedJobs.load(memory_order_acquire) > 0;
+			});
+		mSleepingWorkers.fetch_sub(1, memory_order_acq_rel);
+		idleSpins = 0;
+	}
+}
+
+bool JobSystem::IsFinished(const JobHandle& job) const
+{
+	return !job || job->finished.load(memory_order_acquire);
+}
+
+void JobSystem::Wait(const JobHandle& job)
+{
+	while (!IsFinished(job))
+	{
+		if (!RunOneJob())
+			this_thread::yield();
+	}
+}
+
+void JobSystem::Wait(const vector<JobHandle>& jobs)
+{
+	for (const JobHandle& job : jobs)
+		Wait(job);
+}
+
+void JobSystem::ParallelFor(unsigned int count, unsigned int grainSize, RangeFunction function)
+{
+	if (count == 0)
+		return;
+
+	grainSize = std::max(grainSize, 1u);
+
+	// Small ranges are not worth the scheduling.
+	if (count <= grainSize)
+	{
+		function(0, count);
+		return;
+	}
+
+	// Queue every range but the first, which the calling thread runs itself before helping with the rest.
+	vector<JobHandle> jobs;
+	jobs.reserve(count / grainSize + 1);
+	for (unsigned int begin = grainSize; begin < count; begin += grainSize)
+	{
+		unsigned int end = std::min(begin + grainSize, count);
+		jobs.push_back(Schedule([&function, begin, end]() { function(begin, end); }));
+	}
+
+	function(0, grainSize);
+
+	Wait(jobs);
+}
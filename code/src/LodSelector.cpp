@@ -0,0 +1,36 @@
+#include "LodSelector.h"
+
+#include <algorithm>
+
+using namespace std;
+
+LodSelector::LodSelector(const vector<float>& thresholds, float hysteresis) : mThresholds(thresholds), mHysteresis(hysteresis)
+{
+}
+
+void LodSelector::Resize(size_t instanceCount)
+{
+	mLevels.resize(instanceCount, (unsigned char)mThresholds.size());
+}
+
+int LodSelector::Select(size_t instance, float pixelRadius)
+{
+	int levelCount = (int)mThresholds.size();
+	int level = mLevels[instance];
+
+	// Finer while clearly above the threshold of the next finer level, coarser while clearly below the current one.
+	while (level > 0 && pixelRadius >= mThresholds[level - 1] * (1.0f + mHysteresis))
+		level--;
+	while (level < levelCount && pixelRadius < mThresholds[level] * (1.0f - mHysteresis))
+		level++;
+
+	mLevels[instance] = (unsigned char)level;
+	return level;
+}
+
+float LodSelector::ProjectedRadius(float radius, float distance, const mat4& projection, int viewportHeight)
+{
+	// projection[1][1] is the cotangent of half the vertical field of view.
+	float pixelsAtUnitDistance = projection[1][1] * viewportHeight * 0.5f;
+	return radius * pixelsAtUnitDistance / std::max(distance, radius);
+}
@@ -0,0 +1,357 @@
+#include "MeshCache.h"
+#include "CubeModel.h"
+#include "MeshContainer.h"
+#include "QuadModel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+using namespace std;
+using namespace glm;
+
+typedef Model::TexturedColoredNormalVertex Vertex;
+
+MeshCache::~MeshCache()
+{
+	for (const pair<const Key, Mesh>& entry : mMeshes)
+	{
+		const Mesh& mesh = entry.second;
+		GLuint buffers[] = { mesh.vertexBuffer, mesh.positionBuffer, mesh.indexBuffer };
+		GLuint vertexArrays[] = { mesh.vertexArray, mesh.positionVertexArray };
+		glDeleteBuffers(3, buffers);
+		glDeleteVertexArrays(2, vertexArrays);
+	}
+}
+
+const MeshCache::Mesh& MeshCache::GetCube()
+{
+	return Get(Key(Cube, 0.0f, 0.0f, 0, 0));
+}
+
+const MeshCache::Mesh& MeshCache::GetQuad()
+{
+	return Get(Key(Quad, 0.0f, 0.0f, 0, 0));
+}
+
+const MeshCache::Mesh& MeshCache::GetSphere(float radius, float heightOffset, int radialSubdivisions, int verticalSubdivisions)
+{
+	return Get(Key(Sphere, radius, heightOffset, radialSubdivisions, verticalSubdivisions));
+}
+
+const MeshCache::Mesh& MeshCache::Get(const Key& key)
+{
+	map<Key, Mesh>::const_iterator found = mMeshes.find(key);
+	if (found != mMeshes.end())
+		return found->second;
+
+	if (!mBakedDirectory.empty() && UploadBaked(key, mBakedDirectory + BakedName(key)))
+		return mMeshes.find(key)->second;
+
+	vector<Vertex> vertices;
+	vector<unsigned int> indices;
+	Build(key, vertices, indices);
+	return Upload(key, vertices, indices);
+}
+
+void MeshCache::Build(const Key& key, vector<Vertex>& vertices, vector<unsigned int>& indices)
+{
+	switch (get<0>(key))
+	{
+	case Cube:
+		Weld(CubeModel::CubeVertices(), vertices, indices);
+		break;
+	case Quad:
+		Weld(QuadModel::QuadVertices(), vertices, indices);
+		break;
+	default:
+		BuildSphere(get<1>(key), get<2>(key), get<3>(key), get<4>(key), vertices, indices);
+		break;
+	}
+}
+
+const MeshCache::Mesh& MeshCache::GetSphereLod(float radius, float heightOffset, int radialSubdivisions, int verticalSubdivisions, int lod)
+{
+	return GetSphere(radius, heightOffset, LodSubdivisions(radialSubdivisions, lod), LodSubdivisions(verticalSubdivisions, lod));
+}
+
+int MeshCache::LodSubdivisions(int subdivisions, int lod)
+{
+	// Evenly spaced steps down: 24 subdivisions give 24, 18, 12 and 6.
+	lod = glm::clamp(lod, 0, SphereLodCount - 1);
+	return std::max(MinimumSubdivisions, subdivisions * (SphereLodCount - lod) / SphereLodCount);
+}
+
+void MeshCache::BuildSphere(float radius, float heightOffset, int radialSubdivisions, int verticalSubdivisions, vector<Vertex>& vertices, vector<unsigned int>& indices)
+{
+	const float PI = acos(-1.0f);
+	float radialStep = 2 * PI / radialSubdivisions;
+	float verticalStep = PI / verticalSubdivisions;
+	float lengthInv = 1.0f / radius;
+
+	// Each ring shares its sines and cosines, so they are computed once per ring and once per column rather than per vertex.
+	vector<float> radialCos(radialSubdivisions + 1);
+	vector<float> radialSin(radialSubdivisions + 1);
+	for (int j = 0; j <= radialSubdivisions; j++)
+	{
+		radialCos[j] = cos(j * radialStep);
+		radialSin[j] = sin(j * radialStep);
+	}
+
+	vertices.clear();
+	indices.clear();
+	vertices.reserve(2 * radialSubdivisions + (verticalSubdivisions - 1) * (radialSubdivisions + 1));
+	indices.reserve(6 * radialSubdivisions * (verticalSubdivisions - 1));
+
+	// As in SphereModel, the normal is the position over the radius, height offset included, and doubles as the colour.
+	auto addVertex = [&](vec3 position, vec2 uv)
+	{
+		vec3 normal = position * lengthInv;
+		vertices.push_back(Vertex(position, normal, uv, normal));
+	};
+
+	// Each cap triangle has its own summit, centered on its column in texture space.
+	unsigned int topSummits = (unsigned int)vertices.size();
+	for (int j = 0; j < radialSubdivisions; j++)
+		addVertex(vec3(0.0f, radius + heightOffset, 0.0f), vec2(((float)j + 0.5f) / radialSubdivisions, 0.0f));
+
+	// Rings from the top, the first column is repeated at the end for the texture seam.
+	unsigned int rings = (unsigned int)vertices.size();
+	for (int i = 1; i < verticalSubdivisions; i++)
+	{
+		float verticalCos = cos(i * verticalStep);
+		float verticalSin = sin(i * verticalStep);
+		for (int j = 0; j <= radialSubdivisions; j++)
+		{
+			vec3 position(radius * radialCos[j] * verticalSin, radius * verticalCos + heightOffset, radius * radialSin[j] * verticalSin);
+			addVertex(position, vec2((float)j / radialSubdivisions, (float)i / verticalSubdivisions));
+		}
+	}
+
+	unsigned int bottomSummits = (unsigned int)vertices.size();
+	for (int j = 0; j < radialSubdivisions; j++)
+		addVertex(vec3(0.0f, -radius + heightOffset, 0.0f), vec2(((float)j + 0.5f) / radialSubdivisions, 1.0f));
+
+	unsigned int ringSize = radialSubdivisions + 1;
+	auto ring = [&](int i, int j) { return rings + (i - 1) * ringSize + j; };
+
+	// Triangles in the order of SphereModel::SphereVertices: top cap, bottom cap, then the body from the top.
+	for (int j = 0; j < radialSubdivisions; j++)
+	{
+		indices.push_back(topSummits + j);
+		indices.push_back(ring(1, j + 1));
+		indices.push_back(ring(1, j));
+	}
+
+	for (int j = 0; j < radialSubdivisions; j++)
+	{
+		indices.push_back(bottomSummits + j);
+		indices.push_back(ring(verticalSubdivisions - 1, j));
+		indices.push_back(ring(verticalSubdivisions - 1, j + 1));
+	}
+
+	for (int i = 1; i < verticalSubdivisions - 1; i++)
+	{
+		for (int j = 0; j < radialSubdivisions; j++)
+		{
+			indices.push_back(ring(i, j));
+			indices.push_back(ring(i + 1, j + 1));
+			indices.push_back(ring(i + 1, j));
+
+			indices.push_back(ring(i, j));
+			indices.push_back(ring(i, j + 1));
+			indices.push_back(ring(i + 1, j + 1));
+		}
+	}
+}
+
+void MeshCache::Weld(const vector<Vertex>& triangles, vector<Vertex>& vertices, vector<unsigned int>& indices)
+{
+	auto compare = [](const Vertex& left, const Vertex& right) { return memcmp(&left, &right, sizeof(Vertex)) < 0; };
+	map<Vertex, unsigned int, decltype(compare)> vertexIndices(compare);
+
+	vertices.clear();
+	indices.clear();
+	indices.reserve(triangles.size());
+	for (const Vertex& vertex : triangles)
+	{
+		pair<map<Vertex, unsigned int, decltype(compare)>::iterator, bool> inserted = vertexIndices.insert(make_pair(vertex, (unsigned int)vertices.size()));
+		if (inserted.second)
+			vertices.push_back(vertex);
+		indices.push_back(inserted.first->second);
+	}
+}
+
+bool MeshCache::BakeCube(const string& directory)
+{
+	return Bake(directory, Key(Cube, 0.0f, 0.0f, 0, 0));
+}
+
+bool MeshCache::BakeQuad(const string& directory)
+{
+	return Bake(directory, Key(Quad, 0.0f, 0.0f, 0, 0));
+}
+
+bool MeshCache::BakeSphere(const string& directory, float radius, float heightOffset, int radialSubdivisions, int verticalSubdivisions)
+{
+	return Bake(directory, Key(Sphere, radius, heightOffset, radialSubdivisions, verticalSubdivisions));
+}
+
+bool MeshCache::Bake(const string& directory, const Key& key)
+{
+	vector<Vertex> vertices;
+	vector<unsigned int> indices;
+	Build(key, vertices, indices);
+	MeshOptimizer::Optimize(vertices, indices);
+	return WriteMesh(directory + BakedName(key), vertices, indices);
+}
+
+bool MeshCache::WriteMesh(const string& path, const vector<Vertex>& vertices, const vector<unsigned int>& indices)
+{
+	// Position, colour, uv and normals, as the vertex arrays of the models point them.
+	vector<MeshContainer::Attribute> attributes = {
+		{ 0, 3, MeshContainer::ComponentFloat, (uint32_t)offsetof(Vertex, position) },
+		{ 1, 3, MeshContainer::ComponentFloat, (uint32_t)offsetof(Vertex, color) },
+		{ 2, 2, MeshContainer::ComponentFloat, (uint32_t)offsetof(Vertex, uv) },
+		{ 3, 3, MeshContainer::ComponentFloat, (uint32_t)offsetof(Vertex, normals) }
+	};
+	return MeshContainer::Write(path, vertices.data(), (uint32_t)vertices.size(), sizeof(Vertex), attributes, indices);
+}
+
+string MeshCache::BakedName(const Key& key)
+{
+	ostringstream name;
+	if (get<0>(key) == Cube)
+		name << "cube";
+	else if (get<0>(key) == Quad)
+		name << "quad";
+	else
+		name << "sphere_r" << get<1>(key) << "_h" << get<2>(key) << "_" << get<3>(key) << "x" << get<4>(key);
+	name << MeshContainer::Extension;
+	return name.str();
+}
+
+const MeshCache::Mesh& MeshCache::Upload(const Key& key, vector<Vertex>& vertices, vector<unsigned int>& indices)
+{
+	Mesh mesh;
+	mesh.generatedCache = MeshOptimizer::AnalyzeVertexCache(indices, (int)vertices.size());
+	MeshOptimizer::Optimize(vertices, indices);
+	mesh.optimizedCache = MeshOptimizer::AnalyzeVertexCache(indices, (int)vertices.size());
+
+	mesh.vertexCount = (int)vertices.size();
+	mesh.indexCount = (int)indices.size();
+	mesh.indexType = GL_UNSIGNED_INT;
+	mesh.baked = false;
+
+	glGenVertexArrays(1, &mesh.vertexArray);
+	glBindVertexArray(mesh.vertexArray);
+
+	glGenBuffers(1, &mesh.vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+
+	// Same attributes as the vertex arrays of the models: position, colour, uv and normals.
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)sizeof(vec3));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(2 * sizeof(vec3)));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(2 * sizeof(vec3) + sizeof(vec2)));
+	glEnableVertexAttribArray(3);
+
+	glGenBuffers(1, &mesh.indexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+	// The index buffer binding belongs to the vertex array, so the position only one is given it too.
+	mesh.positionVertexArray = Model::PositionOnlyVAO(vertices.data(), mesh.vertexCount, &mesh.positionBuffer);
+	glBindVertexArray(mesh.positionVertexArray);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+	glBindVertexArray(0);
+
+	return mMeshes.insert(make_pair(key, mesh)).first->second;
+}
+
+bool MeshCache::UploadBaked(const Key& key, const string& path)
+{
+	MeshContainer container;
+	if (!container.Open(path))
+		return false;
+
+	const MeshContainer::Attribute* position = container.FindAttribute(0);
+	if (!position || position->componentCount != 3)
+	{
+		cout << "Ignoring baked mesh " << path << ": it has no positions.\n";
+		return false;
+	}
+
+	Mesh mesh;
+	mesh.vertexCount = (int)container.GetVertexCount();
+	mesh.indexCount = (int)container.GetIndexCount();
+	mesh.indexType = (GLenum)container.GetIndexType();
+	mesh.baked = true;
+
+	// The buffers are filled straight from the mapping, and the attributes pointed as the file lays them out.
+	glGenVertexArrays(1, &mesh.vertexArray);
+	glBindVertexArray(mesh.vertexArray);
+
+	glGenBuffers(1, &mesh.vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)container.GetVertexDataSize(), container.GetVertexData(), GL_STATIC_DRAW);
+
+	GLsizei stride = (GLsizei)container.GetVertexStride();
+	for (const MeshContainer::Attribute& attribute : container.GetAttributes())
+	{
+		glVertexAttribPointer(attribute.location, attribute.componentCount, attribute.componentType, GL_FALSE, stride, (void*)(size_t)attribute.offset);
+		glEnableVertexAttribArray(attribute.location);
+	}
+
+	glGenBuffers(1, &mesh.indexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)container.GetIndexDataSize(), container.GetIndexData(), GL_STATIC_DRAW);
+
+	// The positions are copied out tightly packed, as Model::PositionOnlyVAO does for built meshes, so position only passes
+	// fetch 12 bytes per vertex instead of striding through the full vertices.
+	vector<vec3> positions(mesh.vertexCount);
+	const unsigned char* vertexData = container.GetVertexData() + position->offset;
+	for (int i = 0; i < mesh.vertexCount; i++)
+		memcpy(&positions[i], vertexData + (size_t)i * stride, sizeof(vec3));
+
+	glGenVertexArrays(1, &mesh.positionVertexArray);
+	glBindVertexArray(mesh.positionVertexArray);
+	glGenBuffers(1, &mesh.positionBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.positionBuffer);
+	glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(vec3), positions.data(), GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (void*)0);
+	glEnableVertexAttribArray(0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	mMeshes.insert(make_pair(key, mesh));
+	return true;
+}
+
+void MeshCache::PrintStatistics() const
+{
+	cout << "Mesh cache: " << mMeshes.size() << " meshes, vertex cache misses per triangle (ACMR) and per vertex (ATVR) with a "
+		<< MeshOptimizer::SimulatedCacheSize << " entry cache, as generated -> as uploaded:\n";
+	for (const pair<const Key, Mesh>& entry : mMeshes)
+	{
+		const Key& key = entry.first;
+		const Mesh& mesh = entry.second;
+		string name = get<0>(key) == Cube ? "cube" : get<0>(key) == Quad ? "quad" : "sphere " + to_string(get<3>(key)) + "x" + to_string(get<4>(key));
+		if (mesh.baked)
+		{
+			cout << "  " << name << ": " << mesh.vertexCount << " vertices, " << mesh.indexCount / 3 << " triangles, baked\n";
+			continue;
+		}
+		MeshOptimizer::PrintStatistics(name, mesh.vertexCount, mesh.indexCount / 3, mesh.generatedCache, mesh.optimizedCache);
+	}
+}
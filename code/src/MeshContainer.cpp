@@ -0,0 +1,351 @@
+#include "MeshContainer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+const char* const MeshContainer::Extension = ".mesh";
+
+// The file is the header, the attribute table, the submesh table, then the vertices and the indices,
+// each starting on a 16 byte boundary.
+struct FileHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t vertexCount;
+	uint32_t vertexStride;
+	uint32_t indexCount;
+	uint32_t indexType;
+	uint32_t attributeCount;
+	uint32_t submeshCount;
+	float boundsMin[3];
+	float boundsMax[3];
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+};
+
+static const char FILE_MAGIC[4] = { 'M', 'E', 'S', 'H' };
+static const uint32_t FILE_VERSION = 1;
+static const uint64_t DATA_ALIGNMENT = 16;
+static const uint32_t MAX_VERTEX_STRIDE = 256;
+static const uint32_t MAX_SUBMESH_COUNT = 65536;
+
+static uint64_t alignOffset(uint64_t offset)
+{
+	return (offset + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+}
+
+static bool isValidAttribute(const MeshContainer::Attribute& attribute, uint32_t vertexStride)
+{
+	return attribute.location < MeshContainer::MaxAttributeLocations && attribute.componentCount >= 1 && attribute.componentCount <= 4
+		&& attribute.componentType == MeshContainer::ComponentFloat && attribute.offset <= vertexStride
+		&& attribute.componentCount * sizeof(float) <= vertexStride - attribute.offset;
+}
+
+// Indices are read through a copy, whatever their alignment in the mapping.
+template <class Index>
+static bool indicesInRange(const unsigned char* data, uint32_t indexCount, uint32_t vertexCount)
+{
+	for (uint32_t i = 0; i < indexCount; i++)
+	{
+		Index index;
+		memcpy(&index, data + (size_t)i * sizeof(Index), sizeof(Index));
+		if (index >= vertexCount)
+			return false;
+	}
+	return true;
+}
+
+MeshContainer::MeshContainer()
+	: mData(nullptr), mSize(0), mVertexCount(0), mVertexStride(0), mIndexCount(0), mIndexType(IndexUInt32), mVertexOffset(0), mIndexOffset(0),
+	mBoundsMin(), mBoundsMax(), mFileHandle(nullptr), mMappingHandle(nullptr) { }
+
+MeshContainer::~MeshContainer()
+{
+	Close();
+}
+
+bool MeshContainer::Open(const string& path)
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	HANDLE mapping = nullptr;
+	if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	mData = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!mData)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	mSize = (size_t)fileSize.QuadPart;
+	mFileHandle = file;
+	mMappingHandle = mapping;
+#else
+	int file = open(path.c_str(), O_RDONLY);
+	if (file < 0)
+		return false;
+
+	struct stat fileStatus;
+	if (fstat(file, &fileStatus) != 0 || fileStatus.st_size <= 0)
+	{
+		close(file);
+		return false;
+	}
+
+	void* mapping = mmap(nullptr, (size_t)fileStatus.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	// The mapping keeps the file alive on its own.
+	close(file);
+	if (mapping == MAP_FAILED)
+		return false;
+
+	mData = (const unsigned char*)mapping;
+	mSize = (size_t)fileStatus.st_size;
+#endif
+
+	// Check everything Get* hands out now, so a truncated or foreign file cannot be read past its end later.
+	bool valid = mSize >= sizeof(FileHeader);
+	FileHeader header;
+	uint64_t tablesEnd = 0;
+	if (valid)
+	{
+		memcpy(&header, mData, sizeof(header));
+		tablesEnd = sizeof(FileHeader) + (uint64_t)header.attributeCount * sizeof(Attribute) + (uint64_t)header.submeshCount * sizeof(Submesh);
+		valid = memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) == 0 && header.version == FILE_VERSION
+			&& header.vertexCount > 0 && header.vertexStride > 0 && header.vertexStride <= MAX_VERTEX_STRIDE && header.indexCount > 0
+			&& (header.indexType == IndexUInt16 || header.indexType == IndexUInt32)
+			&& header.attributeCount > 0 && header.attributeCount <= MaxAttributeLocations
+			&& header.submeshCount > 0 && header.submeshCount <= MAX_SUBMESH_COUNT && mSize >= tablesEnd;
+	}
+
+	if (valid)
+	{
+		mVertexCount = header.vertexCount;
+		mVertexStride = header.vertexStride;
+		mIndexCount = header.indexCount;
+		mIndexType = (EIndexType)header.indexType;
+		mVertexOffset = header.vertexOffset;
+		mIndexOffset = header.indexOffset;
+		memcpy(mBoundsMin, header.boundsMin, sizeof(mBoundsMin));
+		memcpy(mBoundsMax, header.boundsMax, sizeof(mBoundsMax));
+
+		mAttributes.resize(header.attributeCount);
+		memcpy(mAttributes.data(), mData + sizeof(FileHeader), header.attributeCount * sizeof(Attribute));
+		mSubmeshes.resize(header.submeshCount);
+		memcpy(mSubmeshes.data(), mData + sizeof(FileHeader) + header.attributeCount * sizeof(Attribute), header.submeshCount * sizeof(Submesh));
+
+		valid = mVertexOffset >= tablesEnd && mVertexOffset <= mSize && GetVertexDataSize() <= mSize - mVertexOffset
+			&& mIndexOffset >= tablesEnd && mIndexOffset <= mSize && GetIndexDataSize() <= mSize - mIndexOffset;
+
+		uint32_t usedLocations = 0;
+		for (const Attribute& attribute : mAttributes)
+		{
+			valid = valid && isValidAttribute(attribute, mVertexStride) && (usedLocations & (1u << attribute.location)) == 0;
+			if (valid)
+				usedLocations |= 1u << attribute.location;
+		}
+
+		for (const Submesh& submesh : mSubmeshes)
+			valid = valid && submesh.firstIndex <= mIndexCount && submesh.indexCount <= mIndexCount - submesh.firstIndex;
+	}
+
+	// An index past the vertices would have the draw read outside the vertex buffer. Checking reads the index pages once,
+	// which the upload would fault in anyway.
+	if (valid)
+	{
+		valid = mIndexType == IndexUInt16 ? indicesInRange<uint16_t>(GetIndexData(), mIndexCount, mVertexCount)
+			: indicesInRange<uint32_t>(GetIndexData(), mIndexCount, mVertexCount);
+	}
+
+	if (!valid)
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void MeshContainer::Close()
+{
+	if (mData)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(mData);
+		CloseHandle((HANDLE)mMappingHandle);
+		CloseHandle((HANDLE)mFileHandle);
+#else
+		munmap((void*)mData, mSize);
+#endif
+	}
+
+	mData = nullptr;
+	mSize = 0;
+	mFileHandle = nullptr;
+	mMappingHandle = nullptr;
+	mVertexCount = 0;
+	mIndexCount = 0;
+	mAttributes.clear();
+	mSubmeshes.clear();
+}
+
+void MeshContainer::Prefetch() const
+{
+	const size_t pageSize = 4096;
+
+	// Volatile, so the reads are not optimized away.
+	volatile unsigned char sink = 0;
+	for (size_t offset = 0; offset < mSize; offset += pageSize)
+		sink = sink + mData[offset];
+}
+
+const MeshContainer::Attribute* MeshContainer::FindAttribute(uint32_t location) const
+{
+	for (const Attribute& attribute : mAttributes)
+	{
+		if (attribute.location == location)
+			return &attribute;
+	}
+	return nullptr;
+}
+
+bool MeshContainer::Write(const string& path, const void* vertices, uint32_t vertexCount, uint32_t vertexStride, const vector<Attribute>& attributes,
+	const vector<unsigned int>& indices, const vector<Submesh>& submeshes)
+{
+	if (!vertices || vertexCount == 0 || vertexStride == 0 || vertexStride > MAX_VERTEX_STRIDE || attributes.empty() || attributes.size() > MaxAttributeLocations
+		|| indices.empty() || indices.size() > UINT32_MAX || submeshes.size() > MAX_SUBMESH_COUNT)
+		return false;
+
+	const Attribute* position = nullptr;
+	for (const Attribute& attribute : attributes)
+	{
+		if (!isValidAttribute(attribute, vertexStride))
+			return false;
+		if (attribute.location == 0)
+			position = &attribute;
+	}
+	if (!position || position->componentCount < 3)
+		return false;
+
+	for (unsigned int index : indices)
+	{
+		if (index >= vertexCount)
+			return false;
+	}
+
+	const unsigned char* vertexBytes = (const unsigned char*)vertices;
+	auto readPosition = [&](uint32_t vertex, float value[3])
+	{
+		memcpy(value, vertexBytes + (size_t)vertex * vertexStride + position->offset, 3 * sizeof(float));
+	};
+
+	vector<Submesh> table = submeshes;
+	if (table.empty())
+		table.push_back(Submesh{ 0, (uint32_t)indices.size(), {}, {} });
+
+	for (Submesh& submesh : table)
+	{
+		if (submesh.firstIndex > indices.size() || submesh.indexCount > indices.size() - submesh.firstIndex)
+			return false;
+
+		for (int c = 0; c < 3; c++)
+		{
+			submesh.boundsMin[c] = submesh.indexCount > 0 ? FLT_MAX : 0.0f;
+			submesh.boundsMax[c] = submesh.indexCount > 0 ? -FLT_MAX : 0.0f;
+		}
+		for (uint32_t i = submesh.firstIndex; i < submesh.firstIndex + submesh.indexCount; i++)
+		{
+			float value[3];
+			readPosition(indices[i], value);
+			for (int c = 0; c < 3; c++)
+			{
+				submesh.boundsMin[c] = std::min(submesh.boundsMin[c], value[c]);
+				submesh.boundsMax[c] = std::max(submesh.boundsMax[c], value[c]);
+			}
+		}
+	}
+
+	FileHeader header{};
+	memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+	header.version = FILE_VERSION;
+	header.vertexCount = vertexCount;
+	header.vertexStride = vertexStride;
+	header.indexCount = (uint32_t)indices.size();
+	header.indexType = vertexCount <= 65536 ? IndexUInt16 : IndexUInt32;
+	header.attributeCount = (uint32_t)attributes.size();
+	header.submeshCount = (uint32_t)table.size();
+
+	// The bounds of the whole mesh take every vertex, those of the submeshes only the ones their indices use.
+	for (int c = 0; c < 3; c++)
+	{
+		header.boundsMin[c] = FLT_MAX;
+		header.boundsMax[c] = -FLT_MAX;
+	}
+	for (uint32_t vertex = 0; vertex < vertexCount; vertex++)
+	{
+		float value[3];
+		readPosition(vertex, value);
+		for (int c = 0; c < 3; c++)
+		{
+			header.boundsMin[c] = std::min(header.boundsMin[c], value[c]);
+			header.boundsMax[c] = std::max(header.boundsMax[c], value[c]);
+		}
+	}
+
+	uint64_t tablesEnd = sizeof(FileHeader) + attributes.size() * sizeof(Attribute) + table.size() * sizeof(Submesh);
+	uint64_t vertexDataSize = (uint64_t)vertexCount * vertexStride;
+	header.vertexOffset = alignOffset(tablesEnd);
+	header.indexOffset = alignOffset(header.vertexOffset + vertexDataSize);
+
+	vector<uint16_t> shortIndices;
+	const char* indexData = (const char*)indices.data();
+	uint64_t indexDataSize = indices.size() * sizeof(unsigned int);
+	if (header.indexType == IndexUInt16)
+	{
+		shortIndices.assign(indices.begin(), indices.end());
+		indexData = (const char*)shortIndices.data();
+		indexDataSize = shortIndices.size() * sizeof(uint16_t);
+	}
+
+	ofstream file(path, ios::binary | ios::trunc);
+	if (!file)
+		return false;
+
+	const char padding[DATA_ALIGNMENT] = {};
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)attributes.data(), attributes.size() * sizeof(Attribute));
+	file.write((const char*)table.data(), table.size() * sizeof(Submesh));
+	file.write(padding, header.vertexOffset - tablesEnd);
+	file.write((const char*)vertices, vertexDataSize);
+	file.write(padding, header.indexOffset - header.vertexOffset - vertexDataSize);
+	file.write(indexData, indexDataSize);
+
+	return (bool)file;
+}
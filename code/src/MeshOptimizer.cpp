@@ -0,0 +1,229 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+
+typedef Model::TexturedColoredNormalVertex Vertex;
+
+// Scoring constants of the paper.
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+// Vertices with more triangles left than this score as if they had this many.
+const unsigned int MAX_SCORED_VALENCE = 32;
+
+void MeshOptimizer::OptimizeVertexCache(vector<unsigned int>& indices, int vertexCount)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0 || vertexCount <= 0)
+		return;
+
+	// Scores by place in the cache, the three vertices of the last triangle all alike, and by triangles left to draw.
+	// Vertices with few triangles left score higher, so lone triangles are not left behind to cost a miss later.
+	float cacheScores[OptimizedCacheSize];
+	for (int i = 0; i < OptimizedCacheSize; i++)
+		cacheScores[i] = i < 3 ? LAST_TRIANGLE_SCORE : pow(1.0f - (float)(i - 3) / (OptimizedCacheSize - 3), CACHE_DECAY_POWER);
+	float valenceScores[MAX_SCORED_VALENCE + 1];
+	valenceScores[0] = 0.0f;
+	for (unsigned int valence = 1; valence <= MAX_SCORED_VALENCE; valence++)
+		valenceScores[valence] = VALENCE_BOOST_SCALE * pow((float)valence, -VALENCE_BOOST_POWER);
+
+	// The triangles left to draw of vertex v are the first remaining[v] ones from triangleStarts[v].
+	vector<unsigned int> remaining(vertexCount, 0);
+	for (unsigned int index : indices)
+		remaining[index]++;
+	vector<unsigned int> triangleStarts(vertexCount + 1, 0);
+	for (int vertex = 0; vertex < vertexCount; vertex++)
+		triangleStarts[vertex + 1] = triangleStarts[vertex] + remaining[vertex];
+	vector<unsigned int> vertexTriangles(triangleStarts[vertexCount]);
+	vector<unsigned int> filled(triangleStarts.begin(), triangleStarts.end() - 1);
+	for (size_t triangle = 0; triangle < triangleCount; triangle++)
+	{
+		for (int corner = 0; corner < 3; corner++)
+			vertexTriangles[filled[indices[3 * triangle + corner]]++] = (unsigned int)triangle;
+	}
+
+	vector<int> cachePositions(vertexCount, -1);
+	auto scoreVertex = [&](unsigned int vertex)
+	{
+		if (remaining[vertex] == 0)
+			return -1.0f;
+		float score = valenceScores[std::min(remaining[vertex], MAX_SCORED_VALENCE)];
+		if (cachePositions[vertex] >= 0)
+			score += cacheScores[cachePositions[vertex]];
+		return score;
+	};
+
+	vector<float> vertexScores(vertexCount);
+	for (int vertex = 0; vertex < vertexCount; vertex++)
+		vertexScores[vertex] = scoreVertex(vertex);
+
+	vector<float> triangleScores(triangleCount);
+	vector<bool> emitted(triangleCount, false);
+	for (size_t triangle = 0; triangle < triangleCount; triangle++)
+		triangleScores[triangle] = vertexScores[indices[3 * triangle]] + vertexScores[indices[3 * triangle + 1]] + vertexScores[indices[3 * triangle + 2]];
+
+	// Most recently used first. Room for the three vertices pushed in front before the oldest are dropped.
+	unsigned int cache[OptimizedCacheSize + 3];
+	int cacheCount = 0;
+
+	vector<unsigned int> optimized;
+	optimized.reserve(indices.size());
+
+	// Triangles before the cursor are all drawn, searches for a new start begin there.
+	size_t firstLeft = 0;
+	long long bestTriangle = -1;
+	for (size_t drawn = 0; drawn < triangleCount; drawn++)
+	{
+		// Nothing around the cache is left to draw: start over from the best triangle of the whole mesh.
+		if (bestTriangle < 0)
+		{
+			while (emitted[firstLeft])
+				firstLeft++;
+			float bestScore = -FLT_MAX;
+			for (size_t triangle = firstLeft; triangle < triangleCount; triangle++)
+			{
+				if (!emitted[triangle] && triangleScores[triangle] > bestScore)
+				{
+					bestScore = triangleScores[triangle];
+					bestTriangle = (long long)triangle;
+				}
+			}
+		}
+
+		size_t triangle = (size_t)bestTriangle;
+		emitted[triangle] = true;
+		const unsigned int* corners = &indices[3 * triangle];
+		optimized.insert(optimized.end(), corners, corners + 3);
+
+		// The triangle is no longer left to draw for its vertices.
+		for (int corner = 0; corner < 3; corner++)
+		{
+			unsigned int vertex = corners[corner];
+			unsigned int* triangles = vertexTriangles.data() + triangleStarts[vertex];
+			unsigned int* end = triangles + remaining[vertex];
+			unsigned int* found = find(triangles, end, (unsigned int)triangle);
+			if (found != end)
+			{
+				*found = *(end - 1);
+				remaining[vertex]--;
+			}
+		}
+
+		// Its vertices move to the front of the cache, the others keep their order behind them.
+		unsigned int newCache[OptimizedCacheSize + 3];
+		int newCount = 0;
+		for (int corner = 0; corner < 3; corner++)
+		{
+			if (find(newCache, newCache + newCount, corners[corner]) == newCache + newCount)
+				newCache[newCount++] = corners[corner];
+		}
+		for (int i = 0; i < cacheCount; i++)
+		{
+			if (find(corners, corners + 3, cache[i]) == corners + 3)
+				newCache[newCount++] = cache[i];
+		}
+
+		// Rescore the vertices of the cache and those that fell out of it, then the triangles left around them.
+		for (int i = 0; i < newCount; i++)
+		{
+			cachePositions[newCache[i]] = i < OptimizedCacheSize ? i : -1;
+			vertexScores[newCache[i]] = scoreVertex(newCache[i]);
+		}
+
+		bestTriangle = -1;
+		float bestScore = -FLT_MAX;
+		for (int i = 0; i < newCount; i++)
+		{
+			unsigned int vertex = newCache[i];
+			for (unsigned int j = 0; j < remaining[vertex]; j++)
+			{
+				unsigned int neighbour = vertexTriangles[triangleStarts[vertex] + j];
+				const unsigned int* neighbourCorners = &indices[3 * neighbour];
+				float score = vertexScores[neighbourCorners[0]] + vertexScores[neighbourCorners[1]] + vertexScores[neighbourCorners[2]];
+				triangleScores[neighbour] = score;
+				if (score > bestScore)
+				{
+					bestScore = score;
+					bestTriangle = neighbour;
+				}
+			}
+		}
+
+		cacheCount = std::min(newCount, OptimizedCacheSize);
+		copy(newCache, newCache + cacheCount, cache);
+	}
+
+	indices.swap(optimized);
+}
+
+void MeshOptimizer::OptimizeVertexFetch(vector<Vertex>& vertices, vector<unsigned int>& indices)
+{
+	const unsigned int UNUSED = ~0u;
+	vector<unsigned int> remap(vertices.size(), UNUSED);
+	vector<Vertex> reordered;
+	reordered.reserve(vertices.size());
+
+	for (unsigned int& index : indices)
+	{
+		if (remap[index] == UNUSED)
+		{
+			remap[index] = (unsigned int)reordered.size();
+			reordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+
+	vertices.swap(reordered);
+}
+
+void MeshOptimizer::Optimize(vector<Vertex>& vertices, vector<unsigned int>& indices)
+{
+	OptimizeVertexCache(indices, (int)vertices.size());
+	OptimizeVertexFetch(vertices, indices);
+}
+
+MeshOptimizer::VertexCacheStatistics MeshOptimizer::AnalyzeVertexCache(const vector<unsigned int>& indices, int vertexCount, int cacheSize)
+{
+	VertexCacheStatistics statistics;
+	if (indices.size() < 3 || vertexCount <= 0 || cacheSize <= 0)
+		return statistics;
+
+	// First in first out: a vertex is still cached while fewer than cacheSize misses came after its own.
+	// Starting cacheSize misses back, every vertex misses on first use.
+	vector<long long> loadedAt(vertexCount, -(long long)cacheSize);
+	vector<bool> used(vertexCount, false);
+	long long misses = 0;
+	int usedCount = 0;
+	for (unsigned int index : indices)
+	{
+		if (misses - loadedAt[index] >= cacheSize)
+		{
+			loadedAt[index] = misses;
+			misses++;
+		}
+		if (!used[index])
+		{
+			used[index] = true;
+			usedCount++;
+		}
+	}
+
+	statistics.acmr = (float)misses / (float)(indices.size() / 3);
+	statistics.atvr = (float)misses / (float)usedCount;
+	return statistics;
+}
+
+void MeshOptimizer::PrintStatistics(const string& name, int vertexCount, int triangleCount, const VertexCacheStatistics& generated, const VertexCacheStatistics& optimized)
+{
+	cout << fixed << setprecision(3);
+	cout << "  " << name << ": " << vertexCount << " vertices, " << triangleCount << " triangles, ACMR " << generated.acmr << " -> " << optimized.acmr
+		<< ", ATVR " << generated.atvr << " -> " << optimized.atvr << "\n";
+	cout << defaultfloat << setprecision(6);
+}
@@ -10,6 +10,8 @@
 #include <glm/common.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include <vector>
+
 using namespace std;
 using namespace glm;
 
@@ -101,4 +103,31 @@ void Model::UpdateRotation(vec3 rotation)
 void Model::UpdateScale(vec3 scale)
 {
     mScaling += scale;
-}
\ No newline at end of file
+}
+
+unsigned int Model::PositionOnlyVAO(const TexturedColoredNormalVertex* vertices, int vertexCount, unsigned int* positionBuffer)
+{
+    std::vector<vec3> positions(vertexCount);
+    for (int i = 0; i < vertexCount; i++)
+        positions[i] = vertices[i].position;
+
+    GLuint vertexArrayObject;
+    glGenVertexArrays(1, &vertexArrayObject);
+    glBindVertexArray(vertexArrayObject);
+
+    GLuint vertexBufferObject;
+    glGenBuffers(1, &vertexBufferObject);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBufferObject);
+    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(vec3), positions.data(), GL_STATIC_DRAW);
+
+    // Attribute 0 matches aPos, as in the full vertex arrays.
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    glBindVertexArray(0);
+
+    if (positionBuffer)
+        *positionBuffer = vertexBufferObject;
+
+    return vertexArrayObject;
+}
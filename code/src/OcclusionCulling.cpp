@@ -0,0 +1,343 @@
+#include "OcclusionCulling.h"
+
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_USE_SSE 1
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+using namespace glm;
+
+// Occluders are clipped this far in front of the camera. Dropping the sliver closer than that only hides less.
+const float NEAR_W = 0.1f;
+
+// Occluders whose bounding sphere is smaller than this fraction of its distance cover a few pixels at most and are skipped.
+const float MINIMUM_OCCLUDER_SIZE = 0.02f;
+
+OcclusionCuller::OcclusionCuller()
+	: mViewProjection(1.0f), mOccludersRendered(0), mDepth(Width * Height, 0.0f), mTileDepth(TilesX * TilesY, 0.0f)
+{
+}
+
+unsigned int OcclusionCuller::AddMesh(const vector<vec3>& positions, const vector<unsigned int>& indices)
+{
+	Mesh mesh;
+	mesh.positions = positions;
+	mesh.indices = indices;
+	mMeshes.push_back(mesh);
+	return (unsigned int)mMeshes.size() - 1;
+}
+
+void OcclusionCuller::AddOccluder(unsigned int mesh, const mat4& worldMatrix, vec3 center, float radius)
+{
+	Occluder occluder;
+	occluder.mesh = mesh;
+	occluder.worldMatrix = worldMatrix;
+	occluder.sphere = vec4(center, radius);
+	mOccluders.push_back(occluder);
+}
+
+void OcclusionCuller::UpdateOccluder(unsigned int occluder, const mat4& worldMatrix, vec3 center, float radius)
+{
+	mOccluders[occluder].worldMatrix = worldMatrix;
+	mOccluders[occluder].sphere = vec4(center, radius);
+}
+
+void OcclusionCuller::Render(const mat4& viewProjection, JobSystem* jobSystem)
+{
+	mViewProjection = viewProjection;
+	mTriangles.clear();
+	mOccludersRendered = 0;
+
+	// Transform and set up on the calling thread, there are only a few thousand triangles.
+	Frustum frustum = Frustum::FromMatrix(viewProjection);
+	for (const Occluder& occluder : mOccluders)
+	{
+		vec3 center = vec3(occluder.sphere);
+		float radius = occluder.sphere.w;
+
+		bool inside = true;
+		for (int p = 0; p < 6 && inside; p++)
+			inside = dot(vec3(frustum.planes[p]), center) + frustum.planes[p].w >= -radius;
+		if (!inside)
+			continue;
+
+		// Occluders around the camera are always kept.
+		float centerW = (viewProjection * vec4(center, 1.0f)).w;
+		if (centerW > radius && radius < MINIMUM_OCCLUDER_SIZE * centerW)
+			continue;
+
+		const Mesh& mesh = mMeshes[occluder.mesh];
+		mat4 worldViewProjection = viewProjection * occluder.worldMatrix;
+
+		mClipPositions.resize(mesh.positions.size());
+		for (size_t i = 0; i < mesh.positions.size(); i++)
+			mClipPositions[i] = worldViewProjection * vec4(mesh.positions[i], 1.0f);
+
+		for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+			ClipTriangle(mClipPositions[mesh.indices[i]], mClipPositions[mesh.indices[i + 1]], mClipPositions[mesh.indices[i + 2]]);
+
+		mOccludersRendered++;
+	}
+
+	// Rows of tiles do not share pixels, so each one is a job of its own.
+	if (jobSystem)
+	{
+		jobSystem->ParallelFor(TilesY, 1, [this](unsigned int begin, unsigned int end)
+		{
+			for (unsigned int tileRow = begin; tileRow < end; tileRow++)
+				RenderTileRow((int)tileRow);
+		});
+	}
+	else
+	{
+		for (int tileRow = 0; tileRow < TilesY; tileRow++)
+			RenderTileRow(tileRow);
+	}
+}
+
+void OcclusionCuller::ClipTriangle(const vec4& a, const vec4& b, const vec4& c)
+{
+	// Sutherland-Hodgman against the near plane. One plane turns a triangle into at most a quad.
+	const vec4 input[3] = { a, b, c };
+	vec4 polygon[4];
+	int count = 0;
+
+	for (int i = 0; i < 3; i++)
+	{
+		const vec4& current = input[i];
+		const vec4& next = input[(i + 1) % 3];
+		bool currentInside = current.w >= NEAR_W;
+		bool nextInside = next.w >= NEAR_W;
+
+		if (currentInside)
+			polygon[count++] = current;
+		if (currentInside != nextInside)
+			polygon[count++] = mix(current, next, (NEAR_W - current.w) / (next.w - current.w));
+	}
+
+	for (int i = 1; i + 1 < count; i++)
+		SetupTriangle(polygon[0], polygon[i], polygon[i + 1]);
+}
+
+void OcclusionCuller::SetupTriangle(const vec4& a, const vec4& b, const vec4& c)
+{
+	// Vertices close to the near plane land far off screen, set up in double precision so the edges stay exact where it matters.
+	const vec4* clip[3] = { &a, &b, &c };
+	dvec3 vertices[3];
+	for (int i = 0; i < 3; i++)
+	{
+		double inverseW = 1.0 / clip[i]->w;
+		vertices[i] = dvec3((clip[i]->x * inverseW * 0.5 + 0.5) * Width, (clip[i]->y * inverseW * 0.5 + 0.5) * Height, inverseW);
+	}
+
+	double area = (vertices[1].x - vertices[0].x) * (vertices[2].y - vertices[0].y) - (vertices[2].x - vertices[0].x) * (vertices[1].y - vertices[0].y);
+	if (std::abs(area) < 1.0e-6)
+		return;
+
+	// Occluders hide what is behind them from both sides, turn every triangle counterclockwise.
+	if (area < 0.0)
+	{
+		std::swap(vertices[1], vertices[2]);
+		area = -area;
+	}
+
+	// Pixels whose center is inside the bounding box, clamped to the screen.
+	double minX = std::min(vertices[0].x, std::min(vertices[1].x, vertices[2].x));
+	double maxX = std::max(vertices[0].x, std::max(vertices[1].x, vertices[2].x));
+	double minY = std::min(vertices[0].y, std::min(vertices[1].y, vertices[2].y));
+	double maxY = std::max(vertices[0].y, std::max(vertices[1].y, vertices[2].y));
+
+	Triangle triangle;
+	triangle.minX = (int)std::max(0.0, ceil(minX - 0.5));
+	triangle.maxX = (int)std::min(Width - 1.0, floor(maxX - 0.5));
+	triangle.minY = (int)std::max(0.0, ceil(minY - 0.5));
+	triangle.maxY = (int)std::min(Height - 1.0, floor(maxY - 0.5));
+	if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+		return;
+
+	// Edge i is opposite vertex i and positive inside. Its value at vertex i is the area, so edge / area is a barycentric coordinate.
+	dvec3 depth = dvec3(0.0);
+	for (int i = 0; i < 3; i++)
+	{
+		const dvec3& from = vertices[(i + 1) % 3];
+		const dvec3& to = vertices[(i + 2) % 3];
+		dvec3 edge = dvec3(from.y - to.y, to.x - from.x, 0.0);
+		edge.z = -(edge.x * from.x + edge.y * from.y);
+
+		depth += edge * (vertices[i].z / area);
+
+		// Only the sign of an edge matters, normalizing keeps it in float range.
+		triangle.edges[i] = vec3(edge / std::max(std::abs(edge.x), std::abs(edge.y)));
+	}
+	triangle.depth = vec3(depth);
+
+	mTriangles.push_back(triangle);
+}
+
+void OcclusionCuller::RenderTileRow(int tileRow)
+{
+	int rowBegin = tileRow * TileSize;
+	int rowEnd = rowBegin + TileSize;
+	std::fill(mDepth.begin() + rowBegin * Width, mDepth.begin() + rowEnd * Width, 0.0f);
+
+	for (const Triangle& triangle : mTriangles)
+	{
+		int yBegin = std::max(triangle.minY, rowBegin);
+		int yEnd = std::min(triangle.maxY + 1, rowEnd);
+		if (yBegin >= yEnd)
+			continue;
+
+		// Pixels go by aligned groups of four, which never run past the end of a row as it is a multiple of four wide.
+		int xBegin = triangle.minX & ~3;
+		int xEnd = triangle.maxX + 1;
+
+		for (int y = yBegin; y < yEnd; y++)
+		{
+			float* row = &mDepth[y * Width];
+			float pixelY = y + 0.5f;
+
+#ifdef OCCLUSION_USE_SSE
+			__m128 edgeX[3], edgeRow[3];
+			for (int i = 0; i < 3; i++)
+			{
+				edgeX[i] = _mm_set1_ps(triangle.edges[i].x);
+				edgeRow[i] = _mm_set1_ps(triangle.edges[i].y * pixelY + triangle.edges[i].z);
+			}
+			__m128 depthX = _mm_set1_ps(triangle.depth.x);
+			__m128 depthRow = _mm_set1_ps(triangle.depth.y * pixelY + triangle.depth.z);
+			__m128 pixelOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+			__m128 zero = _mm_setzero_ps();
+
+			for (int x = xBegin; x < xEnd; x += 4)
+			{
+				__m128 pixelX = _mm_add_ps(_mm_set1_ps((float)x), pixelOffsets);
+
+				__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeX[0], pixelX), edgeRow[0]), zero);
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeX[1], pixelX), edgeRow[1]), zero));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeX[2], pixelX), edgeRow[2]), zero));
+				if (_mm_movemask_ps(inside) == 0)
+					continue;
+
+				__m128 depth = _mm_add_ps(_mm_mul_ps(depthX, pixelX), depthRow);
+				__m128 previous = _mm_loadu_ps(row + x);
+				__m128 nearest = _mm_max_ps(previous, depth);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, previous)));
+			}
+#else
+			for (int x = xBegin; x < xEnd; x++)
+			{
+				float pixelX = x + 0.5f;
+
+				bool inside = true;
+				for (int i = 0; i < 3 && inside; i++)
+					inside = triangle.edges[i].x * pixelX + triangle.edges[i].y * pixelY + triangle.edges[i].z >= 0.0f;
+				if (!inside)
+					continue;
+
+				float depth = triangle.depth.x * pixelX + triangle.depth.y * pixelY + triangle.depth.z;
+				row[x] = std::max(row[x], depth);
+			}
+#endif
+		}
+	}
+
+	// Keep the farthest depth of each tile.
+	for (int tileX = 0; tileX < TilesX; tileX++)
+	{
+#ifdef OCCLUSION_USE_SSE
+		__m128 farthest = _mm_set1_ps(FLT_MAX);
+		for (int y = rowBegin; y < rowEnd; y++)
+		{
+			const float* pixels = &mDepth[y * Width + tileX * TileSize];
+			for (int x = 0; x < TileSize; x += 4)
+				farthest = _mm_min_ps(farthest, _mm_loadu_ps(pixels + x));
+		}
+		farthest = _mm_min_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(1, 0, 3, 2)));
+		farthest = _mm_min_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(2, 3, 0, 1)));
+		mTileDepth[tileRow * TilesX + tileX] = _mm_cvtss_f32(farthest);
+#else
+		float farthest = FLT_MAX;
+		for (int y = rowBegin; y < rowEnd; y++)
+		{
+			for (int x = 0; x < TileSize; x++)
+				farthest = std::min(farthest, mDepth[y * Width + tileX * TileSize + x]);
+		}
+		mTileDepth[tileRow * TilesX + tileX] = farthest;
+#endif
+	}
+}
+
+bool OcclusionCuller::IsVisible(vec3 center, float radius) const
+{
+	// Project the sphere's bounding box, whose nearest corner is at least as near as any point of the sphere.
+	vec4 clipCenter = mViewProjection * vec4(center, 1.0f);
+	vec4 axes[3] = { mViewProjection[0] * radius, mViewProjection[1] * radius, mViewProjection[2] * radius };
+
+	float minX = FLT_MAX, maxX = -FLT_MAX;
+	float minY = FLT_MAX, maxY = -FLT_MAX;
+	float nearest = 0.0f;
+	for (int corner = 0; corner < 8; corner++)
+	{
+		vec4 clip = clipCenter;
+		for (int axis = 0; axis < 3; axis++)
+			clip += (corner & (1 << axis)) ? axes[axis] : -axes[axis];
+
+		// Reaching the clipped away sliver in front of the camera, nothing can hide it.
+		if (clip.w < NEAR_W)
+			return true;
+
+		float inverseW = 1.0f / clip.w;
+		float x = (clip.x * inverseW * 0.5f + 0.5f) * Width;
+		float y = (clip.y * inverseW * 0.5f + 0.5f) * Height;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		nearest = std::max(nearest, inverseW);
+	}
+
+	// Entirely off screen is for frustum culling to decide.
+	if (maxX < 0.0f || maxY < 0.0f || minX > Width || minY > Height)
+		return true;
+
+	int tileMinX = std::min((int)std::max(0.0f, minX) / TileSize, TilesX - 1);
+	int tileMaxX = std::min((int)std::min((float)Width, maxX) / TileSize, TilesX - 1);
+	int tileMinY = std::min((int)std::max(0.0f, minY) / TileSize, TilesY - 1);
+	int tileMaxY = std::min((int)std::min((float)Height, maxY) / TileSize, TilesY - 1);
+
+	// Hidden only when every tile has an occluder nearer than the box.
+	for (int tileY = tileMinY; tileY <= tileMaxY; tileY++)
+	{
+		for (int tileX = tileMinX; tileX <= tileMaxX; tileX++)
+		{
+			if (mTileDepth[tileY * TilesX + tileX] <= nearest)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+unsigned int OcclusionCuller::Cull(const CullingSystem& bounds, vector<unsigned char>& visibility) const
+{
+	unsigned int hiddenCount = 0;
+	for (unsigned int i = 0; i < bounds.GetCount(); i++)
+	{
+		if (!visibility[i])
+			continue;
+
+		vec4 sphere = bounds.GetSphere(i);
+		if (!IsVisible(vec3(sphere), sphere.w))
+		{
+			visibility[i] = 0;
+			hiddenCount++;
+		}
+	}
+
+	return hiddenCount;
+}
@@ -0,0 +1,60 @@
+#include "OffscreenTarget.h"
+
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+OffscreenTarget::OffscreenTarget(int width, int height) : mFramebuffer(0), mColourBuffer(0), mDepthBuffer(0), mWidth(width), mHeight(height), mComplete(false)
+{
+	glGenRenderbuffers(1, &mColourBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, mColourBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+	glGenRenderbuffers(1, &mDepthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, mDepthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &mFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, mColourBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mDepthBuffer);
+
+	mComplete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	if (!mComplete)
+		cout << "Offscreen framebuffer incomplete.\n";
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+OffscreenTarget::~OffscreenTarget()
+{
+	glDeleteFramebuffers(1, &mFramebuffer);
+	glDeleteRenderbuffers(1, &mColourBuffer);
+	glDeleteRenderbuffers(1, &mDepthBuffer);
+}
+
+bool OffscreenTarget::SaveFrame(const string& path)
+{
+	mPixels.resize((size_t)mWidth * mHeight * 3);
+
+	GLint previousFramebuffer = 0;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousFramebuffer);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, mFramebuffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, mWidth, mHeight, GL_RGB, GL_UNSIGNED_BYTE, mPixels.data());
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, previousFramebuffer);
+
+	ofstream file(path, ios::binary | ios::trunc);
+	if (!file)
+		return false;
+
+	// GL rows go bottom up, PPM rows top down.
+	file << "P6\n" << mWidth << " " << mHeight << "\n255\n";
+	for (int row = mHeight - 1; row >= 0; row--)
+		file.write((const char*)&mPixels[(size_t)row * mWidth * 3], (size_t)mWidth * 3);
+
+	return (bool)file;
+}
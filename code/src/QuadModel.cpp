@@ -9,7 +9,7 @@
 using namespace glm;
 using namespace std;
 
-unsigned int QuadModel::QuadModelVAO()
+std::vector<Model::TexturedColoredNormalVertex> QuadModel::QuadVertices()
 {
 	TexturedColoredNormalVertex texturedCubeVertexArray[] = {
 			TexturedColoredNormalVertex(vec3(-0.5, 0.5, 0),		vec3(1.0f, 0.0f, 0.0f),	vec2(1.0f, 0.0f),	vec3(0.0f, 0.0f, -1.0f)),
@@ -21,6 +21,13 @@ unsigned int QuadModel::QuadModelVAO()
 			TexturedColoredNormalVertex(vec3(0.5, -0.5, 0),		vec3(1.0f, 0.0f, 0.0f),	vec2(0.0f, 1.0f),	vec3(0.0f, 0.0f, -1.0f))
 	};
 
+	return std::vector<TexturedColoredNormalVertex>(texturedCubeVertexArray, texturedCubeVertexArray + sizeof(texturedCubeVertexArray) / sizeof(TexturedColoredNormalVertex));
+}
+
+unsigned int QuadModel::QuadModelVAO(unsigned int* shadowVAO, unsigned int* shadowVBO)
+{
+	std::vector<TexturedColoredNormalVertex> vertices = QuadVertices();
+
 	// Create a vertex array
 	GLuint vertexArrayObject;
 	glGenVertexArrays(1, &vertexArrayObject);
@@ -30,7 +37,7 @@ unsigned int QuadModel::QuadModelVAO()
 	GLuint vertexBufferObject;
 	glGenBuffers(1, &vertexBufferObject);
 	glBindBuffer(GL_ARRAY_BUFFER, vertexBufferObject);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(texturedCubeVertexArray), texturedCubeVertexArray, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(TexturedColoredNormalVertex), vertices.data(), GL_STATIC_DRAW);
 
 	glVertexAttribPointer(0,                   // attribute 0 matches aPos in Vertex Shader
 		3,                   // size
@@ -69,6 +76,12 @@ unsigned int QuadModel::QuadModelVAO()
 	);
 	glEnableVertexAttribArray(3);
 
+	if (shadowVAO)
+	{
+		*shadowVAO = PositionOnlyVAO(vertices.data(), (int)vertices.size(), shadowVBO);
+		glBindVertexArray(vertexArrayObject);
+	}
+
 	return vertexArrayObject;
 }
 
@@ -0,0 +1,296 @@
+#include "RenderQueue.h"
+#include "TextureManager.h"
+#include "GpuProfiler.h"
+
+#include <iostream>
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+// Bit widths of the sort key fields.
+const int PASS_BITS = 4;
+const int SECTION_BITS = 4;
+const int PROGRAM_BITS = 8;
+const int VERTEX_ARRAY_BITS = 12;
+const int MATERIAL_BITS = 16;
+const int DEPTH_BITS = 20;
+
+const GLuint UNKNOWN_STATE = 0xFFFFFFFFu;
+
+RenderQueue::RenderQueue() : mMaxDepth(1000.0f), mTextureManager(nullptr), mProfiler(nullptr)
+{
+	// Reserve material 0 as the empty material.
+	mMaterials.push_back(RenderMaterial());
+
+	InvalidateState();
+}
+
+unsigned int RenderQueue::RegisterProgram(GLuint shaderProgram)
+{
+	for (unsigned int i = 0; i < mPrograms.size(); i++)
+	{
+		if (mPrograms[i] == shaderProgram)
+			return i;
+	}
+
+	mPrograms.push_back(shaderProgram);
+	mWorldMatrixLocations.push_back(glGetUniformLocation(shaderProgram, "worldMatrix"));
+
+	if (mPrograms.size() > (1u << PROGRAM_BITS))
+		cout << "RenderQueue: too many programs registered, sort keys will collide.\n";
+
+	return (unsigned int)mPrograms.size() - 1;
+}
+
+unsigned int RenderQueue::RegisterVertexArray(GLuint vertexArray)
+{
+	for (unsigned int i = 0; i < mVertexArrays.size(); i++)
+	{
+		if (mVertexArrays[i] == vertexArray)
+			return i;
+	}
+
+	mVertexArrays.push_back(vertexArray);
+
+	if (mVertexArrays.size() > (1u << VERTEX_ARRAY_BITS))
+		cout << "RenderQueue: too many vertex arrays registered, sort keys will collide.\n";
+
+	return (unsigned int)mVertexArrays.size() - 1;
+}
+
+unsigned int RenderQueue::AddMaterial(const RenderMaterial& material)
+{
+	mMaterials.push_back(material);
+
+	if (mMaterials.size() > (1u << MATERIAL_BITS))
+		cout << "RenderQueue: too many materials, sort keys will collide.\n";
+
+	return (unsigned int)mMaterials.size() - 1;
+}
+
+uint64_t RenderQueue::PackSortKey(unsigned int pass, unsigned int section, unsigned int program, unsigned int vertexArray, unsigned int material, unsigned int depth)
+{
+	uint64_t key = (uint64_t)(pass & ((1u << PASS_BITS) - 1));
+	key = (key << SECTION_BITS) | (section & ((1u << SECTION_BITS) - 1));
+	key = (key << PROGRAM_BITS) | (program & ((1u << PROGRAM_BITS) - 1));
+	key = (key << VERTEX_ARRAY_BITS) | (vertexArray & ((1u << VERTEX_ARRAY_BITS) - 1));
+	key = (key << MATERIAL_BITS) | (material & ((1u << MATERIAL_BITS) - 1));
+	key = (key << DEPTH_BITS) | (depth & ((1u << DEPTH_BITS) - 1));
+	return key;
+}
+
+void RenderQueue::Submit(EPass pass, GLuint shaderProgram, GLuint vertexArray, unsigned int material, float depth, const mat4& worldMatrix, int vertexCount, GLenum renderingMode, int section)
+{
+	// Opaque draws go front to back to make the most of early depth testing, alpha tested ones back to front.
+	const unsigned int maxDepthValue = (1u << DEPTH_BITS) - 1;
+	float normalizedDepth = std::max(0.0f, std::min(1.0f, depth / mMaxDepth));
+	unsigned int quantizedDepth = (unsigned int)(normalizedDepth * maxDepthValue);
+	if (pass == AlphaTested)
+		quantizedDepth = maxDepthValue - quantizedDepth;
+
+	unsigned int programIndex = RegisterProgram(shaderProgram);
+	if (!mProfiler)
+		section = -1;
+
+	SortEntry entry;
+	entry.key = PackSortKey(pass, section + 1, programIndex, RegisterVertexArray(vertexArray), material, quantizedDepth);
+	entry.command = (unsigned int)mCommands.size();
+	mSortEntries.push_back(entry);
+
+	RenderCommand command;
+	command.shaderProgram = shaderProgram;
+	command.worldMatrixLocation = mWorldMatrixLocations[programIndex];
+	command.vertexArray = vertexArray;
+	command.material = material;
+	command.vertexCount = vertexCount;
+	command.indexType = 0;
+	command.renderingMode = renderingMode;
+	command.section = section;
+	command.worldMatrix = worldMatrix;
+	mCommands.push_back(command);
+}
+
+void RenderQueue::SubmitIndexed(EPass pass, GLuint shaderProgram, GLuint vertexArray, unsigned int material, float depth, const mat4& worldMatrix, int indexCount, GLenum indexType, GLenum renderingMode, int section)
+{
+	Submit(pass, shaderProgram, vertexArray, material, depth, worldMatrix, indexCount, renderingMode, section);
+	mCommands.back().indexType = indexType;
+}
+
+void RenderQueue::Clear()
+{
+	mCommands.clear();
+	mSortEntries.clear();
+}
+
+// LSD radix sort on 8 bit digits. Digits shared by every key are skipped, which is most of them for a typical frame.
+void RenderQueue::Sort()
+{
+	const size_t count = mSortEntries.size();
+	if (count < 2)
+		return;
+
+	mSortScratch.resize(count);
+	SortEntry* source = mSortEntries.data();
+	SortEntry* destination = mSortScratch.data();
+
+	for (int shift = 0; shift < 64; shift += 8)
+	{
+		size_t histogram[256] = { 0 };
+		for (size_t i = 0; i < count; i++)
+			histogram[(source[i].key >> shift) & 0xFF]++;
+
+		if (histogram[(source[0].key >> shift) & 0xFF] == count)
+			continue;
+
+		size_t offset = 0;
+		for (int digit = 0; digit < 256; digit++)
+		{
+			size_t digitCount = histogram[digit];
+			histogram[digit] = offset;
+			offset += digitCount;
+		}
+
+		for (size_t i = 0; i < count; i++)
+			destination[histogram[(source[i].key >> shift) & 0xFF]++] = source[i];
+
+		std::swap(source, destination);
+	}
+
+	if (source != mSortEntries.data())
+		mSortEntries.swap(mSortScratch);
+}
+
+void RenderQueue::InvalidateState()
+{
+	mCurrentProgram = UNKNOWN_STATE;
+	mCurrentVertexArray = UNKNOWN_STATE;
+	mCurrentTextureUnit = UNKNOWN_STATE;
+	for (int i = 0; i < MaxTextureUnits; i++)
+		mBoundTextures[i] = UNKNOWN_STATE;
+}
+
+void RenderQueue::Execute()
+{
+	ExecuteRange(0, mSortEntries.size());
+}
+
+void RenderQueue::Execute(EPass pass)
+{
+	// The pass is the top field of the key, so its draws are contiguous once sorted.
+	const int passShift = 64 - PASS_BITS;
+	size_t begin = 0;
+	while (begin < mSortEntries.size() && (mSortEntries[begin].key >> passShift) < (uint64_t)pass)
+		begin++;
+
+	size_t end = begin;
+	while (end < mSortEntries.size() && (mSortEntries[end].key >> passShift) == (uint64_t)pass)
+		end++;
+
+	ExecuteRange(begin, end);
+}
+
+void RenderQueue::ExecuteRange(size_t begin, size_t end)
+{
+	// Code outside the queue may have changed any binding since the last pass.
+	InvalidateState();
+	mMaterialDraws.resize(mMaterials.size(), 0);
+
+	int currentSection = -1;
+	for (size_t i = begin; i < end; i++)
+	{
+		const SortEntry& entry = mSortEntries[i];
+		const RenderCommand& command = mCommands[entry.command];
+		const RenderMaterial& material = mMaterials[command.material];
+
+		// Sections are contiguous in the pass, so each one is begun once.
+		if (command.section != currentSection)
+		{
+			if (command.section < 0)
+				mProfiler->End();
+			else
+				mProfiler->Begin(command.section);
+			currentSection = command.section;
+		}
+
+		// Program.
+		if (command.shaderProgram != mCurrentProgram)
+		{
+			glUseProgram(command.shaderProgram);
+			mCurrentProgram = command.shaderProgram;
+			mStatistics.programBinds++;
+		}
+		else
+		{
+			mStatistics.programBindsAvoided++;
+		}
+
+		// Vertex array.
+		if (command.vertexArray != mCurrentVertexArray)
+		{
+			glBindVertexArray(command.vertexArray);
+			mCurrentVertexArray = command.vertexArray;
+			mStatistics.vertexArrayBinds++;
+		}
+		else
+		{
+			mStatistics.vertexArrayBindsAvoided++;
+		}
+
+		// Textures.
+		for (int i = 0; i < material.textureCount; i++)
+		{
+			GLuint unit = material.textureUnits[i];
+			if (unit < MaxTextureUnits && mBoundTextures[unit] == material.textureIDs[i])
+			{
+				mStatistics.textureBindsAvoided++;
+				continue;
+			}
+
+			if (unit != mCurrentTextureUnit)
+			{
+				glActiveTexture(GL_TEXTURE0 + unit);
+				mCurrentTextureUnit = unit;
+			}
+			glBindTexture(GL_TEXTURE_2D, material.textureIDs[i]);
+			if (unit < MaxTextureUnits)
+				mBoundTextures[unit] = material.textureIDs[i];
+			mStatistics.textureBinds++;
+		}
+		if (mTextureManager && material.textureCount > 0)
+			mMaterialDraws[command.material]++;
+
+		// Draw.
+		glUniformMatrix4fv(command.worldMatrixLocation, 1, GL_FALSE, &command.worldMatrix[0][0]);
+		if (command.indexType != 0)
+			glDrawElements(command.renderingMode, command.vertexCount, command.indexType, (void*)0);
+		else
+			glDrawArrays(command.renderingMode, 0, command.vertexCount);
+		mStatistics.draws++;
+		if (command.renderingMode == GL_TRIANGLES)
+			mStatistics.triangles += command.vertexCount / 3;
+	}
+
+	if (currentSection >= 0)
+		mProfiler->End();
+
+	if (mTextureManager)
+	{
+		for (size_t material = 0; material < mMaterialDraws.size(); material++)
+		{
+			if (mMaterialDraws[material] == 0)
+				continue;
+			for (int i = 0; i < mMaterials[material].textureCount; i++)
+				mTextureManager->Touch(mMaterials[material].textureIDs[i], mMaterialDraws[material]);
+			mMaterialDraws[material] = 0;
+		}
+	}
+}
+
+void RenderQueue::PrintStatistics() const
+{
+	cout << "Render queue: " << mStatistics.draws << " draws, " << mStatistics.triangles << " triangles.\n";
+	cout << "  Program binds: " << mStatistics.programBinds << " (" << mStatistics.programBindsAvoided << " avoided).\n";
+	cout << "  Vertex array binds: " << mStatistics.vertexArrayBinds << " (" << mStatistics.vertexArrayBindsAvoided << " avoided).\n";
+	cout << "  Texture binds: " << mStatistics.textureBinds << " (" << mStatistics.textureBindsAvoided << " avoided).\n";
+}
@@ -0,0 +1,164 @@
+#include "ShadowCascades.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace glm;
+
+// The camera near plane is a millimeter away. Starting the logarithmic distribution there would spend a whole cascade on the first few centimeters.
+const float MINIMUM_SPLIT_NEAR = 1.0f;
+
+// Slice centers move in steps of this fraction of the slice radius. Larger steps keep the static layers cached longer
+// but every cascade grows by one step to still contain its slice, costing that much resolution.
+const float CENTER_STEP_FRACTION = 0.125f;
+
+ShadowCascades::ShadowCascades(int cascadeCount, unsigned int resolution)
+	: mCascadeCount(std::max(1, std::min(cascadeCount, (int)MaxCascades))), mResolution(resolution), mSplitLambda(0.75f), mTexture(0), mFramebuffer(0), mStaticLayerRenderCount(0)
+{
+	for (int i = 0; i < MaxCascades; i++)
+	{
+		mMatrices[i] = mat4(1.0f);
+		mSplitDistances[i] = 0.0f;
+		mLightPositions[i] = vec3(0.0f);
+		mStaticMatrices[i] = mat4(1.0f);
+		mStaticLayerValid[i] = false;
+	}
+
+	// A static and a dynamic layer per cascade.
+	glGenTextures(1, &mTexture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, mTexture);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, mResolution, mResolution, mCascadeCount * 2, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	// Depth only, the layer is attached when a cascade is bound.
+	glGenFramebuffers(1, &mFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, mTexture, 0, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+ShadowCascades::~ShadowCascades()
+{
+	glDeleteFramebuffers(1, &mFramebuffer);
+	glDeleteTextures(1, &mTexture);
+}
+
+void ShadowCascades::Update(const mat4& view, const mat4& projection, float shadowDistance, vec3 lightDirection, float casterDistance)
+{
+	// Recover the frustum shape from the perspective projection.
+	float tanHalfFovX = 1.0f / projection[0][0];
+	float tanHalfFovY = 1.0f / projection[1][1];
+	float cameraNear = projection[3][2] / (projection[2][2] - 1.0f);
+
+	float splitNear = std::max(cameraNear, MINIMUM_SPLIT_NEAR);
+	float splitFar = std::max(shadowDistance, splitNear + 1.0f);
+
+	// Practical split scheme (Zhang et al., "Parallel-Split Shadow Maps").
+	for (int i = 0; i < mCascadeCount; i++)
+	{
+		float fraction = (float)(i + 1) / mCascadeCount;
+		float logarithmicSplit = splitNear * pow(splitFar / splitNear, fraction);
+		float uniformSplit = splitNear + (splitFar - splitNear) * fraction;
+		mSplitDistances[i] = mix(uniformSplit, logarithmicSplit, mSplitLambda);
+	}
+
+	mat4 inverseView = inverse(view);
+	vec3 towardLight = normalize(lightDirection);
+	vec3 lightUp = abs(towardLight.y) > 0.99f ? vec3(0.0f, 0.0f, 1.0f) : vec3(0.0f, 1.0f, 0.0f);
+
+	// Orientation of the light, used to move the slice centers on a grid aligned with the shadow maps.
+	mat3 lightRotation = mat3(lookAt(vec3(0.0f), -towardLight, lightUp));
+	mat3 inverseLightRotation = transpose(lightRotation);
+
+	float sliceNear = cameraNear;
+	for (int i = 0; i < mCascadeCount; i++)
+	{
+		float sliceFar = mSplitDistances[i];
+
+		// View space corners of the slice, the camera looks down -z.
+		vec3 corners[8];
+		int corner = 0;
+		for (float depth : { sliceNear, sliceFar })
+		{
+			for (float y : { -1.0f, 1.0f })
+			{
+				for (float x : { -1.0f, 1.0f })
+					corners[corner++] = vec3(x * tanHalfFovX * depth, y * tanHalfFovY * depth, -depth);
+			}
+		}
+
+		// Fit a sphere rather than a box, its size does not change as the camera moves or rotates so the texel size stays constant.
+		// Measured in view space so the radius is exactly the same every frame.
+		vec3 viewCenter = vec3(0.0f);
+		for (int c = 0; c < 8; c++)
+			viewCenter += corners[c];
+		viewCenter /= 8.0f;
+
+		float radius = 0.0f;
+		for (int c = 0; c < 8; c++)
+			radius = std::max(radius, length(corners[c] - viewCenter));
+		radius = ceil(radius * 16.0f) / 16.0f;
+
+		// Snap the center to a grid in light space, and grow the cascade by one step so the slice still fits.
+		float centerStep = radius * CENTER_STEP_FRACTION;
+		vec3 center = vec3(inverseView * vec4(viewCenter, 1.0f));
+		vec3 lightSpaceCenter = round(lightRotation * center / centerStep) * centerStep;
+		center = inverseLightRotation * lightSpaceCenter;
+		radius += centerStep;
+
+		// Back the light camera up so casters between the slice and the light are captured too.
+		vec3 lightPosition = center + towardLight * (radius + casterDistance);
+		mat4 lightView = lookAt(lightPosition, center, lightUp);
+		mat4 lightProjection = ortho(-radius, radius, -radius, radius, 0.0f, 2.0f * radius + casterDistance);
+
+		// Snap the projection to whole texels: project the world origin and move it onto the nearest texel.
+		mat4 lightMatrix = lightProjection * lightView;
+		vec4 origin = lightMatrix * vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		vec2 originTexels = vec2(origin) * (mResolution * 0.5f);
+		vec2 snapOffset = (round(originTexels) - originTexels) / (mResolution * 0.5f);
+		lightProjection[3][0] += snapOffset.x;
+		lightProjection[3][1] += snapOffset.y;
+
+		mMatrices[i] = lightProjection * lightView;
+		mLightPositions[i] = lightPosition;
+
+		sliceNear = sliceFar;
+	}
+}
+
+void ShadowCascades::BindCascade(int cascade, ELayer layer) const
+{
+	int layerIndex = layer == StaticLayer ? cascade : mCascadeCount + cascade;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, mTexture, 0, layerIndex);
+	glViewport(0, 0, mResolution, mResolution);
+}
+
+bool ShadowCascades::IsStaticLayerStale(int cascade) const
+{
+	return !mStaticLayerValid[cascade] || mStaticMatrices[cascade] != mMatrices[cascade];
+}
+
+void ShadowCascades::MarkStaticLayerRendered(int cascade)
+{
+	mStaticMatrices[cascade] = mMatrices[cascade];
+	mStaticLayerValid[cascade] = true;
+	mStaticLayerRenderCount++;
+}
+
+void ShadowCascades::InvalidateStaticLayers()
+{
+	for (int i = 0; i < MaxCascades; i++)
+		mStaticLayerValid[i] = false;
+}
@@ -10,7 +10,7 @@
 #define GLEW_STATIC 1   // This allows linking with Static Library on Windows, without DLL
 #include <GL/glew.h>    // Include GLEW - OpenGL Extension Wrangler
 
-unsigned int SphereModel::SphereModelVAO(float radius, float heightOffset, int radialSubdivisions, int verticalSubdivisions, int& numOfVertices)
+std::vector<Model::TexturedColoredNormalVertex> SphereModel::SphereVertices(float radius, float heightOffset, int radialSubdivisions, int verticalSubdivisions)
 {
 	std::vector<TexturedColoredNormalVertex> texturedSphereVertexVector;
 
@@ -281,6 +281,13 @@ unsigned int SphereModel::SphereModelVAO(float radius, float heightOffset, int r
 		}
 	}
 
+	return texturedSphereVertexVector;
+}
+
+unsigned int SphereModel::SphereModelVAO(float radius, float heightOffset, int radialSubdivisions, int verticalSubdivisions, int& numOfVertices, unsigned int* shadowVAO, unsigned int* shadowVBO)
+{
+	std::vector<TexturedColoredNormalVertex> texturedSphereVertexVector = SphereVertices(radius, heightOffset, radialSubdivisions, verticalSubdivisions);
+
 	numOfVertices = texturedSphereVertexVector.size();
 
 	// Create a vertex array
@@ -332,6 +339,12 @@ unsigned int SphereModel::SphereModelVAO(float radius, float heightOffset, int r
 	);
 	glEnableVertexAttribArray(3);
 
+	if (shadowVAO)
+	{
+		*shadowVAO = PositionOnlyVAO(texturedSphereVertexVector.data(), (int)texturedSphereVertexVector.size(), shadowVBO);
+		glBindVertexArray(vertexArrayObject);
+	}
+
 	return vertexArrayObject;
 }
 
@@ -343,274 +356,7 @@ SphereModel::SphereModel(vec3 position, vec3 rotation, vec3 scale, mat4 parent)
 
 SphereModel::SphereModel(float radius, float heightOffset, int radialSubdivisions, int verticalSubdivisions) : Model()
 {
-	std::vector<TexturedColoredNormalVertex> texturedSphereVertexVector;
-
-	// Generate the vertices.
-	// I originally referenced the code from http://www.songho.ca/opengl/gl_sphere.html, then completely redid the triangle drawing bits.
-
-	const float PI = acos(-1);
-
-	float x, y, z; // Vertex position.
-	float u, v; // UV coordinate.
-	float nx, ny, nz, lengthInv = 1.0f / radius; // Normal, will also be used as vertex colour.
-
-	float radialStep = 2 * PI / radialSubdivisions;
-	float verticalStep = PI / verticalSubdivisions;
-	float radialAngle = 0.0f;
-	float verticalAngle = 0.0f;
-
-	// Sphere top cap.
-	for (int i = 0; i < radialSubdivisions; i++)
-	{
-		float angleFromTop = verticalStep;
-
-		// Summit
-		// Vertex positions.
-		x = 0;
-		y = radius + heightOffset;
-		z = 0;
-
-		// Normalized vertex normal.
-		nx = x * lengthInv;
-		ny = y * lengthInv;
-		nz = z * lengthInv;
-
-		// UV coordinates.
-		u = ((float)i / radialSubdivisions) + (1.0f / (2 * radialSubdivisions));
-		v = 0.0f;
-
-		TexturedColoredNormalVertex newVertex = TexturedColoredNormalVertex(vec3(x, y, z), vec3(nx, ny, nz), vec2(u, v), vec3(nx, ny, nz));
-		texturedSphereVertexVector.push_back(newVertex);
-
-		// Bottom right vertex.
-		// Vertex positions.
-		x = radius * cos(radialAngle + radialStep) * sin(angleFromTop);
-		y = radius * cos(angleFromTop) + heightOffset;
-		z = radius * sin(radialAngle + radialStep) * sin(angleFromTop);
-
-		// Normalized vertex normal.
-		nx = x * lengthInv;
-		ny = y * lengthInv;
-		nz = z * lengthInv;
-
-		// UV coordinates.
-		u = ((float)i + 1.0f) / radialSubdivisions;
-		v = 1.0f / verticalSubdivisions;
-
-		newVertex = TexturedColoredNormalVertex(vec3(x, y, z), vec3(nx, ny, nz), vec2(u, v), vec3(nx, ny, nz));
-		texturedSphereVertexVector.push_back(newVertex);
-
-		// Bottom left vertex.
-		// Vertex positions.
-		x = radius * cos(radialAngle) * sin(angleFromTop);
-		y = radius * cos(angleFromTop) + heightOffset;
-		z = radius * sin(radialAngle) * sin(angleFromTop);
-
-		// Normalized vertex normal.
-		nx = x * lengthInv;
-		ny = y * lengthInv;
-		nz = z * lengthInv;
-
-		// UV coordinates.
-		u = (float)i / radialSubdivisions;
-		v = 1.0f / verticalSubdivisions;
-
-		newVertex = TexturedColoredNormalVertex(vec3(x, y, z), vec3(nx, ny, nz), vec2(u, v), vec3(nx, ny, nz));
-		texturedSphereVertexVector.push_back(newVertex);
-
-
-		radialAngle += radialStep;
-	}
-
-	// Sphere bottom cap.
-	radialAngle = 0.0f;
-	for (int i = 0; i < radialSubdivisions; i++)
-	{
-		float angleFromBottom = PI - verticalStep;
-
-		// Summit
-		// Vertex positions.
-		x = 0;
-		y = -radius + heightOffset;
-		z = 0;
-
-		// Normalized vertex normal.
-		nx = x * lengthInv;
-		ny = y * lengthInv;
-		nz = z * lengthInv;
-
-		// UV coordinates.
-		u = ((float)i / radialSubdivisions) + (1.0f / (2 * radialSubdivisions));
-		v = 1.0f;
-
-		TexturedColoredNormalVertex newVertex = TexturedColoredNormalVertex(vec3(x, y, z), vec3(nx, ny, nz), vec2(u, v), vec3(nx, ny, nz));
-		texturedSphereVertexVector.push_back(newVertex);
-
-		// Top left vertex.
-		// Vertex positions.
-		x = radius * cos(radialAngle) * sin(angleFromBottom);
-		y = radius * cos(angleFromBottom) + heightOffset;
-		z = radius * sin(radialAngle) * sin(angleFromBottom);
-
-		// Normalized vertex normal.
-		nx = x * lengthInv;
-		ny = y * lengthInv;
-		nz = z * lengthInv;
-
-		// UV coordinates.
-		u = (float)i / radialSubdivisions;
-		v = 1.0f - (1.0f / verticalSubdivisions);
-
-		newVertex = TexturedColoredNormalVertex(vec3(x, y, z), vec3(nx, ny, nz), vec2(u, v), vec3(nx, ny, nz));
-		texturedSphereVertexVector.push_back(newVertex);
-
-		// Top right vertex.
-		// Vertex positions.
-		x = radius * cos(radialAngle + radialStep) * sin(angleFromBottom);
-		y = radius * cos(angleFromBottom) + heightOffset;
-		z = radius * sin(radialAngle + radialStep) * sin(angleFromBottom);
-
-		// Normalized vertex normal.
-		nx = x * lengthInv;
-		ny = y * lengthInv;
-		nz = z * lengthInv;
-
-		// UV coordinates.
-		u = ((float)i + 1.0f) / radialSubdivisions;
-		v = 1.0f - (1.0f / verticalSubdivisions);
-
-		newVertex = TexturedColoredNormalVertex(vec3(x, y, z), vec3(nx, ny, nz), vec2(u, v), vec3(nx, ny, nz));
-		texturedSphereVertexVector.push_back(newVertex);
-
-
-		radialAngle += radialStep;
-	}
-
-	// Sphere 'body'.
-	for (int i = 1; i < verticalSubdivisions - 1; i++) // Vertical subdivisions.
-	{
-		verticalAngle += verticalStep;
-		radialAngle = radians(0.0f);
-
-		for (int j = 0; j < radialSubdivisions; j++) // Radial subdivisions.
-		{
-			// Triangle 1.
-
-			// Bottom left.
-			// Vertex positions.
-			x = radius * cos(radialAngle) * sin(verticalAngle);
-			y = radius * cos(verticalAngle) + heightOffset;
-			z = radius * sin(radialAngle) * sin(verticalAngle);
-
-			// Normalized vertex normal.
-			nx = x * lengthInv;
-			ny = y * lengthInv;
-			nz = z * lengthInv;
-
-			// UV coordinates.
-			u = (float)j / radialSubdivisions;
-			v = (float)i / verticalSubdivisions;
-
-			TexturedColoredNormalVertex newVertex = TexturedColoredNormalVertex(vec3(x, y, z), vec3(nx, ny, nz), vec2(u, v), vec3(nx, ny, nz));
-			texturedSphereVertexVector.push_back(newVertex);
-
-			// Top right.
-			// Vertex positions.
-			x = radius * cos(radialAngle + radialStep) * sin(verticalAngle + verticalStep);
-			y = radius * cos(verticalAngle + verticalStep) + heightOffset;
-			z = radius * sin(radialAngle + radialStep) * sin(verticalAngle + verticalStep);
-
-			// Normalized vertex normal.
-			nx = x * lengthInv;
-			ny = y * lengthInv;
-			nz = z * lengthInv;
-
-			// UV coordinates.
-			u = (float)(j + 1) / radialSubdivisions;
-			v = (float)(i + 1) / verticalSubdivisions;
-
-			newVertex = TexturedColoredNormalVertex(vec3(x, y, z), vec3(nx, ny, nz), vec2(u, v), vec3(nx, ny, nz));
-			texturedSphereVertexVector.push_back(newVertex);
-
-			// Top left.
-			// Vertex positions.
-			x = radius * cos(radialAngle) * sin(verticalAngle + verticalStep);
-			y = radius * cos(verticalAngle + verticalStep) + heightOffset;
-			z = radius * sin(radialAngle) * sin(verticalAngle + verticalStep);
-
-			// Normalized vertex normal.
-			nx = x * lengthInv;
-			ny = y * lengthInv;
-			nz = z * lengthInv;
-
-			// UV coordinates.
-			u = (float)j / radialSubdivisions;
-			v = (float)(i + 1) / verticalSubdivisions;
-
-			newVertex = TexturedColoredNormalVertex(vec3(x, y, z), vec3(nx, ny, nz), vec2(u, v), vec3(nx, ny, nz));
-			texturedSphereVertexVector.push_back(newVertex);
-
-
-			// Triangle 2.
-
-			// Bottom left.
-			// Vertex positions.
-			x = radius * cos(radialAngle) * sin(verticalAngle);
-			y = radius * cos(verticalAngle) + heightOffset;
-			z = radius * sin(radialAngle) * sin(verticalAngle);
-
-			// Normalized vertex normal.
-			nx = x * lengthInv;
-			ny = y * lengthInv;
-			nz = z * lengthInv;
-
-			// UV coordinates.
-			u = (float)j / radialSubdivisions;
-			v = (float)i / verticalSubdivisions;
-
-			newVertex = TexturedColoredNormalVertex(vec3(x, y, z), vec3(nx, ny, nz), vec2(u, v), vec3(nx, ny, nz));
-			texturedSphereVertexVector.push_back(newVertex);
-
-			// Bottom right.
-			// Vertex positions.
-			x = radius * cos(radialAngle + radialStep) * sin(verticalAngle);
-			y = radius * cos(verticalAngle) + heightOffset;
-			z = radius * sin(radialAngle + radialStep) * sin(verticalAngle);
-
-			// Normalized vertex normal.
-			nx = x * lengthInv;
-			ny = y * lengthInv;
-			nz = z * lengthInv;
-
-			// UV coordinates.
-			u = (float)(j + 1) / radialSubdivisions;
-			v = (float)i / verticalSubdivisions;
-
-			newVertex = TexturedColoredNormalVertex(vec3(x, y, z), vec3(nx, ny, nz), vec2(u, v), vec3(nx, ny, nz));
-			texturedSphereVertexVector.push_back(newVertex);
-
-			// Top right.
-			// Vertex positions.
-			x = radius * cos(radialAngle + radialStep) * sin(verticalAngle + verticalStep);
-			y = radius * cos(verticalAngle + verticalStep) + heightOffset;
-			z = radius * sin(radialAngle + radialStep) * sin(verticalAngle + verticalStep);
-
-			// Normalized vertex normal.
-			nx = x * lengthInv;
-			ny = y * lengthInv;
-			nz = z * lengthInv;
-
-			// UV coordinates.
-			u = (float)(j + 1) / radialSubdivisions;
-			v = (float)(i + 1) / verticalSubdivisions;
-
-			newVertex = TexturedColoredNormalVertex(vec3(x, y, z), vec3(nx, ny, nz), vec2(u, v), vec3(nx, ny, nz));
-			texturedSphereVertexVector.push_back(newVertex);
-
-
-			radialAngle += radialStep;
-		}
-	}
+	std::vector<TexturedColoredNormalVertex> texturedSphereVertexVector = SphereVertices(radius, heightOffset, radialSubdivisions, verticalSubdivisions);
 
 	numOfVertices = texturedSphereVertexVector.size();
 
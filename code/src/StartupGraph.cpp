@@ -0,0 +1,193 @@
+#include "StartupGraph.h"
+#include "CpuProfiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+using namespace std;
+
+StartupGraph::StartupGraph(JobSystem* jobSystem) : mJobSystem(jobSystem), mWallMilliseconds(0.0), mFinishedCount(0) { }
+
+StartupGraph::TaskId StartupGraph::Add(const string& name, EThread thread, TaskFunction function, initializer_list<TaskId> dependencies)
+{
+	return Add(name, thread, function, vector<TaskId>(dependencies));
+}
+
+StartupGraph::TaskId StartupGraph::Add(const string& name, EThread thread, TaskFunction function, const vector<TaskId>& dependencies)
+{
+	TaskId id = (TaskId)mTasks.size();
+
+	Task task;
+	task.name = name;
+	task.profileName = CpuProfiler::Intern(name);
+	task.thread = thread;
+	task.function = function;
+	task.dependencies = dependencies;
+	task.remainingDependencies = (unsigned int)dependencies.size();
+	task.startMilliseconds = 0.0;
+	task.durationMilliseconds = 0.0;
+	task.threadIndex = 0;
+	mTasks.push_back(task);
+
+	for (TaskId dependency : dependencies)
+		mTasks[dependency].dependents.push_back(id);
+
+	return id;
+}
+
+void StartupGraph::Run()
+{
+	mStartTime = chrono::steady_clock::now();
+	mFinishedCount = 0;
+
+	vector<TaskId> readyTasks;
+	for (TaskId id = 0; id < mTasks.size(); id++)
+	{
+		if (mTasks[id].remainingDependencies == 0)
+			readyTasks.push_back(id);
+	}
+	Dispatch(readyTasks);
+
+	// Run context tasks as they become ready, until the last task of any kind is done.
+	while (true)
+	{
+		TaskId task;
+		{
+			unique_lock<mutex> lock(mMutex);
+			mCondition.wait(lock, [this]() { return !mContextQueue.empty() || mFinishedCount == mTasks.size(); });
+			if (mContextQueue.empty())
+				break;
+
+			task = mContextQueue.front();
+			mContextQueue.pop_front();
+		}
+
+		Execute(task);
+	}
+
+	mWallMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - mStartTime).count();
+}
+
+void StartupGraph::Execute(TaskId id)
+{
+	Task& task = mTasks[id];
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	if (task.function)
+	{
+		PROFILE_ZONE(task.profileName);
+		task.function();
+	}
+	chrono::steady_clock::time_point end = chrono::steady_clock::now();
+
+	task.startMilliseconds = chrono::duration<double, milli>(start - mStartTime).count();
+	task.durationMilliseconds = chrono::duration<double, milli>(end - start).count();
+	task.threadIndex = mJobSystem ? std::max(0, mJobSystem->GetCurrentThreadIndex()) : 0;
+
+	vector<TaskId> readyTasks;
+	{
+		lock_guard<mutex> lock(mMutex);
+		for (TaskId dependent : task.dependents)
+		{
+			if (--mTasks[dependent].remainingDependencies == 0)
+				readyTasks.push_back(dependent);
+		}
+	}
+	Dispatch(readyTasks);
+
+	// Counted last: once every task is, Run returns and the graph may go away.
+	lock_guard<mutex> lock(mMutex);
+	mFinishedCount++;
+	mCondition.notify_all();
+}
+
+void StartupGraph::Dispatch(const vector<TaskId>& readyTasks)
+{
+	bool hasWorkers = mJobSystem && mJobSystem->GetWorkerCount() > 0;
+
+	for (TaskId id : readyTasks)
+	{
+		if (mTasks[id].thread == WorkerThread && hasWorkers)
+		{
+			mJobSystem->Schedule([this, id]() { Execute(id); });
+		}
+		else
+		{
+			lock_guard<mutex> lock(mMutex);
+			mContextQueue.push_back(id);
+		}
+	}
+
+	mCondition.notify_all();
+}
+
+void StartupGraph::ComputeCriticalPaths(vector<double>& chainMilliseconds, vector<int>& previousTask) const
+{
+	// Dependencies always come first, so one pass in order is enough.
+	chainMilliseconds.assign(mTasks.size(), 0.0);
+	previousTask.assign(mTasks.size(), -1);
+	for (TaskId id = 0; id < mTasks.size(); id++)
+	{
+		double longestDependency = 0.0;
+		for (TaskId dependency : mTasks[id].dependencies)
+		{
+			if (chainMilliseconds[dependency] > longestDependency)
+			{
+				longestDependency = chainMilliseconds[dependency];
+				previousTask[id] = (int)dependency;
+			}
+		}
+		chainMilliseconds[id] = longestDependency + mTasks[id].durationMilliseconds;
+	}
+}
+
+double StartupGraph::GetCriticalPathMilliseconds() const
+{
+	vector<double> chainMilliseconds;
+	vector<int> previousTask;
+	ComputeCriticalPaths(chainMilliseconds, previousTask);
+
+	double longest = 0.0;
+	for (double milliseconds : chainMilliseconds)
+		longest = std::max(longest, milliseconds);
+	return longest;
+}
+
+void StartupGraph::PrintReport() const
+{
+	vector<TaskId> order;
+	double workMilliseconds = 0.0;
+	for (TaskId id = 0; id < mTasks.size(); id++)
+	{
+		order.push_back(id);
+		workMilliseconds += mTasks[id].durationMilliseconds;
+	}
+	sort(order.begin(), order.end(), [this](TaskId a, TaskId b) { return mTasks[a].startMilliseconds < mTasks[b].startMilliseconds; });
+
+	cout << "Startup tasks (start, duration, thread):\n";
+	for (TaskId id : order)
+	{
+		const Task& task = mTasks[id];
+		printf("  %8.2f ms %8.2f ms  %-8s %d  %s\n", task.startMilliseconds, task.durationMilliseconds,
+			task.thread == ContextThread ? "context" : "worker", task.threadIndex, task.name.c_str());
+	}
+
+	vector<double> chainMilliseconds;
+	vector<int> previousTask;
+	ComputeCriticalPaths(chainMilliseconds, previousTask);
+
+	int last = -1;
+	for (TaskId id = 0; id < mTasks.size(); id++)
+	{
+		if (last < 0 || chainMilliseconds[id] > chainMilliseconds[last])
+			last = (int)id;
+	}
+
+	string chain;
+	for (int id = last; id >= 0; id = previousTask[id])
+		chain = mTasks[id].name + (chain.empty() ? "" : " -> ") + chain;
+
+	printf("Startup took %.2f ms for %.2f ms of work. Longest chain %.2f ms: %s.\n", mWallMilliseconds, workMilliseconds,
+		last >= 0 ? chainMilliseconds[last] : 0.0, chain.c_str());
+}
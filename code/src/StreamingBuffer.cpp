@@ -0,0 +1,143 @@
+#include "StreamingBuffer.h"
+
+#include <iostream>
+
+using namespace std;
+
+// Mapping goes through the copy write target so that no array or uniform buffer binding is disturbed.
+const GLenum MAPPING_TARGET = GL_COPY_WRITE_BUFFER;
+
+StreamingBuffer::StreamingBuffer(GLsizeiptr frameSize, bool allowPersistentMapping)
+	: mBuffer(0), mFrameSize(frameSize), mFrame(0), mFrameOffset(0), mPersistentPointer(nullptr), mMapped(false), mStallCount(0), mOverflowCount(0)
+{
+	for (int i = 0; i < FrameCount; i++)
+		mFences[i] = 0;
+
+	GLsizeiptr totalSize = mFrameSize * FrameCount;
+
+	glGenBuffers(1, &mBuffer);
+	glBindBuffer(MAPPING_TARGET, mBuffer);
+
+	if (allowPersistentMapping && GLEW_ARB_buffer_storage)
+	{
+		// Coherent, so writes are visible to the GPU without explicit flushes.
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(MAPPING_TARGET, totalSize, nullptr, flags);
+		mPersistentPointer = (unsigned char*)glMapBufferRange(MAPPING_TARGET, 0, totalSize, flags);
+	}
+
+	if (!mPersistentPointer)
+	{
+		// Immutable storage cannot be reallocated, start over with a fresh buffer if persistent mapping failed.
+		if (allowPersistentMapping && GLEW_ARB_buffer_storage)
+		{
+			glDeleteBuffers(1, &mBuffer);
+			glGenBuffers(1, &mBuffer);
+			glBindBuffer(MAPPING_TARGET, mBuffer);
+		}
+		glBufferData(MAPPING_TARGET, totalSize, nullptr, GL_STREAM_DRAW);
+	}
+
+	glBindBuffer(MAPPING_TARGET, 0);
+}
+
+StreamingBuffer::~StreamingBuffer()
+{
+	for (int i = 0; i < FrameCount; i++)
+	{
+		if (mFences[i])
+			glDeleteSync(mFences[i]);
+	}
+
+	if (mPersistentPointer || mMapped)
+	{
+		glBindBuffer(MAPPING_TARGET, mBuffer);
+		glUnmapBuffer(MAPPING_TARGET);
+		glBindBuffer(MAPPING_TARGET, 0);
+	}
+
+	glDeleteBuffers(1, &mBuffer);
+}
+
+void StreamingBuffer::BeginFrame()
+{
+	mFrameOffset = 0;
+
+	GLsync fence = mFences[mFrame];
+	if (!fence)
+		return;
+
+	// Poll first, a wait is only a stall when the region is still in use.
+	GLenum result = glClientWaitSync(fence, 0, 0);
+	if (result == GL_TIMEOUT_EXPIRED)
+	{
+		mStallCount++;
+		do
+		{
+			result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		} while (result == GL_TIMEOUT_EXPIRED);
+	}
+
+	glDeleteSync(fence);
+	mFences[mFrame] = 0;
+}
+
+void StreamingBuffer::EndFrame()
+{
+	if (mMapped)
+		Unmap();
+
+	mFences[mFrame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	mFrame = (mFrame + 1) % FrameCount;
+}
+
+void* StreamingBuffer::Map(GLsizeiptr size, GLintptr& offset, GLsizeiptr alignment)
+{
+	if (mMapped)
+		Unmap();
+
+	GLintptr regionStart = mFrame * mFrameSize;
+	GLintptr start = regionStart + mFrameOffset;
+	if (alignment > 1)
+		start = (start + alignment - 1) / alignment * alignment;
+
+	if (size <= 0 || start + size > regionStart + mFrameSize)
+	{
+		mOverflowCount++;
+		return nullptr;
+	}
+
+	mFrameOffset = start + size - regionStart;
+	offset = start;
+
+	if (mPersistentPointer)
+		return mPersistentPointer + start;
+
+	// The fence guarantees the GPU is done with this range, so there is nothing to synchronize with.
+	glBindBuffer(MAPPING_TARGET, mBuffer);
+	void* pointer = glMapBufferRange(MAPPING_TARGET, start, size, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+	glBindBuffer(MAPPING_TARGET, 0);
+
+	mMapped = pointer != nullptr;
+	return pointer;
+}
+
+void StreamingBuffer::Unmap()
+{
+	if (!mMapped)
+		return;
+
+	glBindBuffer(MAPPING_TARGET, mBuffer);
+	glUnmapBuffer(MAPPING_TARGET);
+	glBindBuffer(MAPPING_TARGET, 0);
+	mMapped = false;
+}
+
+void StreamingBuffer::PrintStatistics() const
+{
+	cout << "Streaming buffer: " << (IsPersistent() ? "persistent" : "unsynchronized") << " mapping, "
+		<< FrameCount << " x " << mFrameSize << " bytes, "
+		<< mFrameOffset << " bytes used this frame, "
+		<< mStallCount << " stalls, "
+		<< mOverflowCount << " overflows\n";
+}
@@ -0,0 +1,471 @@
+#include "TextureContainer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+const char* const TextureContainer::Extension = ".mip";
+
+// The file is the header, the level table, then the levels from largest to smallest, each starting on a 16 byte boundary.
+struct FileHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t format;
+	uint32_t levelCount;
+};
+
+static const char FILE_MAGIC[4] = { 'M', 'I', 'P', 'C' };
+static const uint32_t FILE_VERSION = 1;
+static const uint64_t LEVEL_ALIGNMENT = 16;
+static const uint32_t MAX_LEVEL_COUNT = 32;
+
+static uint64_t alignOffset(uint64_t offset)
+{
+	return (offset + LEVEL_ALIGNMENT - 1) / LEVEL_ALIGNMENT * LEVEL_ALIGNMENT;
+}
+
+static bool isKnownFormat(uint32_t format)
+{
+	return format == TextureContainer::FormatR8 || format == TextureContainer::FormatRGB8 || format == TextureContainer::FormatRGBA8
+		|| format == TextureContainer::FormatBC1;
+}
+
+TextureContainer::TextureContainer() : mData(nullptr), mSize(0), mFormat(FormatRGBA8), mFileHandle(nullptr), mMappingHandle(nullptr) { }
+
+TextureContainer::~TextureContainer()
+{
+	Close();
+}
+
+bool TextureContainer::Open(const string& path)
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	HANDLE mapping = nullptr;
+	if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	mData = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!mData)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	mSize = (size_t)fileSize.QuadPart;
+	mFileHandle = file;
+	mMappingHandle = mapping;
+#else
+	int file = open(path.c_str(), O_RDONLY);
+	if (file < 0)
+		return false;
+
+	struct stat fileStatus;
+	if (fstat(file, &fileStatus) != 0 || fileStatus.st_size <= 0)
+	{
+		close(file);
+		return false;
+	}
+
+	void* mapping = mmap(nullptr, (size_t)fileStatus.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	// The mapping keeps the file alive on its own.
+	close(file);
+	if (mapping == MAP_FAILED)
+		return false;
+
+	mData = (const unsigned char*)mapping;
+	mSize = (size_t)fileStatus.st_size;
+#endif
+
+	// Check everything Get* hands out now, so a truncated or foreign file cannot be read past its end later.
+	bool valid = mSize >= sizeof(FileHeader);
+	FileHeader header;
+	if (valid)
+	{
+		memcpy(&header, mData, sizeof(header));
+		valid = memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) == 0 && header.version == FILE_VERSION && isKnownFormat(header.format)
+			&& header.levelCount > 0 && header.levelCount <= MAX_LEVEL_COUNT
+			&& mSize >= sizeof(FileHeader) + header.levelCount * sizeof(Level);
+	}
+
+	if (valid)
+	{
+		mFormat = (EFormat)header.format;
+		mLevels.resize(header.levelCount);
+		memcpy(mLevels.data(), mData + sizeof(FileHeader), header.levelCount * sizeof(Level));
+
+		for (unsigned int i = 0; i < mLevels.size() && valid; i++)
+		{
+			const Level& level = mLevels[i];
+			uint32_t expectedWidth = i == 0 ? level.width : std::max(1u, mLevels[i - 1].width / 2);
+			uint32_t expectedHeight = i == 0 ? level.height : std::max(1u, mLevels[i - 1].height / 2);
+			valid = level.width > 0 && level.height > 0 && level.width == expectedWidth && level.height == expectedHeight
+				&& level.size == GetLevelSize(mFormat, level.width, level.height)
+				&& level.offset <= mSize && level.size <= mSize - level.offset;
+		}
+	}
+
+	if (!valid)
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void TextureContainer::Close()
+{
+	if (mData)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(mData);
+		CloseHandle((HANDLE)mMappingHandle);
+		CloseHandle((HANDLE)mFileHandle);
+#else
+		munmap((void*)mData, mSize);
+#endif
+	}
+
+	mData = nullptr;
+	mSize = 0;
+	mFileHandle = nullptr;
+	mMappingHandle = nullptr;
+	mLevels.clear();
+}
+
+void TextureContainer::Prefetch() const
+{
+	const size_t pageSize = 4096;
+
+	// Volatile, so the reads are not optimized away.
+	volatile unsigned char sink = 0;
+	for (size_t offset = 0; offset < mSize; offset += pageSize)
+		sink = sink + mData[offset];
+}
+
+uint64_t TextureContainer::GetTotalSize() const
+{
+	uint64_t size = 0;
+	for (const Level& level : mLevels)
+		size += level.size;
+	return size;
+}
+
+bool TextureContainer::Write(const string& path, const unsigned char* pixels, int width, int height, int components, bool compress)
+{
+	if (!pixels || width <= 0 || height <= 0 || !isKnownFormat((uint32_t)components))
+		return false;
+
+	EFormat format = compress && components == 3 ? FormatBC1 : (EFormat)components;
+	unsigned int levelCount = GetMipLevelCount((uint32_t)width, (uint32_t)height);
+
+	// Every level is filtered from the uncompressed level above it, not from a compressed one.
+	vector<vector<unsigned char>> levelData(levelCount);
+	vector<Level> levels(levelCount);
+	vector<unsigned char> source(pixels, pixels + (size_t)width * height * components);
+	uint32_t levelWidth = (uint32_t)width;
+	uint32_t levelHeight = (uint32_t)height;
+	uint64_t offset = alignOffset(sizeof(FileHeader) + levelCount * sizeof(Level));
+	for (unsigned int i = 0; i < levelCount; i++)
+	{
+		if (format == FormatBC1)
+			CompressBC1(source.data(), levelWidth, levelHeight, levelData[i]);
+		else
+			levelData[i] = source;
+
+		levels[i].width = levelWidth;
+		levels[i].height = levelHeight;
+		levels[i].offset = offset;
+		levels[i].size = levelData[i].size();
+		offset = alignOffset(offset + levels[i].size);
+
+		if (i + 1 < levelCount)
+		{
+			vector<unsigned char> next;
+			Downsample(source.data(), levelWidth, levelHeight, components, next);
+			source.swap(next);
+			levelWidth = std::max(1u, levelWidth / 2);
+			levelHeight = std::max(1u, levelHeight / 2);
+		}
+	}
+
+	ofstream file(path, ios::binary | ios::trunc);
+	if (!file)
+		return false;
+
+	FileHeader header;
+	memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+	header.version = FILE_VERSION;
+	header.format = format;
+	header.levelCount = levelCount;
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)levels.data(), levels.size() * sizeof(Level));
+
+	const char padding[LEVEL_ALIGNMENT] = {};
+	uint64_t written = sizeof(header) + levels.size() * sizeof(Level);
+	for (unsigned int i = 0; i < levelCount; i++)
+	{
+		file.write(padding, levels[i].offset - written);
+		file.write((const char*)levelData[i].data(), levelData[i].size());
+		written = levels[i].offset + levels[i].size;
+	}
+
+	return (bool)file;
+}
+
+string TextureContainer::GetContainerPath(const string& imagePath)
+{
+	size_t extension = imagePath.find_last_of('.');
+	size_t directory = imagePath.find_last_of("/\\");
+	if (extension == string::npos || (directory != string::npos && extension < directory))
+		return imagePath + Extension;
+	return imagePath.substr(0, extension) + Extension;
+}
+
+unsigned int TextureContainer::GetMipLevelCount(uint32_t width, uint32_t height)
+{
+	unsigned int count = 1;
+	while (width > 1 || height > 1)
+	{
+		width = std::max(1u, width / 2);
+		height = std::max(1u, height / 2);
+		count++;
+	}
+	return count;
+}
+
+uint64_t TextureContainer::GetLevelSize(EFormat format, uint32_t width, uint32_t height)
+{
+	if (format == FormatBC1)
+		return (uint64_t)((width + 3) / 4) * ((height + 3) / 4) * 8;
+	return (uint64_t)width * height * format;
+}
+
+void TextureContainer::Downsample(const unsigned char* source, uint32_t width, uint32_t height, int components, vector<unsigned char>& destination)
+{
+	uint32_t destinationWidth = std::max(1u, width / 2);
+	uint32_t destinationHeight = std::max(1u, height / 2);
+	destination.resize((size_t)destinationWidth * destinationHeight * components);
+
+	// An odd last row or column is dropped, and a side already at 1 is averaged along the other only.
+	for (uint32_t y = 0; y < destinationHeight; y++)
+	{
+		uint32_t y0 = std::min(y * 2, height - 1);
+		uint32_t y1 = std::min(y * 2 + 1, height - 1);
+		for (uint32_t x = 0; x < destinationWidth; x++)
+		{
+			uint32_t x0 = std::min(x * 2, width - 1);
+			uint32_t x1 = std::min(x * 2 + 1, width - 1);
+			for (int c = 0; c < components; c++)
+			{
+				unsigned int sum = source[((size_t)y0 * width + x0) * components + c] + source[((size_t)y0 * width + x1) * components + c]
+					+ source[((size_t)y1 * width + x0) * components + c] + source[((size_t)y1 * width + x1) * components + c];
+				destination[((size_t)y * destinationWidth + x) * components + c] = (unsigned char)((sum + 2) / 4);
+			}
+		}
+	}
+}
+
+static uint16_t packRGB565(const float colour[3])
+{
+	int r = std::clamp((int)(colour[0] * 31.0f / 255.0f + 0.5f), 0, 31);
+	int g = std::clamp((int)(colour[1] * 63.0f / 255.0f + 0.5f), 0, 63);
+	int b = std::clamp((int)(colour[2] * 31.0f / 255.0f + 0.5f), 0, 31);
+	return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void unpackRGB565(uint16_t packed, int colour[3])
+{
+	int r = (packed >> 11) & 31;
+	int g = (packed >> 5) & 63;
+	int b = packed & 31;
+	colour[0] = (r << 3) | (r >> 2);
+	colour[1] = (g << 2) | (g >> 4);
+	colour[2] = (b << 3) | (b >> 2);
+}
+
+// The four colours a block can pick from. Without c0 > c1 the block is in its three colour and black mode.
+static void bc1Palette(uint16_t colour0, uint16_t colour1, int palette[4][3])
+{
+	unpackRGB565(colour0, palette[0]);
+	unpackRGB565(colour1, palette[1]);
+	for (int c = 0; c < 3; c++)
+	{
+		if (colour0 > colour1)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		else
+		{
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+}
+
+void TextureContainer::CompressBC1(const unsigned char* rgb, uint32_t width, uint32_t height, vector<unsigned char>& blocks)
+{
+	uint32_t blocksX = (width + 3) / 4;
+	uint32_t blocksY = (height + 3) / 4;
+	blocks.resize((size_t)blocksX * blocksY * 8);
+
+	for (uint32_t blockY = 0; blockY < blocksY; blockY++)
+	{
+		for (uint32_t blockX = 0; blockX < blocksX; blockX++)
+		{
+			// Blocks overhanging a small level repeat its edge texels.
+			float texels[16][3];
+			float mean[3] = { 0.0f, 0.0f, 0.0f };
+			for (int i = 0; i < 16; i++)
+			{
+				uint32_t x = std::min(blockX * 4 + i % 4, width - 1);
+				uint32_t y = std::min(blockY * 4 + i / 4, height - 1);
+				for (int c = 0; c < 3; c++)
+				{
+					texels[i][c] = rgb[((size_t)y * width + x) * 3 + c];
+					mean[c] += texels[i][c] / 16.0f;
+				}
+			}
+
+			// The endpoints are the texels furthest apart along the principal axis, found by power iteration on the covariance.
+			float covariance[3][3] = {};
+			for (int i = 0; i < 16; i++)
+			{
+				for (int a = 0; a < 3; a++)
+					for (int b = 0; b < 3; b++)
+						covariance[a][b] += (texels[i][a] - mean[a]) * (texels[i][b] - mean[b]);
+			}
+
+			float axis[3] = { 1.0f, 1.0f, 1.0f };
+			for (int iteration = 0; iteration < 8; iteration++)
+			{
+				float next[3];
+				for (int a = 0; a < 3; a++)
+					next[a] = covariance[a][0] * axis[0] + covariance[a][1] * axis[1] + covariance[a][2] * axis[2];
+				float length = std::max(std::max(fabsf(next[0]), fabsf(next[1])), fabsf(next[2]));
+				if (length <= 0.0f)
+					break;
+				for (int a = 0; a < 3; a++)
+					axis[a] = next[a] / length;
+			}
+
+			int minimum = 0;
+			int maximum = 0;
+			float minimumProjection = 0.0f;
+			float maximumProjection = 0.0f;
+			for (int i = 0; i < 16; i++)
+			{
+				float projection = texels[i][0] * axis[0] + texels[i][1] * axis[1] + texels[i][2] * axis[2];
+				if (i == 0 || projection < minimumProjection)
+				{
+					minimumProjection = projection;
+					minimum = i;
+				}
+				if (i == 0 || projection > maximumProjection)
+				{
+					maximumProjection = projection;
+					maximum = i;
+				}
+			}
+
+			// Keep the four colour mode: colour 0 must be the larger one.
+			uint16_t colour0 = packRGB565(texels[maximum]);
+			uint16_t colour1 = packRGB565(texels[minimum]);
+			if (colour0 < colour1)
+				std::swap(colour0, colour1);
+
+			uint32_t indices = 0;
+			if (colour0 != colour1)
+			{
+				int palette[4][3];
+				bc1Palette(colour0, colour1, palette);
+				for (int i = 0; i < 16; i++)
+				{
+					int best = 0;
+					float bestDistance = 0.0f;
+					for (int p = 0; p < 4; p++)
+					{
+						float distance = 0.0f;
+						for (int c = 0; c < 3; c++)
+							distance += (texels[i][c] - palette[p][c]) * (texels[i][c] - palette[p][c]);
+						if (p == 0 || distance < bestDistance)
+						{
+							bestDistance = distance;
+							best = p;
+						}
+					}
+					indices |= (uint32_t)best << (i * 2);
+				}
+			}
+
+			unsigned char* block = &blocks[((size_t)blockY * blocksX + blockX) * 8];
+			block[0] = (unsigned char)(colour0 & 0xff);
+			block[1] = (unsigned char)(colour0 >> 8);
+			block[2] = (unsigned char)(colour1 & 0xff);
+			block[3] = (unsigned char)(colour1 >> 8);
+			for (int i = 0; i < 4; i++)
+				block[4 + i] = (unsigned char)(indices >> (i * 8));
+		}
+	}
+}
+
+void TextureContainer::DecompressBC1(const unsigned char* blocks, uint32_t width, uint32_t height, vector<unsigned char>& rgb)
+{
+	uint32_t blocksX = (width + 3) / 4;
+	uint32_t blocksY = (height + 3) / 4;
+	rgb.resize((size_t)width * height * 3);
+
+	for (uint32_t blockY = 0; blockY < blocksY; blockY++)
+	{
+		for (uint32_t blockX = 0; blockX < blocksX; blockX++)
+		{
+			const unsigned char* block = &blocks[((size_t)blockY * blocksX + blockX) * 8];
+			uint16_t colour0 = (uint16_t)(block[0] | (block[1] << 8));
+			uint16_t colour1 = (uint16_t)(block[2] | (block[3] << 8));
+			uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24);
+
+			int palette[4][3];
+			bc1Palette(colour0, colour1, palette);
+
+			for (int i = 0; i < 16; i++)
+			{
+				uint32_t x = blockX * 4 + i % 4;
+				uint32_t y = blockY * 4 + i / 4;
+				if (x >= width || y >= height)
+					continue;
+
+				const int* colour = palette[(indices >> (i * 2)) & 3];
+				for (int c = 0; c < 3; c++)
+					rgb[((size_t)y * width + x) * 3 + c] = (unsigned char)colour[c];
+			}
+		}
+	}
+}
@@ -0,0 +1,649 @@
+#include "TextureManager.h"
+#include "CpuProfiler.h"
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <tuple>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+// Weight of a frame in the running average of the draws made with a texture, about the last 30 frames.
+static const float DRAW_AVERAGE_WEIGHT = 1.0f / 30.0f;
+
+// Client format and GPU bytes per texel of an uncompressed internal format. Drivers store RGB8 padded to four bytes.
+static void describeInternalFormat(GLint internalFormat, GLenum& format, int& components, int& bytesPerTexel)
+{
+	if (internalFormat == GL_RED || internalFormat == GL_R8)
+	{
+		format = GL_RED;
+		components = 1;
+		bytesPerTexel = 1;
+	}
+	else if (internalFormat == GL_RGB || internalFormat == GL_RGB8)
+	{
+		format = GL_RGB;
+		components = 3;
+		bytesPerTexel = 4;
+	}
+	else
+	{
+		format = GL_RGBA;
+		components = 4;
+		bytesPerTexel = 4;
+	}
+}
+
+static void setTextureParameters(bool hasAlpha, unsigned int levelCount)
+{
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, hasAlpha ? GL_CLAMP_TO_EDGE : GL_REPEAT); // for this tutorial: use GL_CLAMP_TO_EDGE to prevent semi-transparent borders. Due to interpolation it takes texels from next repeat
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, hasAlpha ? GL_CLAMP_TO_EDGE : GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+}
+
+// Upload one level of the bound texture. Rows may not be a multiple of 4 bytes, the unpack alignment must be 1.
+static void uploadLevel(GLint level, TextureContainer::EFormat format, uint32_t width, uint32_t height, const unsigned char* data, uint64_t size,
+	vector<unsigned char>& decompressed)
+{
+	if (format == TextureContainer::FormatBC1 && GLEW_EXT_texture_compression_s3tc)
+	{
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, width, height, 0, (GLsizei)size, data);
+	}
+	else if (format == TextureContainer::FormatBC1)
+	{
+		// No S3TC in the driver, decompress on the CPU.
+		TextureContainer::DecompressBC1(data, width, height, decompressed);
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, decompressed.data());
+	}
+	else
+	{
+		GLenum glFormat = format == TextureContainer::FormatR8 ? GL_RED : format == TextureContainer::FormatRGB8 ? GL_RGB : GL_RGBA;
+		glTexImage2D(GL_TEXTURE_2D, level, glFormat, width, height, 0, glFormat, GL_UNSIGNED_BYTE, data);
+	}
+}
+
+// Upload every level of a container straight from the mapping into the bound texture.
+static void uploadContainer(const TextureContainer& container)
+{
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	vector<unsigned char> decompressed;
+	for (unsigned int level = 0; level < container.GetLevelCount(); level++)
+	{
+		const TextureContainer::Level& levelInfo = container.GetLevel(level);
+		uploadLevel(level, container.GetFormat(), levelInfo.width, levelInfo.height, container.GetLevelData(level), levelInfo.size, decompressed);
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+static GLuint createPlaceholder(const vec4& colour)
+{
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+
+	unsigned char texel[4];
+	for (int c = 0; c < 4; c++)
+		texel[c] = (unsigned char)(glm::clamp(colour[c], 0.0f, 1.0f) * 255.0f + 0.5f);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+
+	setTextureParameters(false, 1);
+	return texture;
+}
+
+TextureManager::TextureManager(uint64_t budgetBytes, JobSystem* jobSystem)
+	: mBudgetBytes(budgetBytes), mResidentBytes(0), mFrame(0), mJobSystem(jobSystem), mUploadBytesPerFrame(1 << 20), mUploadMillisecondsPerFrame(2.0),
+	mStreamingCount(0), mDuplicateLoads(0), mLevelsDropped(0), mLevelsStreamed(0), mBytesStreamed(0), mBudgetWarningShown(false) { }
+
+TextureManager::~TextureManager()
+{
+	// Jobs still decoding hold on to their streams.
+	if (mJobSystem)
+		mJobSystem->Wait(mStreamJobs);
+
+	for (const vector<StreamingTexture*>* streams : { &mPendingStreams, &mDecodedStreams, &mActiveStreams })
+	{
+		for (StreamingTexture* stream : *streams)
+		{
+			Free(stream->decoded);
+			delete stream;
+		}
+	}
+
+	for (const auto& entry : mEntries)
+		glDeleteTextures(1, &entry.first);
+}
+
+TextureManager::DecodedTexture TextureManager::Decode(const string& path)
+{
+	DecodedTexture decoded;
+	decoded.path = path;
+
+	decoded.container = new TextureContainer();
+	if (decoded.container->Open(TextureContainer::GetContainerPath(path)))
+	{
+		decoded.container->Prefetch();
+		return decoded;
+	}
+	delete decoded.container;
+	decoded.container = nullptr;
+
+	decoded.data = stbi_load(path.c_str(), &decoded.width, &decoded.height, &decoded.components, 0);
+	return decoded;
+}
+
+void TextureManager::Free(DecodedTexture& decoded)
+{
+	if (decoded.data)
+		stbi_image_free(decoded.data);
+	delete decoded.container;
+	decoded.data = nullptr;
+	decoded.container = nullptr;
+}
+
+GLuint TextureManager::Upload(DecodedTexture& decoded, const vec4& placeholder)
+{
+	auto existing = mTexturesByPath.find(decoded.path);
+	if (existing != mTexturesByPath.end())
+	{
+		Free(decoded);
+		mEntries[existing->second].references++;
+		mDuplicateLoads++;
+		return existing->second;
+	}
+
+	Entry entry;
+	entry.path = decoded.path;
+	entry.references = 1;
+	entry.baseLevel = 0;
+	entry.droppedLevels = 0;
+	entry.lastUsedFrame = mFrame;
+	entry.frameDraws = 0;
+	entry.averageDraws = 0.0f;
+	entry.stream = nullptr;
+
+	GLuint texture = CreateTexture(decoded, placeholder, entry.placeholder);
+	Free(decoded);
+
+	GLint maxLevel = 0;
+	glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+	entry.levelCount = (unsigned int)maxLevel + 1;
+	entry.bytes = MeasureBytes(0, entry.levelCount);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	mResidentBytes += entry.bytes;
+	mTexturesByPath[entry.path] = texture;
+	mEntries[texture] = entry;
+	return texture;
+}
+
+GLuint TextureManager::Acquire(const string& path, const vec4& placeholder)
+{
+	auto existing = mTexturesByPath.find(path);
+	if (existing != mTexturesByPath.end())
+	{
+		mEntries[existing->second].references++;
+		mDuplicateLoads++;
+		return existing->second;
+	}
+
+	DecodedTexture decoded = Decode(path);
+	return Upload(decoded, placeholder);
+}
+
+GLuint TextureManager::Stream(const string& path, const vec4& placeholder)
+{
+	auto existing = mTexturesByPath.find(path);
+	if (existing != mTexturesByPath.end())
+	{
+		mEntries[existing->second].references++;
+		mDuplicateLoads++;
+		return existing->second;
+	}
+
+	GLuint texture = createPlaceholder(placeholder);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	StreamingTexture* stream = new StreamingTexture();
+	stream->texture = texture;
+	stream->path = path;
+	stream->format = TextureContainer::FormatRGBA8;
+	stream->nextLevel = -1;
+	stream->cancelled = false;
+
+	Entry entry;
+	entry.path = path;
+	entry.references = 1;
+	entry.bytes = 4;
+	entry.baseLevel = 0;
+	entry.levelCount = 1;
+	entry.droppedLevels = 0;
+	entry.lastUsedFrame = mFrame;
+	entry.frameDraws = 0;
+	entry.averageDraws = 0.0f;
+	entry.placeholder = false;
+	entry.stream = stream;
+
+	mResidentBytes += entry.bytes;
+	mTexturesByPath[path] = texture;
+	mEntries[texture] = entry;
+	mStreamingCount++;
+
+	if (mJobSystem && mJobSystem->GetWorkerCount() > 0)
+	{
+		mStreamJobs.push_back(mJobSystem->Schedule([this, stream]()
+			{
+				PrepareStream(stream);
+				lock_guard<mutex> lock(mStreamMutex);
+				mDecodedStreams.push_back(stream);
+			}));
+	}
+	else
+	{
+		mPendingStreams.push_back(stream);
+	}
+
+	return texture;
+}
+
+void TextureManager::Release(GLuint texture)
+{
+	auto entry = mEntries.find(texture);
+	if (entry == mEntries.end())
+		return;
+
+	if (--entry->second.references > 0)
+		return;
+
+	// A stream still decoding is thrown away once it is handed back.
+	if (entry->second.stream)
+		entry->second.stream->cancelled = true;
+
+	glDeleteTextures(1, &texture);
+	mResidentBytes -= entry->second.bytes;
+	mTexturesByPath.erase(entry->second.path);
+	mEntries.erase(entry);
+}
+
+void TextureManager::Touch(GLuint texture, unsigned int drawCount)
+{
+	auto entry = mEntries.find(texture);
+	if (entry != mEntries.end())
+	{
+		entry->second.lastUsedFrame = mFrame;
+		entry->second.frameDraws += drawCount;
+	}
+}
+
+void TextureManager::Update()
+{
+	PROFILE_ZONE("TextureManager::Update");
+	mFrame++;
+
+	for (auto& entry : mEntries)
+	{
+		entry.second.averageDraws += (entry.second.frameDraws - entry.second.averageDraws) * DRAW_AVERAGE_WEIGHT;
+		entry.second.frameDraws = 0;
+	}
+
+	if (mStreamingCount > 0)
+		UpdateStreams();
+
+	if (mBudgetBytes == 0 || mResidentBytes <= mBudgetBytes)
+		return;
+
+	// Textures out of use first, least recently used first, then those in use, least drawn first: most textures are drawn
+	// with every frame, so their last use alone would only order them by when they were bound.
+	// Each texture is shrunk as far as it goes before the next one is touched. Textures still streaming in are left alone.
+	vector<tuple<bool, double, GLuint>> candidates;
+	for (const auto& entry : mEntries)
+	{
+		if (entry.second.stream)
+			continue;
+		bool inUse = entry.second.lastUsedFrame + RecentFrames >= mFrame;
+		candidates.push_back(make_tuple(inUse, inUse ? (double)entry.second.averageDraws : (double)entry.second.lastUsedFrame, entry.first));
+	}
+	sort(candidates.begin(), candidates.end());
+
+	glActiveTexture(GL_TEXTURE0);
+	for (size_t i = 0; i < candidates.size() && mResidentBytes > mBudgetBytes; i++)
+	{
+		GLuint texture = get<2>(candidates[i]);
+		Entry& entry = mEntries[texture];
+		glBindTexture(GL_TEXTURE_2D, texture);
+		while (mResidentBytes > mBudgetBytes && DropTopLevel(entry))
+			mLevelsDropped++;
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if (mResidentBytes > mBudgetBytes && !mBudgetWarningShown)
+	{
+		cout << "Textures still use " << mResidentBytes / (1024 * 1024) << " MiB with every texture at its smallest size, over the "
+			<< mBudgetBytes / (1024 * 1024) << " MiB budget.\n";
+		mBudgetWarningShown = true;
+	}
+}
+
+void TextureManager::SetBudget(uint64_t budgetBytes)
+{
+	mBudgetBytes = budgetBytes;
+	mBudgetWarningShown = false;
+}
+
+void TextureManager::SetUploadBudget(uint64_t bytesPerFrame, double millisecondsPerFrame)
+{
+	mUploadBytesPerFrame = bytesPerFrame;
+	mUploadMillisecondsPerFrame = millisecondsPerFrame;
+}
+
+void TextureManager::PrintStatistics() const
+{
+	unsigned int placeholders = 0;
+	unsigned int shrunk = 0;
+	for (const auto& entry : mEntries)
+	{
+		if (entry.second.placeholder)
+			placeholders++;
+		if (entry.second.droppedLevels > 0)
+			shrunk++;
+	}
+
+	cout << "Textures: " << mEntries.size() << " (" << placeholders << " placeholders for missing files), " << mResidentBytes / 1024 << " KiB on the GPU, budget ";
+	if (mBudgetBytes > 0)
+		cout << mBudgetBytes / 1024 << " KiB";
+	else
+		cout << "none";
+	cout << ", " << mDuplicateLoads << " loads deduplicated, " << mLevelsDropped << " mip levels dropped from " << shrunk << " textures.\n";
+	cout << "  Streaming: " << mStreamingCount << " textures still loading, " << mLevelsStreamed << " levels (" << mBytesStreamed / 1024 << " KiB) uploaded, budget "
+		<< mUploadBytesPerFrame / 1024 << " KiB and " << mUploadMillisecondsPerFrame << " ms per frame.\n";
+}
+
+GLuint TextureManager::CreateTexture(DecodedTexture& decoded, const vec4& placeholder, bool& isPlaceholder)
+{
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	isPlaceholder = false;
+
+	if (decoded.container)
+	{
+		uploadContainer(*decoded.container);
+		setTextureParameters(decoded.container->GetFormat() == TextureContainer::FormatRGBA8, decoded.container->GetLevelCount());
+	}
+	else if (decoded.data && decoded.components != 2)
+	{
+		GLenum format = decoded.components == 1 ? GL_RED : decoded.components == 3 ? GL_RGB : GL_RGBA;
+
+		glTexImage2D(GL_TEXTURE_2D, 0, format, decoded.width, decoded.height, 0, format, GL_UNSIGNED_BYTE, decoded.data);
+		glGenerateMipmap(GL_TEXTURE_2D);
+
+		setTextureParameters(format == GL_RGBA, TextureContainer::GetMipLevelCount(decoded.width, decoded.height));
+	}
+	else
+	{
+		std::cout << "Texture failed to load at path: " << decoded.path << ", using a placeholder." << std::endl;
+
+		glDeleteTextures(1, &texture);
+		texture = createPlaceholder(placeholder);
+		isPlaceholder = true;
+	}
+
+	return texture;
+}
+
+bool TextureManager::DropTopLevel(Entry& entry)
+{
+	if (entry.levelCount <= 1 || entry.baseLevel != 0)
+		return false;
+
+	GLint width = 0;
+	GLint height = 0;
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 1, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 1, GL_TEXTURE_HEIGHT, &height);
+	if (std::max(width, height) < MinimumDroppedSize)
+		return false;
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	// Each level is read before the level above it is redefined with its contents.
+	vector<unsigned char> pixels;
+	for (unsigned int level = 1; level < entry.levelCount; level++)
+	{
+		GLint internalFormat = 0;
+		GLint compressed = GL_FALSE;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED, &compressed);
+
+		if (compressed)
+		{
+			GLint size = 0;
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+			pixels.resize(size);
+			glGetCompressedTexImage(GL_TEXTURE_2D, level, pixels.data());
+			glCompressedTexImage2D(GL_TEXTURE_2D, level - 1, internalFormat, width, height, 0, size, pixels.data());
+		}
+		else
+		{
+			GLenum format;
+			int components, bytesPerTexel;
+			describeInternalFormat(internalFormat, format, components, bytesPerTexel);
+			pixels.resize((size_t)width * height * components);
+			glGetTexImage(GL_TEXTURE_2D, level, format, GL_UNSIGNED_BYTE, pixels.data());
+			glTexImage2D(GL_TEXTURE_2D, level - 1, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, pixels.data());
+		}
+	}
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	// The old last level is left defined but out of range, it is a single texel.
+	entry.levelCount--;
+	entry.droppedLevels++;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, entry.levelCount - 1);
+
+	uint64_t bytes = MeasureBytes(0, entry.levelCount);
+	mResidentBytes = mResidentBytes - entry.bytes + bytes;
+	entry.bytes = bytes;
+	return true;
+}
+
+uint64_t TextureManager::MeasureBytes(unsigned int baseLevel, unsigned int levelCount)
+{
+	uint64_t bytes = 0;
+	for (unsigned int level = baseLevel; level < baseLevel + levelCount; level++)
+	{
+		GLint compressed = GL_FALSE;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED, &compressed);
+		if (compressed)
+		{
+			GLint size = 0;
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+			bytes += size;
+			continue;
+		}
+
+		GLint width = 0;
+		GLint height = 0;
+		GLint internalFormat = 0;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+
+		GLenum format;
+		int components, bytesPerTexel;
+		describeInternalFormat(internalFormat, format, components, bytesPerTexel);
+		bytes += (uint64_t)width * height * bytesPerTexel;
+	}
+	return bytes;
+}
+
+void TextureManager::PrepareStream(StreamingTexture* stream)
+{
+	stream->decoded = Decode(stream->path);
+	DecodedTexture& decoded = stream->decoded;
+
+	if (decoded.container)
+	{
+		stream->format = decoded.container->GetFormat();
+		for (unsigned int level = 0; level < decoded.container->GetLevelCount(); level++)
+		{
+			const TextureContainer::Level& levelInfo = decoded.container->GetLevel(level);
+			stream->levels.push_back({ levelInfo.width, levelInfo.height, decoded.container->GetLevelData(level), levelInfo.size });
+		}
+	}
+	else if (decoded.data && decoded.components != 2)
+	{
+		// Filter the mip chain here rather than with glGenerateMipmap, which needs the top level uploaded first.
+		stream->format = (TextureContainer::EFormat)decoded.components;
+		unsigned int levelCount = TextureContainer::GetMipLevelCount(decoded.width, decoded.height);
+		stream->mips.resize(levelCount - 1);
+
+		uint32_t width = (uint32_t)decoded.width;
+		uint32_t height = (uint32_t)decoded.height;
+		const unsigned char* data = decoded.data;
+		for (unsigned int level = 0; level < levelCount; level++)
+		{
+			stream->levels.push_back({ width, height, data, (uint64_t)width * height * decoded.components });
+			if (level + 1 < levelCount)
+			{
+				TextureContainer::Downsample(data, width, height, decoded.components, stream->mips[level]);
+				data = stream->mips[level].data();
+				width = std::max(1u, width / 2);
+				height = std::max(1u, height / 2);
+			}
+		}
+	}
+
+	stream->nextLevel = (int)stream->levels.size() - 1;
+}
+
+void TextureManager::UpdateStreams()
+{
+	{
+		lock_guard<mutex> lock(mStreamMutex);
+		mActiveStreams.insert(mActiveStreams.end(), mDecodedStreams.begin(), mDecodedStreams.end());
+		mDecodedStreams.clear();
+	}
+
+	mStreamJobs.erase(remove_if(mStreamJobs.begin(), mStreamJobs.end(), [this](const JobSystem::JobHandle& job) { return mJobSystem->IsFinished(job); }),
+		mStreamJobs.end());
+
+	// Without workers, decode one texture per frame here.
+	if (!mPendingStreams.empty())
+	{
+		StreamingTexture* stream = mPendingStreams.front();
+		mPendingStreams.erase(mPendingStreams.begin());
+		if (!stream->cancelled)
+			PrepareStream(stream);
+		mActiveStreams.push_back(stream);
+	}
+
+	for (size_t i = 0; i < mActiveStreams.size();)
+	{
+		if (!mActiveStreams[i]->cancelled)
+		{
+			i++;
+			continue;
+		}
+
+		Free(mActiveStreams[i]->decoded);
+		delete mActiveStreams[i];
+		mActiveStreams.erase(mActiveStreams.begin() + i);
+		mStreamingCount--;
+	}
+
+	// Smallest pending level first over every stream, so all textures sharpen at the same pace.
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	uint64_t bytes = 0;
+	unsigned int uploads = 0;
+	glActiveTexture(GL_TEXTURE0);
+	while (!mActiveStreams.empty())
+	{
+		size_t next = 0;
+		for (size_t i = 1; i < mActiveStreams.size(); i++)
+		{
+			const StreamingTexture* stream = mActiveStreams[i];
+			const StreamingTexture* best = mActiveStreams[next];
+			uint64_t size = stream->nextLevel >= 0 ? stream->levels[stream->nextLevel].size : 0;
+			uint64_t bestSize = best->nextLevel >= 0 ? best->levels[best->nextLevel].size : 0;
+			if (size < bestSize)
+				next = i;
+		}
+
+		StreamingTexture* stream = mActiveStreams[next];
+		uint64_t size = stream->nextLevel >= 0 ? stream->levels[stream->nextLevel].size : 0;
+		double milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		if (uploads > 0 && (bytes + size > mUploadBytesPerFrame || milliseconds >= mUploadMillisecondsPerFrame))
+			break;
+
+		bytes += size;
+		uploads++;
+		if (UploadNextLevel(stream))
+		{
+			FinishStream(stream);
+			mActiveStreams.erase(mActiveStreams.begin() + next);
+		}
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+bool TextureManager::UploadNextLevel(StreamingTexture* stream)
+{
+	if (stream->nextLevel < 0)
+		return true;
+
+	Entry& entry = mEntries[stream->texture];
+	unsigned int levelCount = (unsigned int)stream->levels.size();
+	unsigned int level = (unsigned int)stream->nextLevel;
+	const StreamLevel& levelData = stream->levels[level];
+
+	glBindTexture(GL_TEXTURE_2D, stream->texture);
+
+	// The first level in replaces the placeholder: from then on the texture has its real parameters.
+	if (level == levelCount - 1)
+		setTextureParameters(stream->format == TextureContainer::FormatRGBA8, levelCount);
+
+	vector<unsigned char> decompressed;
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	uploadLevel(level, stream->format, levelData.width, levelData.height, levelData.data, levelData.size, decompressed);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	// Sampling starts at the largest level uploaded so far, the levels below it are never touched.
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+
+	uint64_t bytes = MeasureBytes(level, levelCount - level);
+	mResidentBytes = mResidentBytes - entry.bytes + bytes;
+	entry.bytes = bytes;
+	entry.baseLevel = level;
+	entry.levelCount = levelCount - level;
+
+	mLevelsStreamed++;
+	mBytesStreamed += levelData.size;
+	stream->nextLevel--;
+	return stream->nextLevel < 0;
+}
+
+void TextureManager::FinishStream(StreamingTexture* stream)
+{
+	Entry& entry = mEntries[stream->texture];
+	if (stream->levels.empty())
+	{
+		std::cout << "Texture failed to load at path: " << stream->path << ", using a placeholder." << std::endl;
+		entry.placeholder = true;
+	}
+	entry.stream = nullptr;
+
+	Free(stream->decoded);
+	delete stream;
+	mStreamingCount--;
+}
@@ -15,6 +15,10 @@
 #include <vector>
 #include <random>
 #include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <cfloat>
 
 #define GLEW_STATIC 1   // This allows linking with Static Library on Windows, without DLL
 #include <GL/glew.h>    // Include GLEW - OpenGL Extension Wrangler
@@ -40,6 +44,21 @@
 #include "PlaneModel.h"
 #include "GroundModel.h"
 #include "SphereModel.h"
+#include "RenderQueue.h"
+#include "MeshCache.h"
+#include "LodSelector.h"
+#include "Culling.h"
+#include "JobSystem.h"
+#include "StreamingBuffer.h"
+#include "ShadowCascades.h"
+#include "GpuProfiler.h"
+#include "CpuProfiler.h"
+#include "CameraPath.h"
+#include "OcclusionCulling.h"
+#include "StartupGraph.h"
+#include "TextureManager.h"
+#include "OffscreenTarget.h"
+#include "ImpostorAtlas.h"
 
 #define VECTOR_UP vec3(0.0f, 1.0f, 0.0f)
 
@@ -47,80 +66,6 @@ using namespace std;
 using namespace glm;
 
 
-GLuint loadTexture(const string filename)
-{
-	//// Create and bind textures¸.
-	//GLuint textureId = 0;
-	//glGenTextures(1, &textureId);
-	//assert(textureId != 0);
-
-	//glBindTexture(GL_TEXTURE_2D, textureId);
-
-	//// Set filter parameters.
-	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	//// Load texture with its dimensional data.
-	//int width, height, nrChannels;
-	//unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrChannels, 0);
-	//if (!data)
-	//{
-	//	std::cerr << "Error::Texture could not load texture file:" << filename << std::endl;
-	//	return 0;
-	//}
-
-	//// Upload the texture to the PU.
-	//GLenum format = 0;
-	//if (nrChannels == 1)
-	//	format = GL_RED;
-	//else if (nrChannels == 3)
-	//	format = GL_RGB;
-	//else if (nrChannels == 4)
-	//	format = GL_RGBA;
-	//glTexImage2D(GL_TEXTURE_2D, 0, format, width, height,
-	//	0, format, GL_UNSIGNED_BYTE, data);
-
-	//// Clean up.
-	//stbi_image_free(data);
-	//glBindTexture(GL_TEXTURE_2D, 0);
-	//return textureId;
-
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-
-	int width, height, nrComponents;
-	unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-	if (data)
-	{
-		GLenum format;
-		if (nrComponents == 1)
-			format = GL_RED;
-		else if (nrComponents == 3)
-			format = GL_RGB;
-		else if (nrComponents == 4)
-			format = GL_RGBA;
-
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT); // for this tutorial: use GL_CLAMP_TO_EDGE to prevent semi-transparent borders. Due to interpolation it takes texels from next repeat 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		stbi_image_free(data);
-	}
-	else
-	{
-		std::cout << "Texture failed to load at path: " << filename << std::endl;
-		stbi_image_free(data);
-	}
-
-	return textureID;
-}
-
-
 enum ECameraType
 {
 	FirstPerson,
@@ -128,14 +73,58 @@ enum ECameraType
 	Static
 };
 
+// Which objects renderScene draws. Shadows cache the static ones and redraw the dynamic ones every frame.
+enum ERenderSubset
+{
+	RenderAll,
+	RenderStatic,
+	RenderDynamic
+};
+
 // Shaders.
 GLuint colourShaderProgram;
 GLuint texturedShaderProgram;
 GLuint groundShaderProgram;
 GLuint shadowShaderProgram;
+GLuint depthShaderProgram;
+// The skybox and the moon are never shadowed and have no normal map.
+GLuint skyShaderProgram;
+// Distant trees: baking their pictures and drawing them. Their shadows are cast by the full trees.
+GLuint impostorBakeShaderProgram;
+GLuint impostorShaderProgram;
+
+// Shader quality levels, each one a permutation of the textured and ground programs.
+// Lower levels sample the shadow map once, then drop shadows and normal maps altogether.
+enum EShaderQuality
+{
+	ShaderQualityHigh,
+	ShaderQualityMedium,
+	ShaderQualityLow,
+	ShaderQualityCount
+};
+const char* shaderQualityNames[ShaderQualityCount] = { "high", "medium", "low" };
+EShaderQuality shaderQuality = ShaderQualityHigh;
+GLuint texturedShaderPrograms[ShaderQualityCount];
+GLuint groundShaderPrograms[ShaderQualityCount];
 
 std::vector<unsigned int> allShaderPrograms;
+// Every permutation of the textured and ground programs, and the impostor program, which share the lighting uniforms.
+std::vector<unsigned int> litShaderPrograms;
+
 
+// Feature flags of each shader quality level, see the fragment shaders.
+vector<string> shaderQualityDefines(EShaderQuality quality)
+{
+	switch (quality)
+	{
+	case ShaderQualityMedium:
+		return { "SHADOW_SINGLE_TAP" };
+	case ShaderQualityLow:
+		return { "NO_SHADOWS", "NO_NORMAL_MAP" };
+	default:
+		return {};
+	}
+}
 
 // Shader variable setters.
 
@@ -244,12 +233,26 @@ vec3 updateCameraPosition(float cameraTheta, float cameraPhi, float cameraRadius
 // Functions.
 void initScene();
 void initShadows();
+void setShadowCascadeUniforms();
+void initRenderQueue();
+void initCulling();
+void initOcclusion();
+void initImpostors();
+void bakeImpostors();
 void setUpLightForShadows(Light light);
-void renderScene(GLuint shaderProgram);
+void renderScene(GLuint shaderProgram, const mat4& viewProjectionMatrix, vec3 viewPosition, ERenderSubset subset = RenderAll);
 void handleInputs();
 void Update(float delta);
 float randomFloat(float max, float min);
 void userInputRequest();
+bool parseCommandLine(int argc, char* argv[]);
+int grassCountForDensity(int density);
+int maximumObjectCount();
+void dumpFrame(int frame);
+void applyCameraPath(float time);
+void selectMeshLods();
+void updateLodOverlay();
+bool writeBenchmarkReport(const vector<double>& frameMilliseconds, double drawsPerFrame, double trianglesPerFrame);
 
 // Textures.
 #pragma region TEXTURES
@@ -285,16 +288,58 @@ GLuint groundLowNormalTextureID;
 GLuint grassNormalTextureID;
 
 // Meshes.
-int cubeVAO;
 int planeVAO;
 int lineVAO;
-int sphereVAO;
-int quadVAO;
+
+// Shared indexed primitives, each with a position only copy for the shadow pass.
+MeshCache* meshCache;
+const MeshCache::Mesh* cubeMesh;
+const MeshCache::Mesh* quadMesh;
+// The sphere at every level of detail, 0 is the finest.
+const MeshCache::Mesh* sphereMeshes[MeshCache::SphereLodCount];
 
 // Additional info for spheres.
 int sphereRadialDivs = 24;
 int sphereVerticalDivs = 24;
-int sphereVertexCount;
+
+// Canopies and bushes draw a coarser sphere as they shrink on screen, selected once per frame from the camera.
+// The thresholds are bounding sphere radii in pixels, one per level but the last. 'N' turns this off, 'V' shows the levels drawn.
+const vector<float> SPHERE_LOD_THRESHOLDS = { 90.0f, 45.0f, 20.0f };
+const float SPHERE_LOD_HYSTERESIS = 0.15f;
+// The shadow cascades have fewer texels than the screen has pixels, their casters use a fixed level.
+const int SHADOW_SPHERE_LOD = 2;
+bool useMeshLods = true;
+bool showLodOverlay = false;
+double lodOverlayUpdateTime;
+LodSelector canopyLods(SPHERE_LOD_THRESHOLDS, SPHERE_LOD_HYSTERESIS);
+LodSelector bushLods(SPHERE_LOD_THRESHOLDS, SPHERE_LOD_HYSTERESIS);
+// Canopies, then bushes, drawn by the last camera pass at each level.
+unsigned int lodDrawCounts[2][MeshCache::SphereLodCount];
+
+// Trees whose canopy is below IMPOSTOR_PIXEL_RADIUS on screen are drawn as impostors: a quad showing a picture of their variant,
+// a pair of bark and leaves materials, baked into the atlas from the nearest direction. 'I' turns them off.
+// The pictures are of a tree of average size, the one of the placement ranges, and each quad stretches it to its own tree.
+const float IMPOSTOR_PIXEL_RADIUS = 12.0f;
+const vec3 IMPOSTOR_TRUNK_SCALE(1.25f, 4.0f, 1.25f);
+const vec3 IMPOSTOR_CANOPY_SCALE(1.625f, 2.5f, 1.625f);
+const int IMPOSTOR_CELL_WIDTH = 64;
+const int IMPOSTOR_CELL_HEIGHT = 128;
+bool useImpostors = true;
+ImpostorAtlas* impostorAtlas;
+LodSelector treeImpostors({ IMPOSTOR_PIXEL_RADIUS }, SPHERE_LOD_HYSTERESIS);
+vector<pair<unsigned int, unsigned int>> impostorVariantMaterials;
+// The quad of every tree, and those of the trees drawn by the current pass.
+vector<ImpostorAtlas::Instance> treeImpostorInstances;
+vector<ImpostorAtlas::Instance> impostorInstances;
+unsigned int impostorDrawCount;
+
+// Mesh space bounding spheres of the shared meshes, used for culling.
+const vec3 cubeBoundsCenter(0.0f, 0.5f, 0.0f);
+const float cubeBoundsRadius = 0.8661f; // sqrt(0.75), the cube spans [-0.5, 0.5] x [0, 1] x [-0.5, 0.5].
+const vec3 sphereBoundsCenter(0.0f, 0.5f, 0.0f); // The shared sphere is generated with a 0.5 height offset.
+const float sphereBoundsRadius = 1.0f;
+const vec3 quadBoundsCenter(0.0f);
+const float quadBoundsRadius = 0.7072f; // sqrt(0.5).
 
 ECameraType cameraType = ECameraType::FirstPerson;
 
@@ -307,9 +352,39 @@ bool useShadows = true;
 // X rotation on Quad, uses SQRT
 bool quadXRotation = true;
 
-const unsigned int SHADOW_TEXTURE_WIDTH = 1024, SHADOW_TEXTURE_HEIGHT = 1024;
-GLuint shadowMapTexture;
-GLuint shadowMapFBO;
+// Cascaded shadow maps, fitted to the camera every frame. Shadows stop at SHADOW_DISTANCE from the camera.
+const int SHADOW_CASCADE_COUNT = 3;
+const unsigned int SHADOW_TEXTURE_SIZE = 1024;
+const float SHADOW_DISTANCE = 150.0f;
+const float SHADOW_CASTER_DISTANCE = 100.0f;
+// The shadow map has a texture unit of its own, materials use the others.
+const GLuint SHADOW_MAP_TEXTURE_UNIT = 7;
+ShadowCascades* shadowCascades;
+int staticShadowLayersRendered;
+
+// Depth pre-pass: lay down the depth of opaque objects with a cheap program first, so the expensive shaders
+// only run once per pixel. The scene pass is timed on the GPU to compare both modes.
+bool useDepthPrePass = false;
+
+// GPU time of each pass, and of each object group of the camera pass. 'R' prints them, --gpu-profile writes them at exit.
+GpuProfiler* gpuProfiler;
+struct GpuSections
+{
+	int shadows;
+	int axisLines;
+	int depthPrePass;
+	int ground;
+	int treeTrunks;
+	int treeTops;
+	int bushes;
+	int sky;
+	int grass;
+	int impostors;
+} gpuSections;
+string gpuProfilePath;
+
+// CPU zones of every thread, recorded and written as a Chrome trace at exit when --cpu-trace is given.
+string cpuTracePath;
 float aspect;
 
 vec3 gravityVector(0.0f, -0.5f, 0.0f);
@@ -329,6 +404,36 @@ vector <CubeModel*> treeBase;
 vector <SphereModel*> treeTop;
 vector <SphereModel*> bush;
 
+// Render queue and the materials submitted to it.
+RenderQueue renderQueue;
+unsigned int groundMaterial;
+unsigned int skyboxMaterial;
+unsigned int moonMaterial;
+unsigned int bushMaterial;
+unsigned int grassMaterial;
+vector<unsigned int> treeBaseMaterials;
+vector<unsigned int> treeTopMaterials;
+
+// Frustum culling. Each object group has a contiguous range of bounding spheres starting at the given index.
+bool useFrustumCulling = true;
+CullingSystem sceneBounds;
+vector<unsigned char> sceneVisibility;
+unsigned int groundBounds;
+unsigned int moonBounds;
+unsigned int treeBaseBounds;
+unsigned int treeTopBounds;
+unsigned int bushBounds;
+unsigned int grassBounds;
+unsigned int shadowVisibleCount;
+unsigned int cameraVisibleCount;
+
+// Software occlusion culling for the camera: the terrain and the tree trunks hide what is behind them.
+// The occluders are rasterized on the job system's threads while the main thread draws the shadows.
+bool useOcclusionCulling = true;
+// The terrain occluder has a vertex every OCCLUDER_TERRAIN_STEP units.
+const unsigned int OCCLUDER_TERRAIN_STEP = 2;
+OcclusionCuller* occlusionCuller;
+unsigned int occludedCount;
 
 // Camera parameters.
 float cameraTheta;
@@ -350,17 +455,19 @@ vec3 cameraDirection(0.0f);
 
 vec3 cameraSideVector;
 mat4 viewMatrix;
+mat4 projectionMatrix;
 
 // Misc information.
 GLFWwindow* window;
+const char* WINDOW_TITLE = "Comp371 - Final Project";
 int windowWidth = 1024, windowHeigth = 768;
 
 double lastMousePosX, lastMousePosY;
 //int previousZPress;
-//int previousCPress;
+int previousCPress;
+int previousZPress;
 //int previousYPress;
-//int previousIPress;
-//int previousBPress;
+int previousBPress;
 //int previousFPress;
 int previousPPress;
 int previousLPress;
@@ -369,6 +476,12 @@ int previous1Press;
 int previous2Press;
 int previous3Press;
 int previous4Press;
+int previousRPress;
+int previousNPress;
+int previousVPress;
+int previousIPress;
+int previousOPress;
+int previousQPress;
 
 float dt;
 float spinning = 0.0f;
@@ -376,6 +489,27 @@ float spinning = 0.0f;
 vector<Model*> objects;
 vector<QuadModel*> quads;
 
+// Worker threads for per frame CPU work.
+JobSystem* jobSystem;
+
+// Every texture, with a GPU memory budget enforced by shrinking the least used ones. 'B' cycles the budget.
+const uint64_t textureBudgets[] = { 256ull << 20, 16ull << 20, 8ull << 20 };
+const int TEXTURE_BUDGET_COUNT = sizeof(textureBudgets) / sizeof(textureBudgets[0]);
+int textureBudget = 0;
+TextureManager* textureManager;
+// The variables holding the scene's references to its textures, released at exit.
+vector<GLuint*> sceneTextureIDs;
+
+// Streamed textures appear as their placeholder colour, then sharpen as their levels are uploaded within a per frame budget.
+// Without streaming, every texture is fully loaded before the first frame.
+bool streamTextures = true;
+const uint64_t TEXTURE_UPLOAD_BYTES_PER_FRAME = 2 << 20;
+const double TEXTURE_UPLOAD_MILLISECONDS_PER_FRAME = 2.0;
+
+// Ring buffer for data uploaded every frame.
+const GLsizeiptr STREAMING_BUFFER_FRAME_SIZE = 1 << 20;
+StreamingBuffer* streamingBuffer;
+
 //QuadModel* quad;
 SphereModel* moon;
 SphereModel* skybox;
@@ -387,6 +521,29 @@ GLuint groundSizeX = 50;
 GLuint groundSizeZ = 50;
 float groundUVTiling = 8.0f;
 
+// Scene parameters given on the command line are not asked for on the console.
+bool sceneFromCommandLine = false;
+
+// Headless and bench runs render a fixed number of frames at a fixed time step, without reading input.
+// A count of 0 takes the default: 300 frames headless, the whole camera path in a bench.
+bool fixedRun = false;
+int fixedFrameCount = 0;
+const float FIXED_FRAME_TIME = 1.0f / 60.0f;
+
+// Headless runs render into an offscreen framebuffer. Frames can be written as PPM images: the last one, or one every few frames.
+bool headless = false;
+string frameDumpDirectory;
+int frameDumpInterval = 0;
+OffscreenTarget* offscreenTarget;
+
+// Bench runs fly the camera along a path, without vsync and with every texture loaded up front, then report
+// the frame time percentiles, draws and triangles as JSON. The first frames only warm caches up and are left out.
+bool benchmark = false;
+string cameraPathFile;
+string benchmarkOutputPath;
+int benchmarkWarmupFrames = 30;
+CameraPath cameraPath;
+
 
 // Handle window resizing.
 void window_size_callback(GLFWwindow* window, int width, int height)
@@ -394,7 +551,7 @@ void window_size_callback(GLFWwindow* window, int width, int height)
 	glfwGetWindowSize(window, &windowWidth, &windowHeigth);
 
 	// Set projection matrix for shaders.
-	mat4 projectionMatrix = perspective(70.0f, // fov in degrees.
+	projectionMatrix = perspective(70.0f, // fov in degrees.
 		(float)width / (float)height, // aspect ratio.
 		0.001f, 1000.0f); // near and far planes.
 	setProjectionMatrix(projectionMatrix);
@@ -404,6 +561,12 @@ void window_size_callback(GLFWwindow* window, int width, int height)
 
 int main(int argc, char* argv[])
 {
+	if (!parseCommandLine(argc, argv))
+		return -1;
+
+	PROFILE_THREAD_NAME("main");
+	CpuProfiler::SetRecording(!cpuTracePath.empty());
+
 	// Initialize GLFW and OpenGL version
 	glfwInit();
 
@@ -412,11 +575,15 @@ int main(int argc, char* argv[])
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 	glfwWindowHint(GLFW_DOUBLEBUFFER, GLFW_TRUE);
+	// Built with HEADLESS_OSMESA, the window is only a software context and needs no display at all.
+	if (headless)
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
-	userInputRequest();
+	if (!sceneFromCommandLine)
+		userInputRequest();
 
 	// Create Window and rendering context using GLFW, resolution is 1024x768
-	window = glfwCreateWindow(windowWidth, windowHeigth, "Comp371 - Final Project", NULL, NULL);
+	window = glfwCreateWindow(windowWidth, windowHeigth, WINDOW_TITLE, NULL, NULL);
 	if (window == NULL)
 	{
 		std::cerr << "Failed to create GLFW window" << std::endl;
@@ -424,7 +591,11 @@ int main(int argc, char* argv[])
 		return -1;
 	}
 	glfwMakeContextCurrent(window);
-	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+	if (!fixedRun)
+		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+	// Frame times of a bench are not capped by the display.
+	if (benchmark)
+		glfwSwapInterval(0);
 
 	// Initialize GLEW
 	glewExperimental = true; // Needed for core profile
@@ -446,38 +617,129 @@ int main(int argc, char* argv[])
 	previous2Press = GLFW_RELEASE;
 	previous3Press = GLFW_RELEASE;
 	previous4Press = GLFW_RELEASE;
+	previousRPress = GLFW_RELEASE;
+	previousCPress = GLFW_RELEASE;
+	previousZPress = GLFW_RELEASE;
+	previousOPress = GLFW_RELEASE;
+	previousQPress = GLFW_RELEASE;
+	previousBPress = GLFW_RELEASE;
+
+	jobSystem = new JobSystem();
+	textureManager = new TextureManager(textureBudgets[textureBudget], jobSystem);
+	textureManager->SetUploadBudget(TEXTURE_UPLOAD_BYTES_PER_FRAME, TEXTURE_UPLOAD_MILLISECONDS_PER_FRAME);
+
+	// Time to first frame, everything between the context being ready and the first swap.
+	double startupStartTime = glfwGetTime();
+	bool firstFrame = true;
+	bool texturesComplete = false;
 
 	initScene();
 	initShadows();
-
-	glUseProgram(texturedShaderProgram);
-	glUniform1i(glGetUniformLocation(texturedShaderProgram, "render_shadows"), (int)true);
-	glUseProgram(groundShaderProgram);
-	glUniform1i(glGetUniformLocation(texturedShaderProgram, "render_shadows"), (int)true);
+	initRenderQueue();
+	initCulling();
+	initOcclusion();
+	initImpostors();
+
+	streamingBuffer = new StreamingBuffer(STREAMING_BUFFER_FRAME_SIZE);
+
+	// Sections in frame order, for the summary.
+	gpuProfiler = new GpuProfiler();
+	gpuSections.shadows = gpuProfiler->AddSection("shadows");
+	gpuSections.axisLines = gpuProfiler->AddSection("axis lines");
+	gpuSections.depthPrePass = gpuProfiler->AddSection("depth pre-pass");
+	gpuSections.ground = gpuProfiler->AddSection("ground");
+	gpuSections.treeTrunks = gpuProfiler->AddSection("tree trunks");
+	gpuSections.treeTops = gpuProfiler->AddSection("tree tops");
+	gpuSections.bushes = gpuProfiler->AddSection("bushes");
+	gpuSections.sky = gpuProfiler->AddSection("sky");
+	gpuSections.grass = gpuProfiler->AddSection("grass");
+	gpuSections.impostors = gpuProfiler->AddSection("impostors");
+
+	// Headless frames go to an offscreen framebuffer, the window's own one may not even be backed by memory.
+	GLuint sceneFramebuffer = 0;
+	if (headless)
+	{
+		offscreenTarget = new OffscreenTarget(windowWidth, windowHeigth);
+		if (!offscreenTarget->IsComplete())
+		{
+			std::cerr << "Failed to create the offscreen framebuffer" << std::endl;
+			glfwTerminate();
+			return -1;
+		}
+		sceneFramebuffer = offscreenTarget->GetFramebuffer();
+	}
 
 	glfwSetWindowSizeCallback(window, window_size_callback);
 
+	int frame = 0;
+	double loopStartTime = glfwGetTime();
+
+	vector<double> benchmarkFrameMilliseconds;
+	double benchmarkDraws = 0.0, benchmarkTriangles = 0.0;
+
 	// Entering Main Loop
 	while (!glfwWindowShouldClose(window))
 	{
+		PROFILE_ZONE("frame");
+		double frameStartTime = glfwGetTime();
+
 		// Frame time calculation.
 		dt = glfwGetTime() - lastFrameTime;
 		lastFrameTime += dt;
+		if (fixedRun)
+			dt = FIXED_FRAME_TIME;
+		if (benchmark)
+			applyCameraPath(frame * FIXED_FRAME_TIME);
 
 		Update(dt);
 
 		// Render frame.
+		selectMeshLods();
+		textureManager->Update();
+		renderQueue.ResetStatistics();
+		streamingBuffer->BeginFrame();
+
+		// Occlusion.
+		// Rasterize the occluders in the background, the result is only needed by the camera pass.
+		mat4 cameraViewProjection = projectionMatrix * viewMatrix;
+		JobSystem::JobHandle occlusionJob;
+		if (useOcclusionCulling)
+			occlusionJob = jobSystem->Schedule([cameraViewProjection]()
+				{
+					PROFILE_ZONE("occlusion rasterization");
+					occlusionCuller->Render(cameraViewProjection, jobSystem);
+				});
 
 		// Shadows.
-		// Size viewport, clear buffers, and render the depth cubemap.
-		glViewport(0, 0, SHADOW_TEXTURE_WIDTH, SHADOW_TEXTURE_HEIGHT);
-		glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
-		glClear(GL_DEPTH_BUFFER_BIT);
+		// Fit the cascades to the camera, then render the depth of each one into its layers.
+		// Static casters are only redrawn when their cascade moved, the moon and the grass every frame.
+		shadowCascades->Update(viewMatrix, projectionMatrix, SHADOW_DISTANCE, sunLight.direction, SHADOW_CASTER_DISTANCE);
+		setShadowCascadeUniforms();
 
 		glCullFace(GL_FRONT);
-		renderScene(shadowShaderProgram);
+		shadowVisibleCount = 0;
+		staticShadowLayersRendered = 0;
+		gpuProfiler->Begin(gpuSections.shadows);
+		for (int cascade = 0; cascade < shadowCascades->GetCascadeCount(); cascade++)
+		{
+			SetUniformMat4(shadowShaderProgram, "lightSpaceMatrix", shadowCascades->GetMatrix(cascade));
+
+			if (shadowCascades->IsStaticLayerStale(cascade))
+			{
+				shadowCascades->BindCascade(cascade, ShadowCascades::StaticLayer);
+				glClear(GL_DEPTH_BUFFER_BIT);
+				renderScene(shadowShaderProgram, shadowCascades->GetMatrix(cascade), shadowCascades->GetLightPosition(cascade), RenderStatic);
+				shadowCascades->MarkStaticLayerRendered(cascade);
+				staticShadowLayersRendered++;
+			}
 
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			shadowCascades->BindCascade(cascade, ShadowCascades::DynamicLayer);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			renderScene(shadowShaderProgram, shadowCascades->GetMatrix(cascade), shadowCascades->GetLightPosition(cascade), RenderDynamic);
+		}
+		gpuProfiler->End();
+
+		glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
 
 		// Scene.
 		// Size viewport, clear buffers, and render the scene itself.
@@ -485,30 +747,76 @@ int main(int argc, char* argv[])
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		// Draw colourful lines.
+		gpuProfiler->Begin(gpuSections.axisLines);
 		glUseProgram(colourShaderProgram);
 		glBindVertexArray(lineVAO);
 		DawAxisStar(colourShaderProgram);
+		gpuProfiler->End();
+
+		// Draw the main scene. Material textures are bound by the render queue, the shadow map sits on its own unit.
+		glActiveTexture(GL_TEXTURE0 + SHADOW_MAP_TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, shadowCascades->GetTexture());
+
+		if (occlusionJob)
+		{
+			PROFILE_ZONE("wait for occlusion");
+			jobSystem->Wait(occlusionJob);
+		}
 
-		// Prepare textures.
-		// To do : either move this to its own function, or make it a loop over all relevant shaders.
-		glUseProgram(texturedShaderProgram);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, shadowMapTexture);
-		GLuint textureLocation = glGetUniformLocation(texturedShaderProgram, "shadowMap");
-		glUniform1i(textureLocation, 0);
-
-		glUseProgram(groundShaderProgram);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, shadowMapTexture);
-		textureLocation = glGetUniformLocation(groundShaderProgram, "shadowMap");
-		glUniform1i(textureLocation, 0);
-
-		// Draw the main scene.
 		glCullFace(GL_BACK);
-		renderScene(groundShaderProgram);
+		if (useDepthPrePass)
+		{
+			gpuProfiler->Begin(gpuSections.depthPrePass);
+			renderScene(depthShaderProgram, cameraViewProjection, cameraPosition);
+			gpuProfiler->End();
+		}
+		renderScene(groundShaderProgram, cameraViewProjection, cameraPosition);
 
 		// End frame
-		glfwSwapBuffers(window);
+		streamingBuffer->EndFrame();
+		if (headless && !frameDumpDirectory.empty())
+		{
+			bool lastFrame = frame == fixedFrameCount - 1;
+			if (frameDumpInterval > 0 ? frame % frameDumpInterval == 0 || lastFrame : lastFrame)
+				dumpFrame(frame);
+		}
+		{
+			PROFILE_ZONE("swap buffers");
+			glfwSwapBuffers(window);
+		}
+
+		if (showLodOverlay)
+			updateLodOverlay();
+
+		if (firstFrame)
+		{
+			cout << "First frame after " << (glfwGetTime() - startupStartTime) * 1000.0 << " ms.\n";
+			firstFrame = false;
+		}
+		if (!texturesComplete && textureManager->GetStreamingCount() == 0)
+		{
+			cout << "Every texture at full resolution after " << (glfwGetTime() - startupStartTime) * 1000.0 << " ms.\n";
+			texturesComplete = true;
+			// The impostors were baked from whatever levels were loaded then.
+			bakeImpostors();
+		}
+
+		if (benchmark && frame >= benchmarkWarmupFrames)
+		{
+			benchmarkFrameMilliseconds.push_back((glfwGetTime() - frameStartTime) * 1000.0);
+			benchmarkDraws += renderQueue.GetStatistics().draws;
+			benchmarkTriangles += renderQueue.GetStatistics().triangles;
+		}
+
+		frame++;
+		if (fixedRun)
+		{
+			// Input is not read, but the window's events are still handled so it can be closed and keeps responding.
+			glfwPollEvents();
+			if (frame >= fixedFrameCount)
+				glfwSetWindowShouldClose(window, GLFW_TRUE);
+			continue;
+		}
 
 		handleInputs();
 
@@ -520,11 +828,65 @@ int main(int argc, char* argv[])
 		previous2Press = glfwGetKey(window, GLFW_KEY_2);
 		previous3Press = glfwGetKey(window, GLFW_KEY_3);
 		previous4Press = glfwGetKey(window, GLFW_KEY_4);
+		previousRPress = glfwGetKey(window, GLFW_KEY_R);
+		previousCPress = glfwGetKey(window, GLFW_KEY_C);
+		previousZPress = glfwGetKey(window, GLFW_KEY_Z);
+		previousOPress = glfwGetKey(window, GLFW_KEY_O);
+		previousQPress = glfwGetKey(window, GLFW_KEY_Q);
+		previousBPress = glfwGetKey(window, GLFW_KEY_B);
+		previousNPress = glfwGetKey(window, GLFW_KEY_N);
+		previousVPress = glfwGetKey(window, GLFW_KEY_V);
+		previousIPress = glfwGetKey(window, GLFW_KEY_I);
+	}
+
+	if (headless)
+	{
+		double loopTime = glfwGetTime() - loopStartTime;
+		cout << "Rendered " << frame << " frames in " << loopTime * 1000.0 << " ms, " << loopTime * 1000.0 / std::max(frame, 1) << " ms per frame.\n";
+	}
+
+	int result = 0;
+	if (benchmark)
+	{
+		double measuredFrames = std::max((double)benchmarkFrameMilliseconds.size(), 1.0);
+		if (!writeBenchmarkReport(benchmarkFrameMilliseconds, benchmarkDraws / measuredFrames, benchmarkTriangles / measuredFrames))
+			result = -1;
 	}
 
+	if (!gpuProfilePath.empty())
+	{
+		if (gpuProfiler->Write(gpuProfilePath))
+			cout << "GPU timers written to " << gpuProfilePath << ".\n";
+		else
+			cout << "Could not write " << gpuProfilePath << ".\n";
+	}
+
+	if (!cpuTracePath.empty())
+	{
+#ifndef CPU_PROFILER_ENABLED
+		cout << "Built without CPU_PROFILER, the CPU trace has no zones.\n";
+#endif
+		if (CpuProfiler::WriteChromeTrace(cpuTracePath))
+			cout << "CPU trace written to " << cpuTracePath << ".\n";
+		else
+			cout << "Could not write " << cpuTracePath << ".\n";
+	}
+
+	delete impostorAtlas;
+	delete meshCache;
+	delete offscreenTarget;
+	delete occlusionCuller;
+	delete gpuProfiler;
+	delete shadowCascades;
+	delete streamingBuffer;
+	for (GLuint* textureID : sceneTextureIDs)
+		textureManager->Release(*textureID);
+	delete textureManager;
+	delete jobSystem;
+
 	// Shutdown GLFW
 	glfwTerminate();
-	return 0;
+	return result;
 }
 
 void initScene()
@@ -532,187 +894,290 @@ void initScene()
 	// Background colour.
 	glClearColor(0.5f, 0.75f, 1.0f, 1.0f);
 
-	std::cout << "LOADING TEXTURES\n";
-	// Load textures.
+	std::cout << "LOADING SCENE\n";
 	const string texturePathPrefix = "assets/textures/";
 	const string shaderPathPrefix = "assets/shaders/";
+	// Meshes baked by mesh_baker. The primitives missing from it are built at startup.
+	const string meshPathPrefix = "assets/meshes/";
+
+	// Startup runs as a task graph: images are decoded and the terrain and placement are generated on the workers,
+	// while this thread uploads the textures and links the programs as their inputs become ready.
+	StartupGraph graph(jobSystem);
 
 #pragma region TEXTURE LOADING
 
-	groundHighTextureID = loadTexture(texturePathPrefix + "groundHigh.png");
-	groundLowTextureID = loadTexture(texturePathPrefix + "groundLow.png");
-	//stoneTextureID = loadTexture(texturePathPrefix + "stone.png");
-	woodTextureID = loadTexture(texturePathPrefix + "wood.png");
-	//metalTextureID = loadTexture(texturePathPrefix + "metal.png");
-	grassTextureID = loadTexture(texturePathPrefix + "grass.png");
-	treeTopTextureID = loadTexture(texturePathPrefix + "treeTop.png");
-	bushTextureID = loadTexture(texturePathPrefix + "Bush.jpg");
-	bushNTextureID = loadTexture(texturePathPrefix + "Bush_N.jpg");
-	moonTextureID = loadTexture(texturePathPrefix + "moon.png");
-
-	bark001TextureID = loadTexture(texturePathPrefix + "Bark001.jpg");
-	bark001NTextureID = loadTexture(texturePathPrefix + "Bark001_N.jpg");
-	bark012TextureID = loadTexture(texturePathPrefix + "Bark012.jpg");
-	bark012NTextureID = loadTexture(texturePathPrefix + "Bark012_N.jpg");
-	birchTextureID = loadTexture(texturePathPrefix + "Birch.jpg");
-	birchNTextureID = loadTexture(texturePathPrefix + "Birch_N.png");
-	leaves01TextureID = loadTexture(texturePathPrefix + "leaves_1.png");
-	leaves02TextureID = loadTexture(texturePathPrefix + "leaves_2.png");
-	skyboxTextureID = loadTexture(texturePathPrefix + "skybox.png");
+	// Missing files show as the placeholder colour: flat normals for normal maps, the background for the sky.
+	const vec4 flatNormal(0.5f, 0.5f, 1.0f, 1.0f);
+	const vec4 skyColour(0.5f, 0.75f, 1.0f, 1.0f);
+	struct TextureLoad
+	{
+		string path;
+		GLuint* textureID;
+		vec4 placeholder = vec4(1.0f);
+	};
+	const vector<TextureLoad> textureLoads = {
+		{ texturePathPrefix + "groundHigh.png", &groundHighTextureID },
+		{ texturePathPrefix + "groundLow.png", &groundLowTextureID },
+		//{ texturePathPrefix + "stone.png", &stoneTextureID },
+		{ texturePathPrefix + "wood.png", &woodTextureID },
+		//{ texturePathPrefix + "metal.png", &metalTextureID },
+		{ texturePathPrefix + "Grass.png", &grassTextureID },
+		{ texturePathPrefix + "treeTop.png", &treeTopTextureID },
+		{ texturePathPrefix + "Bush.jpg", &bushTextureID },
+		{ texturePathPrefix + "Bush_N.jpg", &bushNTextureID, flatNormal },
+		{ texturePathPrefix + "moon.png", &moonTextureID },
+
+		{ texturePathPrefix + "Bark001.jpg", &bark001TextureID },
+		{ texturePathPrefix + "Bark001_N.jpg", &bark001NTextureID, flatNormal },
+		{ texturePathPrefix + "Bark012.jpg", &bark012TextureID },
+		{ texturePathPrefix + "Bark012_N.jpg", &bark012NTextureID, flatNormal },
+		{ texturePathPrefix + "Birch.jpg", &birchTextureID },
+		{ texturePathPrefix + "Birch_N.png", &birchNTextureID, flatNormal },
+		{ texturePathPrefix + "leaves_1.png", &leaves01TextureID },
+		{ texturePathPrefix + "leaves_2.png", &leaves02TextureID },
+		{ texturePathPrefix + "skybox.png", &skyboxTextureID, skyColour },
+
+		{ texturePathPrefix + "groundHighDepth.png", &groundHighDepthTextureID },
+		{ texturePathPrefix + "groundLowDepth.png", &groundLowDepthTextureID },
+		{ texturePathPrefix + "groundHighNormal.png", &groundHighNormalTextureID, flatNormal },
+		{ texturePathPrefix + "groundLowNormal.png", &groundLowNormalTextureID, flatNormal },
+	};
+
+	// Each decoded image stays here until its upload frees it.
+	vector<TextureManager::DecodedTexture> decodedTextures(textureLoads.size());
+	for (size_t i = 0; i < textureLoads.size(); i++)
+	{
+		sceneTextureIDs.push_back(textureLoads[i].textureID);
+		if (streamTextures)
+		{
+			*textureLoads[i].textureID = textureManager->Stream(textureLoads[i].path, textureLoads[i].placeholder);
+			continue;
+		}
 
+		string name = textureLoads[i].path.substr(texturePathPrefix.size());
+		StartupGraph::TaskId decode = graph.Add("decode " + name, StartupGraph::WorkerThread,
+			[&textureLoads, &decodedTextures, i]() { decodedTextures[i] = TextureManager::Decode(textureLoads[i].path); });
+		graph.Add("upload " + name, StartupGraph::ContextThread,
+			[&textureLoads, &decodedTextures, i]() { *textureLoads[i].textureID = textureManager->Upload(decodedTextures[i], textureLoads[i].placeholder); }, { decode });
+	}
 
 #pragma endregion
 
+	// Compile and link shaders, or load them from the binaries linked by an earlier run.
+	// Every quality level of the lit programs is compiled up front so switching costs nothing.
+	// Permutations with the same defines are compiled once: the sky program is the low quality textured one.
+	StartupGraph::TaskId linkUtilityPrograms = graph.Add("link colour, shadow and depth programs", StartupGraph::ContextThread, [&shaderPathPrefix]()
+	{
+		colourShaderProgram = loadSHADER(shaderPathPrefix + "vertexcolour_vertex.glsl", shaderPathPrefix + "vertexcolour_fragment.glsl");
+		shadowShaderProgram = loadSHADER(shaderPathPrefix + "shadow_vertex.glsl", shaderPathPrefix + "shadow_fragment.glsl");
+		depthShaderProgram = loadSHADER(shaderPathPrefix + "depth_vertex.glsl", shaderPathPrefix + "shadow_fragment.glsl");
+	});
 
-	groundHighDepthTextureID = loadTexture("assets/textures/groundHighDepth.png");
-	groundLowDepthTextureID = loadTexture("assets/textures/groundLowDepth.png");
+	StartupGraph::TaskId linkImpostorPrograms = graph.Add("link impostor programs", StartupGraph::ContextThread, [&shaderPathPrefix]()
+	{
+		impostorBakeShaderProgram = loadSHADER(shaderPathPrefix + "textured_vertex.glsl", shaderPathPrefix + "impostor_bake_fragment.glsl");
+		impostorShaderProgram = loadSHADER(shaderPathPrefix + "impostor_vertex.glsl", shaderPathPrefix + "impostor_fragment.glsl");
+	});
 
-	groundHighNormalTextureID = loadTexture("assets/textures/groundHighNormal.png");
-	groundLowNormalTextureID = loadTexture("assets/textures/groundLowNormal.png");
+	StartupGraph::TaskId linkTexturedPrograms = graph.Add("link textured permutations", StartupGraph::ContextThread, [&shaderPathPrefix]()
+	{
+		for (int quality = 0; quality < ShaderQualityCount; quality++)
+			texturedShaderPrograms[quality] = loadShaderPermutation(shaderPathPrefix + "textured_vertex.glsl", shaderPathPrefix + "textured_fragment.glsl", shaderQualityDefines((EShaderQuality)quality));
+		skyShaderProgram = loadShaderPermutation(shaderPathPrefix + "textured_vertex.glsl", shaderPathPrefix + "textured_fragment.glsl", { "NO_SHADOWS", "NO_NORMAL_MAP" });
+	});
 
-	// Compile and link shaders.
-	colourShaderProgram = loadSHADER(shaderPathPrefix + "vertexcolour_vertex.glsl", shaderPathPrefix + "vertexcolour_fragment.glsl");
-	texturedShaderProgram = loadSHADER(shaderPathPrefix + "textured_vertex.glsl", shaderPathPrefix + "textured_fragment.glsl");
-	groundShaderProgram = loadSHADER(shaderPathPrefix + "textured_vertex.glsl", shaderPathPrefix + "ground_fragment.glsl");
-	shadowShaderProgram = loadSHADER(shaderPathPrefix + "shadow_vertex.glsl", shaderPathPrefix + "shadow_fragment.glsl");
+	StartupGraph::TaskId linkGroundPrograms = graph.Add("link ground permutations", StartupGraph::ContextThread, [&shaderPathPrefix]()
+	{
+		for (int quality = 0; quality < ShaderQualityCount; quality++)
+			groundShaderPrograms[quality] = loadShaderPermutation(shaderPathPrefix + "textured_vertex.glsl", shaderPathPrefix + "ground_fragment.glsl", shaderQualityDefines((EShaderQuality)quality));
+	});
 
-	// Collect shaders into a vector for ease of iteration.
-	allShaderPrograms.push_back(colourShaderProgram);
-	allShaderPrograms.push_back(texturedShaderProgram);
-	allShaderPrograms.push_back(groundShaderProgram);
-	allShaderPrograms.push_back(shadowShaderProgram);
+	StartupGraph::TaskId collectPrograms = graph.Add("collect programs", StartupGraph::ContextThread, []()
+	{
+		const ShaderLoadStatistics& shaderStatistics = shaderLoadStatistics();
+		cout << "Shaders loaded, " << (shaderStatistics.compiled > 0 ? "cold" : "warm") << " start: "
+			<< shaderStatistics.loadedFromCache << " programs from the binary cache, " << shaderStatistics.compiled << " compiled";
+		if (shaderStatistics.rejectedFromCache > 0)
+			cout << " (" << shaderStatistics.rejectedFromCache << " cached binaries rejected by the driver)";
+		cout << ".\n";
+		texturedShaderProgram = texturedShaderPrograms[shaderQuality];
+		groundShaderProgram = groundShaderPrograms[shaderQuality];
+
+		for (int quality = 0; quality < ShaderQualityCount; quality++)
+		{
+			for (GLuint program : { texturedShaderPrograms[quality], groundShaderPrograms[quality] })
+			{
+				if (find(litShaderPrograms.begin(), litShaderPrograms.end(), program) == litShaderPrograms.end())
+					litShaderPrograms.push_back(program);
+			}
+		}
+		if (find(litShaderPrograms.begin(), litShaderPrograms.end(), skyShaderProgram) == litShaderPrograms.end())
+			litShaderPrograms.push_back(skyShaderProgram);
+		litShaderPrograms.push_back(impostorShaderProgram);
 
-	// Define and upload geometry to the GPU.
-	cubeVAO = CubeModel::CubeModelVAO();
-	planeVAO = PlaneModel::PlaneModelVAO();
-	sphereVAO = SphereModel::SphereModelVAO(1.0f, 0.5f, sphereRadialDivs, sphereVerticalDivs, sphereVertexCount);
-	quadVAO = QuadModel::QuadModelVAO();
-	//cubeVAO = createCubeVBO();
-	//planeVAO = createPlaneVBO();
-	lineVAO = createLinesVBO();
-	//sphereVAO = createSphereVBO(0.75f, 0.5f, sphereRadialDivs, sphereVerticalDivs);
-	//sphereVertexCount = sphereRadialDivs * sphereVerticalDivs * 6;
-	//groundVAO = createGroundVBO(groundSizeX, groundSizeZ, groundUVTiling);
-
-	// Initial camera parameters.
-	cameraTheta = radians(270.0f);
-	cameraPhi = radians(10.0f);
-	cameraRadius = 10.0f;
-	cameraRotSpeed = radians(1.0f);
+		// Collect shaders into a vector for ease of iteration.
+		allShaderPrograms.push_back(colourShaderProgram);
+		allShaderPrograms.insert(allShaderPrograms.end(), litShaderPrograms.begin(), litShaderPrograms.end());
+		allShaderPrograms.push_back(shadowShaderProgram);
+		allShaderPrograms.push_back(depthShaderProgram);
+	}, { linkUtilityPrograms, linkTexturedPrograms, linkGroundPrograms, linkImpostorPrograms });
 
-	// Set projection matrix for shaders.
-	mat4 projectionMatrix = perspective(70.0f, // fov in degrees.
-		(float)windowWidth / (float)windowHeigth, // aspect ratio.
-		0.001f, 1000.0f); // near and far planes.
+	// Define and upload geometry to the GPU.
+	graph.Add("upload primitive meshes", StartupGraph::ContextThread, [&meshPathPrefix]()
+	{
+		meshCache = new MeshCache(meshPathPrefix);
+		cubeMesh = &meshCache->GetCube();
+		quadMesh = &meshCache->GetQuad();
+		for (int lod = 0; lod < MeshCache::SphereLodCount; lod++)
+			sphereMeshes[lod] = &meshCache->GetSphereLod(1.0f, 0.5f, sphereRadialDivs, sphereVerticalDivs, lod);
+		planeVAO = PlaneModel::PlaneModelVAO();
+		//cubeVAO = createCubeVBO();
+		//planeVAO = createPlaneVBO();
+		lineVAO = createLinesVBO();
+		//sphereVAO = createSphereVBO(0.75f, 0.5f, sphereRadialDivs, sphereVerticalDivs);
+		//sphereVertexCount = sphereRadialDivs * sphereVerticalDivs * 6;
+		//groundVAO = createGroundVBO(groundSizeX, groundSizeZ, groundUVTiling);
+	});
+
+	StartupGraph::TaskId setUpCameraAndLight = graph.Add("set up camera and light", StartupGraph::ContextThread, []()
+	{
+		// Initial camera parameters.
+		cameraTheta = radians(270.0f);
+		cameraPhi = radians(10.0f);
+		cameraRadius = 10.0f;
+		cameraRotSpeed = radians(1.0f);
 
+		// Set projection matrix for shaders.
+		projectionMatrix = perspective(70.0f, // fov in degrees.
+			(float)windowWidth / (float)windowHeigth, // aspect ratio.
+			0.001f, 1000.0f); // near and far planes.
 
-	// Set initial view matrix
-	cameraPosition = updateCameraPosition(cameraTheta, cameraPhi, cameraRadius);
-	cameraSideVector = cross(cameraLookAt, cameraUpVector);
-	normalize(cameraSideVector);
-	viewMatrix = lookAt(cameraPosition, cameraLookAt, cameraUpVector); // eye, center, up.
 
-	// Set View and Projection matrices.
-	setViewMatrix(viewMatrix);
-	setProjectionMatrix(projectionMatrix);
+		// Set initial view matrix
+		cameraPosition = updateCameraPosition(cameraTheta, cameraPhi, cameraRadius);
+		cameraSideVector = cross(cameraLookAt, cameraUpVector);
+		normalize(cameraSideVector);
+		viewMatrix = lookAt(cameraPosition, cameraLookAt, cameraUpVector); // eye, center, up.
 
+		// Set View and Projection matrices.
+		setViewMatrix(viewMatrix);
+		setProjectionMatrix(projectionMatrix);
 
-	// Initialize main light.
-	sunLight = Light(vec3(0.95f, 0.95f, 1.0f), vec3(0.0f, 45.0f, 50.0f), vec3(0.0f, 1.0f, 0.0f));
 
-	setUpLightForShadows(sunLight);
+		// Initialize main light.
+		sunLight = Light(vec3(0.95f, 0.95f, 1.0f), vec3(0.0f, 45.0f, 50.0f), vec3(0.0f, 1.0f, 0.0f));
 
-	// Set constant light related parameters in texture shader.
-	SetUniformVec3(texturedShaderProgram, "light_color", sunLight.color);
-	SetUniformVec3(groundShaderProgram, "light_color", sunLight.color);
+		setUpLightForShadows(sunLight);
 
+		// Set constant light related parameters, and the other parameters, in every permutation of the lit programs.
+		for (GLuint program : litShaderPrograms)
+		{
+			SetUniformVec3(program, "light_color", sunLight.color);
+			SetUniformVec3(program, "view_position", cameraPosition);
+			SetUniformVec3(program, "ambient_colour", ambientColour);
 
-	// Set other parameters in textured shader program.
-	// To do: loop these over shaders.
+			SetUniform1Value(program, "light_near_plane", light_near_plane);
+			SetUniform1Value(program, "light_far_plane", light_far_plane);
+		}
 
-	SetUniformVec3(texturedShaderProgram, "view_position", cameraPosition);
-	SetUniformVec3(groundShaderProgram, "view_position", cameraPosition);
+		for (GLuint program : groundShaderPrograms)
+			SetUniform1Value(program, "heightblend_factor", 0.45f);
 
-	SetUniformVec3(texturedShaderProgram, "ambient_colour", ambientColour);
-	SetUniformVec3(groundShaderProgram, "ambient_colour", ambientColour);
+		//quad = new QuadModel(vec3(2.0f, 0.7f, 2.0f), vec3(0.0f), vec3(1.0f));
 
-	SetUniform1Value(texturedShaderProgram, "light_near_plane", light_near_plane);
-	SetUniform1Value(texturedShaderProgram, "light_far_plane", light_far_plane);
 
-	SetUniform1Value(groundShaderProgram, "light_near_plane", light_near_plane);
-	SetUniform1Value(groundShaderProgram, "light_far_plane", light_far_plane);
+		// Setting the Moon to the outerbound of the terrain
+		moon = new SphereModel(vec3(groundSizeX, 40.0f, groundSizeZ), vec3(0.0f), vec3(2.0f));
+		//Skybox, scaling by negative so it is inverted and rotating it by 180 so it upright
+		skybox = new SphereModel(vec3(0.0f), vec3(radians(180.0f), 0.0f, 0.0f), vec3(groundSizeX * -2.0f, groundSizeX * -2.0f, groundSizeZ * -2.0f));
 
-	SetUniform1Value(groundShaderProgram, "heightblend_factor", 0.45f);
+		// camera's sphere collider
+		cameraBoundingSphere = new SphereModel(cameraPosition, vec3(0.0f), vec3(1.0f));
+	}, { collectPrograms });
 
-	//quad = new QuadModel(vec3(2.0f, 0.7f, 2.0f), vec3(0.0f), vec3(1.0f));
-	
+	// The terrain's vertices are generated on a worker, and uploaded once they are.
+	StartupGraph::TaskId generateTerrain = graph.Add("generate terrain", StartupGraph::WorkerThread, []()
+	{
+		ground = new GroundModel(groundSizeX, groundSizeZ, groundUVTiling, false, seed);
+	});
+	StartupGraph::TaskId uploadTerrain = graph.Add("upload terrain", StartupGraph::ContextThread, []() { ground->CreateBuffers(); }, { generateTerrain });
 
-	// Setting the Moon to the outerbound of the terrain
-	moon = new SphereModel(vec3(groundSizeX, 40.0f, groundSizeZ), vec3(0.0f), vec3(2.0f));
-	//Skybox, scaling by negative so it is inverted and rotating it by 180 so it upright
-	skybox = new SphereModel(vec3(0.0f), vec3(radians(180.0f), 0.0f, 0.0f), vec3(groundSizeX * -2.0f, groundSizeX * -2.0f, groundSizeZ * -2.0f));
+	// Placement only builds CPU side models. The terrain and placement are the only tasks drawing from rand(), one after the other,
+	// and each seeds it from the scene seed first, so a seed always gives the same scene.
+	StartupGraph::TaskId placeObjects = graph.Add("place trees, bushes and grass", StartupGraph::WorkerThread, []()
+	{
+		srand(seed);
 
-	// camera's sphere collider
-	cameraBoundingSphere = new SphereModel(cameraPosition, vec3(0.0f), vec3(1.0f));
+		// setup all possible item positions within a vector and the shuffle the vector using seed
+		for (int i = 1; i < (groundSizeX / 6) - 1; i++)
+		{
+			for (int j = 1; j < (groundSizeZ / 6) - 1; j++)
+			{
+				float xTranslation = float(i) * 6.0f - float(groundSizeX / 2);
+				float zTranslation = float(j) * 6.0f - float(groundSizeZ / 2);
+				float height = randomFloat(5.0f, 3.0f);
+				float yTranslation = ground->returnHeightAtPoint(vec2(xTranslation + float(groundSizeX / 2), zTranslation + float(groundSizeZ / 2))) - 0.5f;
+				treeBase.push_back(new CubeModel(vec3(xTranslation, yTranslation, zTranslation), vec3(0.0f, randomFloat(90.0f, 0.0f), 0.0f), vec3(randomFloat(1.5f, 1.0f), height, randomFloat(1.5f, 1.0f))));
 
-	ground = new GroundModel(groundSizeX, groundSizeZ, groundUVTiling);
+				treeTop.push_back(new SphereModel(vec3(xTranslation, yTranslation + height, zTranslation), vec3(0.0f), vec3(randomFloat(1.75f, 1.5f), randomFloat(3.5f, 1.5f), randomFloat(1.75f, 1.5f))));
+			}
+		}
 
-	// setup all possible item positions within a vector and the shuffle the vector using seed
-	for (int i = 1; i < (groundSizeX / 6) - 1; i++)
-	{
-		for (int j = 1; j < (groundSizeZ / 6) - 1; j++)
+		for (int i = 1; i < (groundSizeX / 6) - 1; i++)
 		{
-			float xTranslation = float(i) * 6.0f - float(groundSizeX / 2);
-			float zTranslation = float(j) * 6.0f - float(groundSizeZ / 2);
-			float height = randomFloat(5.0f, 3.0f);
-			float yTranslation = ground->returnHeightAtPoint(vec2(xTranslation + float(groundSizeX / 2), zTranslation + float(groundSizeZ / 2))) - 0.5f;
-			treeBase.push_back(new CubeModel(vec3(xTranslation, yTranslation, zTranslation), vec3(0.0f, randomFloat(90.0f, 0.0f), 0.0f), vec3(randomFloat(1.5f, 1.0f), height, randomFloat(1.5f, 1.0f))));
-
-			treeTop.push_back(new SphereModel(vec3(xTranslation, yTranslation + height, zTranslation), vec3(0.0f), vec3(randomFloat(1.75f, 1.5f), randomFloat(3.5f, 1.5f), randomFloat(1.75f, 1.5f))));
-			cout << i << " " << j << endl;
+			for (int j = 1; j < (groundSizeZ / 6) - 1; j++)
+			{
+				float xTranslation = float(i) * 6.0f - float(groundSizeX / 2);
+				float zTranslation = float(j) * 6.0f - float(groundSizeZ / 2);
+				float yTranslation = ground->returnHeightAtPoint(vec2(xTranslation + float(groundSizeX / 2), zTranslation + float(groundSizeZ / 2))) - 0.5f;
+
+				bush.push_back(new SphereModel(vec3(xTranslation, yTranslation, zTranslation), vec3(0.0f), vec3(randomFloat(2.0f, 1.0f), randomFloat(1.0f, 0.5f), randomFloat(2.0f, 1.0f))));
+			}
 		}
-	}
-	
-	for (int i = 1; i < (groundSizeX / 6) - 1; i++)
-	{
-		for (int j = 1; j < (groundSizeZ / 6) - 1; j++)
+
+		for (int i = 1; i < (groundSizeX) - 1; i++)
 		{
-			float xTranslation = float(i) * 6.0f - float(groundSizeX / 2);
-			float zTranslation = float(j) * 6.0f - float(groundSizeZ / 2);
-			float yTranslation = ground->returnHeightAtPoint(vec2(xTranslation + float(groundSizeX / 2), zTranslation + float(groundSizeZ / 2))) - 0.5f;
+			for (int j = 1; j < (groundSizeZ) - 1; j++)
+			{
+				float xTranslation = float(i) - float(groundSizeX / 2);
+				float zTranslation = float(j) - float(groundSizeZ / 2);
+				float yTranslation = ground->returnHeightAtPoint(vec2(xTranslation + float(groundSizeX / 2), zTranslation + float(groundSizeZ / 2)));
 
-			bush.push_back(new SphereModel(vec3(xTranslation, yTranslation, zTranslation), vec3(0.0f), vec3(randomFloat(2.0f, 1.0f), randomFloat(1.0f, 0.5f), randomFloat(2.0f, 1.0f))));
+				quads.push_back(new QuadModel(vec3(xTranslation, yTranslation, zTranslation), vec3(0.0f), vec3(randomFloat(1.0f, 0.5f), randomFloat(1.0f, 0.5f), 1.0f)));
+			}
 		}
-	}
 
-	for (int i = 1; i < (groundSizeX) - 1; i++)
+		shuffle(treeBase.begin(), treeBase.end(), std::default_random_engine(seed));
+		shuffle(treeTop.begin(), treeTop.end(), std::default_random_engine(seed));
+		shuffle(bush.begin(), bush.end(), std::default_random_engine(seed));
+		shuffle(quads.begin(), quads.end(), std::default_random_engine(seed));
+	}, { generateTerrain });
+
+	// add the items will be rendered to the objects vector
+	graph.Add("collect objects", StartupGraph::ContextThread, []()
 	{
-		for (int j = 1; j < (groundSizeZ) - 1; j++)
+		for (int i = 0; i < treeCount; i++)
 		{
-			float xTranslation = float(i) - float(groundSizeX / 2);
-			float zTranslation = float(j) - float(groundSizeZ / 2);
-			float yTranslation = ground->returnHeightAtPoint(vec2(xTranslation + float(groundSizeX / 2), zTranslation + float(groundSizeZ / 2)));
+			objects.push_back(treeBase.at(i));
+			objects.push_back(treeTop.at(i));
+		}
 
-			quads.push_back(new QuadModel(vec3(xTranslation, yTranslation, zTranslation), vec3(0.0f), vec3(randomFloat(1.0f, 0.5f), randomFloat(1.0f, 0.5f), 1.0f)));
+		for (int i = treeCount; i < treeCount + bushCount; i++)
+		{
+			objects.push_back(bush.at(i));
 		}
-	}
 
-	shuffle(treeBase.begin(), treeBase.end(), std::default_random_engine(seed));
-	shuffle(treeTop.begin(), treeTop.end(), std::default_random_engine(seed));
-	shuffle(bush.begin(), bush.end(), std::default_random_engine(seed));
-	shuffle(quads.begin(), quads.end(), std::default_random_engine(seed));
+		objects.push_back(moon);
+		objects.push_back(ground);
+	}, { placeObjects, uploadTerrain, setUpCameraAndLight });
 
-	// add the items will be rendered to the objects vector
-	for (int i = 0; i < treeCount; i++)
-	{
-		objects.push_back(treeBase.at(i));
-		objects.push_back(treeTop.at(i));
-	}
+	graph.Run();
+	graph.PrintReport();
 
-	for (int i = treeCount; i < treeCount + bushCount; i++)
-	{
-		objects.push_back(bush.at(i));
-	}
+	// Every generated mesh was reordered for the vertex cache on its way to the GPU.
+	meshCache->PrintStatistics();
+	MeshOptimizer::PrintStatistics("terrain " + to_string(groundSizeX) + "x" + to_string(groundSizeZ), ground->GetVertexCount(), ground->GetIndexCount() / 3,
+		ground->GetGeneratedCacheStatistics(), ground->GetOptimizedCacheStatistics());
 
 	// set coordinates for possible generated item placements into a vector and shuffle the vector using the system clock as the seed
 	//for (int i = 0; i < groundSizeX / 3; i++)
@@ -757,8 +1222,6 @@ void initScene()
 	objects.push_back(cube2);
 	objects.push_back(cube3);
 	objects.push_back(cube5);*/
-	objects.push_back(moon);
-	objects.push_back(ground);
 
 	// Other OpenGL states to set once
 	glEnable(GL_DEPTH_TEST);
@@ -770,39 +1233,24 @@ void initScene()
 
 void setUpLightForShadows(Light light)
 {
-	// Set the light projection matrix in the textured shader.
-	SetUniformMat4(texturedShaderProgram, "lightSpaceMatrix", light.lightSpaceMatrix);
-	SetUniformMat4(groundShaderProgram, "lightSpaceMatrix", light.lightSpaceMatrix);
-
-	SetUniformVec3(texturedShaderProgram, "light_position", light.position);
-	SetUniformVec3(groundShaderProgram, "light_position", light.position);
-
-	SetUniformVec3(texturedShaderProgram, "light_direction", light.direction);
-	SetUniformVec3(groundShaderProgram, "light_direction", light.direction);
-
-	// Set light related parameters in shadow shader.
-	glUseProgram(shadowShaderProgram);
-	SetUniformMat4(shadowShaderProgram, "lightSpaceMatrix", light.lightSpaceMatrix);
+	// The light projection matrices come from the shadow cascades, updated every frame.
+	for (GLuint program : litShaderPrograms)
+	{
+		SetUniformVec3(program, "light_position", light.position);
+		SetUniformVec3(program, "light_direction", light.direction);
+	}
 }
 
 void initShadows() // All shadowcasting code references https://learnopengl.com/Advanced-Lighting/Shadows/Point-Shadows.
 {
-	// Create and configure the depth map.
-	glGenTextures(1, &shadowMapTexture);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, shadowMapTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_TEXTURE_WIDTH, SHADOW_TEXTURE_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	// Create the depth texture array and its framebuffer, one layer per cascade.
+	shadowCascades = new ShadowCascades(SHADOW_CASCADE_COUNT, SHADOW_TEXTURE_SIZE);
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-	// Attach depth cubemap to framebuffer.
-	glGenFramebuffers(1, &shadowMapFBO);
-	glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, shadowMapTexture, 0);
-	glDrawBuffer(GL_NONE);
+	for (GLuint program : litShaderPrograms)
+	{
+		glUseProgram(program);
+		glUniform1i(glGetUniformLocation(program, "cascadeCount"), shadowCascades->GetCascadeCount());
+	}
 
 
 	// Set up light clip information in shadow shader.
@@ -811,242 +1259,440 @@ void initShadows() // All shadowcasting code references https://learnopengl.com/
 	SetUniform1Value(shadowShaderProgram, "light_far_plane", light_far_plane);
 }
 
-
-void renderScene(GLuint shaderProgram)
+// Only the programs of the current quality level are updated, the level can only change between frames.
+void setShadowCascadeUniforms()
 {
-	// Update light.
+	int cascadeCount = shadowCascades->GetCascadeCount();
+	const GLuint programs[] = { texturedShaderProgram, groundShaderProgram };
+	for (GLuint program : programs)
+	{
+		glUseProgram(program);
+		glUniformMatrix4fv(glGetUniformLocation(program, "cascadeMatrices"), cascadeCount, GL_FALSE, &shadowCascades->GetMatrices()[0][0][0]);
+		glUniform1fv(glGetUniformLocation(program, "cascadeSplits"), cascadeCount, shadowCascades->GetSplitDistances());
+	}
+}
 
 
-	// Draw geometry
+void initRenderQueue()
+{
+	// Point the samplers of each program at fixed texture units once, the render queue only binds textures.
+	vector<GLuint> texturedPermutations(texturedShaderPrograms, texturedShaderPrograms + ShaderQualityCount);
+	texturedPermutations.push_back(skyShaderProgram);
+	for (GLuint program : texturedPermutations)
+	{
+		glUseProgram(program);
+		glUniform1i(glGetUniformLocation(program, "shadowMap"), SHADOW_MAP_TEXTURE_UNIT);
+		glUniform1i(glGetUniformLocation(program, "textureSampler"), 0);
+		glUniform1i(glGetUniformLocation(program, "normalSampler"), 2);
+	}
 
-	// Handle textures.
-	glUseProgram(shaderProgram);
+	for (GLuint program : groundShaderPrograms)
+	{
+		glUseProgram(program);
+		glUniform1i(glGetUniformLocation(program, "shadowMap"), SHADOW_MAP_TEXTURE_UNIT);
+		glUniform1i(glGetUniformLocation(program, "textureSamplerA"), 1);
+		glUniform1i(glGetUniformLocation(program, "textureSamplerB"), 2);
+		glUniform1i(glGetUniformLocation(program, "depthSamplerA"), 3);
+		glUniform1i(glGetUniformLocation(program, "depthSamplerB"), 4);
+		glUniform1i(glGetUniformLocation(program, "normalSamplerA"), 5);
+		glUniform1i(glGetUniformLocation(program, "normalSamplerB"), 6);
+	}
+	glUseProgram(0);
 
-	// Set ground shader textures.
-	// -> Texture A.
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, groundLowTextureID);
-	GLuint textureLocation = glGetUniformLocation(shaderProgram, "textureSamplerA");
-	glUniform1i(textureLocation, 1);
+	renderQueue.SetTextureManager(textureManager);
+	renderQueue.RegisterProgram(shadowShaderProgram);
+	renderQueue.RegisterProgram(depthShaderProgram);
+	for (GLuint program : litShaderPrograms)
+		renderQueue.RegisterProgram(program);
+
+	// Materials.
+	RenderMaterial material;
+	material.AddTexture(1, groundLowTextureID);
+	material.AddTexture(2, groundHighTextureID);
+	material.AddTexture(3, groundLowDepthTextureID);
+	material.AddTexture(4, groundHighDepthTextureID);
+	material.AddTexture(5, groundLowNormalTextureID);
+	material.AddTexture(6, groundHighNormalTextureID);
+	groundMaterial = renderQueue.AddMaterial(material);
+
+	material = RenderMaterial();
+	material.AddTexture(0, skyboxTextureID);
+	material.AddTexture(2, bushNTextureID);
+	skyboxMaterial = renderQueue.AddMaterial(material);
+
+	material = RenderMaterial();
+	material.AddTexture(0, moonTextureID);
+	material.AddTexture(2, bushNTextureID);
+	moonMaterial = renderQueue.AddMaterial(material);
+
+	material = RenderMaterial();
+	material.AddTexture(0, bushTextureID);
+	material.AddTexture(2, bushNTextureID);
+	bushMaterial = renderQueue.AddMaterial(material);
+
+	material = RenderMaterial();
+	material.AddTexture(0, grassTextureID);
+	material.AddTexture(2, bushNTextureID);
+	grassMaterial = renderQueue.AddMaterial(material);
+
+	// Trees pick their bark and leaves variations from the seed. Pick them once here rather than every frame.
+	unsigned int barkMaterials[2][2];
+	for (int colour = 0; colour < 2; colour++)
+	{
+		for (int normal = 0; normal < 2; normal++)
+		{
+			material = RenderMaterial();
+			material.AddTexture(0, colour == 0 ? bark001TextureID : bark012TextureID);
+			material.AddTexture(2, normal == 0 ? bark001NTextureID : bark012NTextureID);
+			barkMaterials[colour][normal] = renderQueue.AddMaterial(material);
+		}
+	}
 
-	glActiveTexture(GL_TEXTURE3);
-	glBindTexture(GL_TEXTURE_2D, groundLowDepthTextureID);
-	textureLocation = glGetUniformLocation(shaderProgram, "depthSamplerA");
-	glUniform1i(textureLocation, 3);
+	unsigned int leavesMaterials[2];
+	for (int colour = 0; colour < 2; colour++)
+	{
+		material = RenderMaterial();
+		material.AddTexture(0, colour == 0 ? leaves02TextureID : leaves01TextureID);
+		material.AddTexture(2, groundLowNormalTextureID);
+		leavesMaterials[colour] = renderQueue.AddMaterial(material);
+	}
 
-	glActiveTexture(GL_TEXTURE5);
-	glBindTexture(GL_TEXTURE_2D, groundLowNormalTextureID);
-	textureLocation = glGetUniformLocation(shaderProgram, "normalSamplerA");
-	glUniform1i(textureLocation, 5);
+	for (int i = 0; i < treeCount; i++)
+	{
+		srand(seed * (i + 1));
+		int colour = (rand() % 2 != 1) ? 0 : 1;
+		int normal = (rand() % 2 != 1) ? 0 : 1;
+		treeBaseMaterials.push_back(barkMaterials[colour][normal]);
 
-	// -> Texture B.
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, groundHighTextureID);
-	textureLocation = glGetUniformLocation(shaderProgram, "textureSamplerB");
-	glUniform1i(textureLocation, 2);
+		srand(seed * i);
+		treeTopMaterials.push_back(leavesMaterials[(rand() % 2 != 1) ? 0 : 1]);
+	}
+}
 
-	glActiveTexture(GL_TEXTURE4);
-	glBindTexture(GL_TEXTURE_2D, groundHighDepthTextureID);
-	textureLocation = glGetUniformLocation(shaderProgram, "depthSamplerB");
-	glUniform1i(textureLocation, 4);
+void initCulling()
+{
+	// The ground's heights are noise in [-5, 5] plus variations under 0.625, so they stay within [-5, 6].
+	vec3 groundHalfSize = vec3((float)groundSizeX / 2, 5.5f, (float)groundSizeZ / 2);
+	vec3 groundCenter = vec3(groundHalfSize.x, 0.5f, groundHalfSize.z);
+	groundBounds = sceneBounds.Add(ground->GetWorldMatrix(), groundCenter, length(groundHalfSize));
 
-	glActiveTexture(GL_TEXTURE6);
-	glBindTexture(GL_TEXTURE_2D, groundHighNormalTextureID);
-	textureLocation = glGetUniformLocation(shaderProgram, "normalSamplerB");
-	glUniform1i(textureLocation, 6);
+	moonBounds = sceneBounds.Add(moon->GetWorldMatrix(), sphereBoundsCenter, sphereBoundsRadius);
 
+	treeBaseBounds = sceneBounds.GetCount();
+	for (int i = 0; i < treeCount; i++)
+		sceneBounds.Add(treeBase.at(i)->GetWorldMatrix(), cubeBoundsCenter, cubeBoundsRadius);
 
-	// Draw ground. Object has it's own VAO
-	ground->Draw(shaderProgram, meshRenderMode);
+	treeTopBounds = sceneBounds.GetCount();
+	for (int i = 0; i < treeCount; i++)
+		sceneBounds.Add(treeTop.at(i)->GetWorldMatrix(), sphereBoundsCenter, sphereBoundsRadius);
 
+	// Bushes are drawn from index treeCount onwards.
+	bushBounds = sceneBounds.GetCount();
+	for (int i = treeCount; i < treeCount + bushCount; i++)
+		sceneBounds.Add(bush.at(i)->GetWorldMatrix(), sphereBoundsCenter, sphereBoundsRadius);
 
-	// Render objects.
+	canopyLods.Resize(treeCount);
+	bushLods.Resize(bushCount);
 
-	// Binding CUBE vertex array Object
-	glBindVertexArray(cubeVAO);
+	// Grass quads only ever rotate about their center, their bounds never change.
+	grassBounds = sceneBounds.GetCount();
+	for (int i = 0; i < grassCount; i++)
+		sceneBounds.Add(quads.at(i)->GetWorldMatrix(), quadBoundsCenter, quadBoundsRadius);
+}
 
-	// render treeBases
+void initOcclusion()
+{
+	occlusionCuller = new OcclusionCuller();
+
+	// The coarse terrain sits below the real one, it can only hide less than the ground does.
+	vector<vec3> positions;
+	vector<unsigned int> indices;
+	ground->BuildOccluderMesh(OCCLUDER_TERRAIN_STEP, positions, indices);
+	unsigned int terrainMesh = occlusionCuller->AddMesh(positions, indices);
+	vec4 groundSphere = sceneBounds.GetSphere(groundBounds);
+	occlusionCuller->AddOccluder(terrainMesh, ground->GetWorldMatrix(), vec3(groundSphere), groundSphere.w);
+
+	// Trunks are the unit cube the tree bases are drawn with, [-0.5, 0.5] x [0, 1] x [-0.5, 0.5].
+	vector<vec3> cubePositions;
+	for (int corner = 0; corner < 8; corner++)
+		cubePositions.push_back(vec3((corner & 1) ? 0.5f : -0.5f, (corner & 2) ? 1.0f : 0.0f, (corner & 4) ? 0.5f : -0.5f));
+	vector<unsigned int> cubeIndices = {
+		0, 1, 3, 0, 3, 2, // Bottom.
+		4, 6, 7, 4, 7, 5, // Top.
+		0, 4, 5, 0, 5, 1, // Back.
+		2, 3, 7, 2, 7, 6, // Front.
+		0, 2, 6, 0, 6, 4, // Left.
+		1, 5, 7, 1, 7, 3  // Right.
+	};
+	unsigned int trunkMesh = occlusionCuller->AddMesh(cubePositions, cubeIndices);
 	for (int i = 0; i < treeCount; i++)
 	{
-		//set treeBase texture
-		if (shaderProgram != shadowShaderProgram)
-		{
-			//cout << "Not in shadow pass.\n";
-			shaderProgram = texturedShaderProgram;
-			glUseProgram(shaderProgram);
+		vec4 trunkSphere = sceneBounds.GetSphere(treeBaseBounds + i);
+		occlusionCuller->AddOccluder(trunkMesh, treeBase.at(i)->GetWorldMatrix(), vec3(trunkSphere), trunkSphere.w);
+	}
+}
+
+void initImpostors()
+{
+	// Trees with the same bark and leaves share their pictures.
+	for (int i = 0; i < treeCount; i++)
+	{
+		pair<unsigned int, unsigned int> materials(treeBaseMaterials[i], treeTopMaterials[i]);
+		size_t variant = find(impostorVariantMaterials.begin(), impostorVariantMaterials.end(), materials) - impostorVariantMaterials.begin();
+		if (variant == impostorVariantMaterials.size())
+			impostorVariantMaterials.push_back(materials);
+
+		// The quad stands on the trunk's base, as wide as the canopy and up to its top.
+		vec3 trunkScale = treeBase.at(i)->GetScaling();
+		vec3 canopyScale = treeTop.at(i)->GetScaling();
+		ImpostorAtlas::Instance instance;
+		instance.position = treeBase.at(i)->GetPosition();
+		instance.variant = (float)variant;
+		instance.size = vec2(2.0f * std::max(canopyScale.x, canopyScale.z) * sphereBoundsRadius, trunkScale.y + (sphereBoundsCenter.y + sphereBoundsRadius) * canopyScale.y);
+		treeImpostorInstances.push_back(instance);
+	}
+	treeImpostors.Resize(treeCount);
 
-			glActiveTexture(GL_TEXTURE0);
+	impostorAtlas = new ImpostorAtlas(std::max((int)impostorVariantMaterials.size(), 1), IMPOSTOR_CELL_WIDTH, IMPOSTOR_CELL_HEIGHT);
 
-			srand(seed * (i+1));
-			if (rand() % 2 != 1)
-			{
-				glBindTexture(GL_TEXTURE_2D, bark001TextureID);
-			}
-			else
-			{
-				glBindTexture(GL_TEXTURE_2D, bark012TextureID);
-			}
-			GLuint textureLocation = glGetUniformLocation(shaderProgram, "textureSampler");
-			glUniform1i(textureLocation, 0);
+	glUseProgram(impostorBakeShaderProgram);
+	glUniform1i(glGetUniformLocation(impostorBakeShaderProgram, "textureSampler"), 0);
+	glUseProgram(0);
 
-			glActiveTexture(GL_TEXTURE2);
-			if (rand() % 2 != 1)
-			{
-				glBindTexture(GL_TEXTURE_2D, bark001NTextureID);
-			}
-			else
-			{
-				glBindTexture(GL_TEXTURE_2D, bark012NTextureID);
-			}
-			textureLocation = glGetUniformLocation(shaderProgram, "normalSampler");
-			glUniform1i(textureLocation, 2);
+	bakeImpostors();
+}
+
+// Render every variant of the average tree from every view of the atlas, through the render queue so the materials bind as usual.
+void bakeImpostors()
+{
+	PROFILE_FUNCTION();
+	if (!impostorAtlas->IsComplete())
+		return;
+
+	mat4 trunkMatrix = scale(mat4(1.0f), IMPOSTOR_TRUNK_SCALE);
+	mat4 canopyMatrix = translate(mat4(1.0f), vec3(0.0f, IMPOSTOR_TRUNK_SCALE.y, 0.0f)) * scale(mat4(1.0f), IMPOSTOR_CANOPY_SCALE);
+	float radius = std::max(IMPOSTOR_CANOPY_SCALE.x, IMPOSTOR_CANOPY_SCALE.z) * sphereBoundsRadius;
+	float top = IMPOSTOR_TRUNK_SCALE.y + (sphereBoundsCenter.y + sphereBoundsRadius) * IMPOSTOR_CANOPY_SCALE.y;
+
+	renderQueue.SetProfiler(nullptr);
+	glCullFace(GL_BACK);
+	impostorAtlas->BeginBake();
+	for (int view = 0; view < ImpostorAtlas::ViewCount; view++)
+	{
+		mat4 bakeViewMatrix, bakeProjectionMatrix;
+		ImpostorAtlas::GetViewMatrices(view, radius, 0.0f, top, bakeViewMatrix, bakeProjectionMatrix);
+		setViewMatrix(impostorBakeShaderProgram, bakeViewMatrix);
+		setProjectionMatrix(impostorBakeShaderProgram, bakeProjectionMatrix);
+
+		for (size_t variant = 0; variant < impostorVariantMaterials.size(); variant++)
+		{
+			impostorAtlas->BindCell(view, (int)variant);
+			renderQueue.Clear();
+			renderQueue.SubmitIndexed(RenderQueue::Opaque, impostorBakeShaderProgram, cubeMesh->vertexArray, impostorVariantMaterials[variant].first, 0.0f, trunkMatrix, cubeMesh->indexCount, cubeMesh->indexType);
+			renderQueue.SubmitIndexed(RenderQueue::Opaque, impostorBakeShaderProgram, sphereMeshes[0]->vertexArray, impostorVariantMaterials[variant].second, 0.0f, canopyMatrix, sphereMeshes[0]->indexCount, sphereMeshes[0]->indexType);
+			renderQueue.Sort();
+			renderQueue.Execute();
 		}
-		treeBase.at(i)->Draw(shaderProgram, meshRenderMode);
 	}
+	impostorAtlas->EndBake();
+	glBindVertexArray(0);
+}
 
-	// Binding SPHERE vertex array object
-	glBindVertexArray(sphereVAO);
-
-	if (shaderProgram != shadowShaderProgram)
+// Pick the level of detail of every canopy and bush, and the trees drawn as impostors, from the camera.
+// Once per frame so the depth pre-pass and the main pass agree.
+void selectMeshLods()
+{
+	PROFILE_FUNCTION();
+	for (int i = 0; i < treeCount; i++)
+	{
+		vec4 sphere = sceneBounds.GetSphere(treeTopBounds + i);
+		float pixelRadius = LodSelector::ProjectedRadius(sphere.w, distance(vec3(sphere), cameraPosition), projectionMatrix, windowHeigth);
+		canopyLods.Select(i, useMeshLods ? pixelRadius : FLT_MAX);
+		treeImpostors.Select(i, useImpostors ? pixelRadius : FLT_MAX);
+	}
+	for (int i = 0; i < bushCount; i++)
 	{
-		//cout << "Not in shadow pass.\n";
-		shaderProgram = texturedShaderProgram;
-		glUseProgram(shaderProgram);
+		vec4 sphere = sceneBounds.GetSphere(bushBounds + i);
+		float pixelRadius = LodSelector::ProjectedRadius(sphere.w, distance(vec3(sphere), cameraPosition), projectionMatrix, windowHeigth);
+		bushLods.Select(i, useMeshLods ? pixelRadius : FLT_MAX);
+	}
+}
 
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, skyboxTextureID);
-		GLuint textureLocation = glGetUniformLocation(shaderProgram, "textureSampler");
-		glUniform1i(textureLocation, 0);
+// Window title readout of the canopies and bushes drawn at each level by the camera, twice a second.
+void updateLodOverlay()
+{
+	double time = glfwGetTime();
+	if (time < lodOverlayUpdateTime)
+		return;
+	lodOverlayUpdateTime = time + 0.5;
+
+	ostringstream title;
+	title << WINDOW_TITLE << " | LOD " << (useMeshLods ? "on" : "off") << ", canopies";
+	for (int lod = 0; lod < MeshCache::SphereLodCount; lod++)
+		title << " " << lodDrawCounts[0][lod];
+	title << ", bushes";
+	for (int lod = 0; lod < MeshCache::SphereLodCount; lod++)
+		title << " " << lodDrawCounts[1][lod];
+	title << " | " << impostorDrawCount << " impostors | " << renderQueue.GetStatistics().triangles << " triangles";
+	glfwSetWindowTitle(window, title.str().c_str());
+}
 
-		glActiveTexture(GL_TEXTURE2);
-		glBindTexture(GL_TEXTURE_2D, bushNTextureID);
-		textureLocation = glGetUniformLocation(shaderProgram, "normalSampler");
-		glUniform1i(textureLocation, 2);
-	}
+// Queue a model drawn from its own indexed vertex array, sorted by its distance to the point of view. The section times it when the queue has a profiler.
+void submitModel(Model* model, RenderQueue::EPass pass, GLuint shaderProgram, GLuint vertexArray, unsigned int material, int indexCount, vec3 viewPosition, GLenum renderingMode, int section = -1)
+{
+	renderQueue.SubmitIndexed(pass, shaderProgram, vertexArray, material, distance(model->GetPosition(), viewPosition), model->GetWorldMatrix(), indexCount, GL_UNSIGNED_INT, renderingMode, section);
+}
 
-	// Drawing the skybox as always triangles
-	skybox->Draw(shaderProgram, sphereVertexCount, GL_TRIANGLES);
+// Same for a model drawn with a cached mesh, from its position only copy when the pass reads nothing else.
+void submitMesh(Model* model, RenderQueue::EPass pass, GLuint shaderProgram, const MeshCache::Mesh& mesh, bool positionOnly, unsigned int material, vec3 viewPosition, GLenum renderingMode, int section = -1)
+{
+	GLuint vertexArray = positionOnly ? mesh.positionVertexArray : mesh.vertexArray;
+	renderQueue.SubmitIndexed(pass, shaderProgram, vertexArray, material, distance(model->GetPosition(), viewPosition), model->GetWorldMatrix(), mesh.indexCount, mesh.indexType, renderingMode, section);
+}
 
-	if (shaderProgram != shadowShaderProgram)
+// Draw the scene as seen through viewProjectionMatrix, a shadow cascade or the camera. Draws are sorted by distance to viewPosition.
+// The moon is the only dynamic object, everything else is static.
+void renderScene(GLuint shaderProgram, const mat4& viewProjectionMatrix, vec3 viewPosition, ERenderSubset subset)
+{
+	PROFILE_ZONE("renderScene");
+
+	// The shadow pass and the depth pre-pass draw everything with their own program and no textures.
+	bool shadowPass = shaderProgram == shadowShaderProgram;
+	bool depthPrePass = shaderProgram == depthShaderProgram;
+	bool positionOnly = shadowPass || depthPrePass;
+	GLuint objectShaderProgram = positionOnly ? shaderProgram : texturedShaderProgram;
+	GLuint skyObjectShaderProgram = positionOnly ? shaderProgram : skyShaderProgram;
+	bool renderStatic = subset != RenderDynamic;
+	bool renderDynamic = subset != RenderStatic;
+
+	// Those programs only read positions, so they draw from the position only meshes.
+	GLuint groundVertexArray = positionOnly ? ground->GetShadowVAO() : ground->GetVAO();
+	// The sky and the moon are always drawn at full detail.
+	const MeshCache::Mesh& sphereMesh = *sphereMeshes[0];
+
+	// Cull against the frustum of the point of view.
+	unsigned int visibleCount = sceneBounds.Cull(Frustum::FromMatrix(viewProjectionMatrix), sceneVisibility);
+	if (!useFrustumCulling)
 	{
-		//cout << "Not in shadow pass.\n";
-		shaderProgram = texturedShaderProgram;
-		glUseProgram(shaderProgram);
+		std::fill(sceneVisibility.begin(), sceneVisibility.end(), 1);
+		visibleCount = sceneBounds.GetCount();
+	}
 
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, moonTextureID);
-		GLuint textureLocation = glGetUniformLocation(shaderProgram, "textureSampler");
-		glUniform1i(textureLocation, 0);
+	// Only the camera is occlusion culled. Points and lines leave the occluders see through.
+	if (!shadowPass && useOcclusionCulling && meshRenderMode == GL_TRIANGLES)
+	{
+		occludedCount = occlusionCuller->Cull(sceneBounds, sceneVisibility);
+		visibleCount -= occludedCount;
+	}
+	else if (!shadowPass)
+	{
+		occludedCount = 0;
 	}
 
-	// Drawing Moon
-	spinning += 5.0f * dt;
-	mat4 center = translate(mat4(1.0f), vec3(0.0f)) * rotate(mat4(1.0f), radians(spinning), VECTOR_UP);
+	if (shadowPass)
+		shadowVisibleCount += visibleCount;
+	else
+		cameraVisibleCount = visibleCount;
 
-	moon->UpdateRotation(vec3(0.0f, radians(0.5f), 0.0f));
-	moon->SetParent(center);
+	// Only the camera pass is split into object groups: the shadow and pre-pass sections are timed as a whole.
+	renderQueue.SetProfiler(positionOnly ? nullptr : gpuProfiler);
+	if (!positionOnly)
+		std::fill(&lodDrawCounts[0][0], &lodDrawCounts[0][0] + 2 * MeshCache::SphereLodCount, 0u);
+	int shadowSphereLod = useMeshLods ? SHADOW_SPHERE_LOD : 0;
+	renderQueue.Clear();
 
-	moon->Draw(shaderProgram, sphereVertexCount, meshRenderMode);
+	// Draw ground. Object has it's own VAO
+	if (renderStatic && sceneVisibility[groundBounds])
+		submitModel(ground, RenderQueue::Opaque, shaderProgram, groundVertexArray, positionOnly ? 0 : groundMaterial, ground->GetIndexCount(), viewPosition, meshRenderMode, gpuSections.ground);
 
-	//render treeTops
+	// Render objects.
+
+	// Impostors are chosen from the camera, but shadows are cached in the static layer: every tree casts its shadow as a full mesh,
+	// so the cached shadows do not depend on where the camera was when they were drawn.
+	// render treeBases
 	for (int i = 0; i < treeCount; i++)
 	{
-		// set treeTop texture
-		if (shaderProgram != shadowShaderProgram)
-		{
-			//cout << "Not in shadow pass.\n";
-			shaderProgram = texturedShaderProgram;
-			glUseProgram(shaderProgram);
-
-			glActiveTexture(GL_TEXTURE0);
-
-			srand(seed * i);
-			if (rand() % 2 != 1)
-			{
-				glBindTexture(GL_TEXTURE_2D, leaves02TextureID);
-			}
-			else 
-			{
-				glBindTexture(GL_TEXTURE_2D, leaves01TextureID);
-			}
-			GLuint textureLocation = glGetUniformLocation(shaderProgram, "textureSampler");
-			glUniform1i(textureLocation, 0);
-
-			glActiveTexture(GL_TEXTURE2);
-			glBindTexture(GL_TEXTURE_2D, groundLowNormalTextureID);
-			textureLocation = glGetUniformLocation(shaderProgram, "normalSampler");
-			glUniform1i(textureLocation, 2);
-		}
-		treeTop.at(i)->Draw(shaderProgram, sphereVertexCount, meshRenderMode);
+		if (renderStatic && (shadowPass || treeImpostors.GetLevel(i) == 0) && sceneVisibility[treeBaseBounds + i])
+			submitMesh(treeBase.at(i), RenderQueue::Opaque, objectShaderProgram, *cubeMesh, positionOnly, positionOnly ? 0 : treeBaseMaterials[i], viewPosition, meshRenderMode, gpuSections.treeTrunks);
 	}
 
-	// set bush texture
-	if (shaderProgram != shadowShaderProgram)
-	{
-		//cout << "Not in shadow pass.\n";
-		shaderProgram = texturedShaderProgram;
-		glUseProgram(shaderProgram);
+	// Drawing the skybox as always triangles. It surrounds the whole scene, so it is never culled.
+	// It casts no shadow, and the cascade cameras can sit outside of it where it would cover every shadow map.
+	if (renderStatic && !shadowPass)
+		submitMesh(skybox, RenderQueue::Opaque, skyObjectShaderProgram, sphereMesh, positionOnly, positionOnly ? 0 : skyboxMaterial, viewPosition, GL_TRIANGLES, gpuSections.sky);
 
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, bushTextureID);
-		GLuint textureLocation = glGetUniformLocation(shaderProgram, "textureSampler");
-		glUniform1i(textureLocation, 0);
+	if (renderDynamic && sceneVisibility[moonBounds])
+		submitMesh(moon, RenderQueue::Opaque, skyObjectShaderProgram, sphereMesh, positionOnly, positionOnly ? 0 : moonMaterial, viewPosition, meshRenderMode, gpuSections.sky);
 
-		glActiveTexture(GL_TEXTURE2);
-		glBindTexture(GL_TEXTURE_2D, bushNTextureID);
-		textureLocation = glGetUniformLocation(shaderProgram, "normalSampler");
-		glUniform1i(textureLocation, 2);
+	//render treeTops
+	for (int i = 0; i < treeCount; i++)
+	{
+		if (renderStatic && (shadowPass || treeImpostors.GetLevel(i) == 0) && sceneVisibility[treeTopBounds + i])
+		{
+			int lod = shadowPass ? shadowSphereLod : canopyLods.GetLevel(i);
+			submitMesh(treeTop.at(i), RenderQueue::Opaque, objectShaderProgram, *sphereMeshes[lod], positionOnly, positionOnly ? 0 : treeTopMaterials[i], viewPosition, meshRenderMode, gpuSections.treeTops);
+			if (!positionOnly)
+				lodDrawCounts[0][lod]++;
+		}
 	}
 
 	// render bushes
 	for (int i = treeCount; i < treeCount + bushCount; i++)
 	{
-		bush.at(i)->Draw(shaderProgram, sphereVertexCount, meshRenderMode);
+		if (renderStatic && sceneVisibility[bushBounds + i - treeCount])
+		{
+			int lod = shadowPass ? shadowSphereLod : bushLods.GetLevel(i - treeCount);
+			submitMesh(bush.at(i), RenderQueue::Opaque, objectShaderProgram, *sphereMeshes[lod], positionOnly, positionOnly ? 0 : bushMaterial, viewPosition, meshRenderMode, gpuSections.bushes);
+			if (!positionOnly)
+				lodDrawCounts[1][lod]++;
+		}
 	}
-	
-	glBindVertexArray(quadVAO);
 
-	//set grass texture
-	if (shaderProgram != shadowShaderProgram)
+	//render grass, alpha tested so it goes last.
+	// The quads turn to face the camera every frame, so in the shadow pass they are dynamic casters, redrawn with the moon.
+	// They are left out of the depth pre-pass, which would write the depth of their transparent texels.
+	bool renderGrass = shadowPass ? renderDynamic : renderStatic;
+	for (int i = 0; i < grassCount; i++)
 	{
-		//cout << "not in shadow pass.\n";
-		shaderProgram = texturedShaderProgram;
-		glUseProgram(shaderProgram);
+		if (renderGrass && !depthPrePass && sceneVisibility[grassBounds + i])
+			submitMesh(quads.at(i), RenderQueue::AlphaTested, objectShaderProgram, *quadMesh, positionOnly, positionOnly ? 0 : grassMaterial, viewPosition, meshRenderMode, gpuSections.grass);
+	}
 
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, grassTextureID);
-		GLuint texturelocation = glGetUniformLocation(shaderProgram, "texturesampler");
-		glUniform1i(texturelocation, 0);
+	renderQueue.Sort();
 
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, grassTextureID);
-		texturelocation = glGetUniformLocation(shaderProgram, "normalsampler");
-		glUniform1i(texturelocation, 2);
+	PROFILE_ZONE("renderScene execute");
+	if (useDepthPrePass && !positionOnly)
+	{
+		// The pre-pass already holds the nearest opaque depth of every pixel: only that fragment passes, and there is nothing to write.
+		glDepthFunc(GL_EQUAL);
+		glDepthMask(GL_FALSE);
+		renderQueue.Execute(RenderQueue::Opaque);
+		glDepthFunc(GL_LESS);
+		glDepthMask(GL_TRUE);
+
+		renderQueue.Execute(RenderQueue::AlphaTested);
 	}
-	//render grass
-	for (int i = 0; i < grassCount; i++)
+	else
 	{
-		quads.at(i)->Draw(shaderProgram, meshRenderMode);
+		renderQueue.Execute();
 	}
 
-	//quad->Draw(shaderProgram, meshRenderMode);
-
-	//// > Base.
-	//float groundCenterX{ 0 - (float)groundSizeX / 2 };
-	//float groundCenterZ{ 0 - (float)groundSizeZ / 2 };
-
-	//mat4 groundBaseMatrix = translate(mat4(1.0f), vec3(groundCenterX, 0.0f, groundCenterZ));
-	//GLuint worldMatrixLocation = glGetUniformLocation(shaderProgram, "worldMatrix");
-	//glUniformMatrix4fv(worldMatrixLocation, 1, GL_FALSE, &groundBaseMatrix[0][0]);
-	//glDrawArrays(meshRenderMode, 0, 6 * groundSizeX * groundSizeZ);
-
-	// Objects will likely have to inherit the ground's transform as to follow its coordinates.
-	// Or we only draw the world in the positive X, positive Z quadrants.
+	// Impostors are alpha tested, so they are left out of the depth pre-pass like the grass. They come last, in one instanced draw.
+	// Visible when their trunk or their canopy is. The shadow pass drew their trees instead.
+	if (renderStatic && !positionOnly)
+	{
+		impostorInstances.clear();
+		for (int i = 0; i < treeCount; i++)
+		{
+			if (treeImpostors.GetLevel(i) > 0 && (sceneVisibility[treeBaseBounds + i] || sceneVisibility[treeTopBounds + i]))
+				impostorInstances.push_back(treeImpostorInstances[i]);
+		}
 
-	//mat4 cubeBaseMatrix = translate(mat4(1.0f), vec3(0.0f, 2.0f, 0.0f));
-	//GLuint worldMatrixLocation = glGetUniformLocation(shaderProgram, "worldMatrix");
-	//glUniformMatrix4fv(worldMatrixLocation, 1, GL_FALSE, &cubeBaseMatrix[0][0]);
-	//glDrawArrays(meshRenderMode, 0, 36);
+		impostorDrawCount = (unsigned int)impostorInstances.size();
+		gpuProfiler->Begin(gpuSections.impostors);
+		impostorAtlas->Draw(impostorShaderProgram, viewProjectionMatrix, viewPosition, impostorInstances, *streamingBuffer);
+		gpuProfiler->End();
+	}
 
 	// Unbind vertex array.
 	glBindVertexArray(0);
@@ -1056,6 +1702,8 @@ void renderScene(GLuint shaderProgram)
 // To do: better camera controls.
 void handleInputs()
 {
+	PROFILE_ZONE("handleInputs");
+
 	// Detect inputs
 	glfwPollEvents();
 
@@ -1207,16 +1855,105 @@ void handleInputs()
 	if (previousPPress == GLFW_RELEASE && glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS)
 	{
 		meshRenderMode = GL_POINTS;
+		shadowCascades->InvalidateStaticLayers();
 	}
 	// Press 'L' to change the world's rendering mode to lines.
 	if (previousLPress == GLFW_RELEASE && glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS)
 	{
 		meshRenderMode = GL_LINE_LOOP;
+		shadowCascades->InvalidateStaticLayers();
 	}
 	// Press 'T' to change the world's rendering mode to triangles.
 	if (previousTPress == GLFW_RELEASE && glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS)
 	{
 		meshRenderMode = GL_TRIANGLES;
+		shadowCascades->InvalidateStaticLayers();
+	}
+
+	// Press 'R' to print the render queue statistics of the last frame.
+	if (previousRPress == GLFW_RELEASE && glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS)
+	{
+		renderQueue.PrintStatistics();
+		cout << "Frustum culling " << (useFrustumCulling ? "on" : "off") << ": " << cameraVisibleCount << " of " << sceneBounds.GetCount() << " objects visible to the camera, "
+			<< shadowVisibleCount << " drawn into the shadow cascades.\n";
+		cout << "Shadow cascades: " << staticShadowLayersRendered << " of " << shadowCascades->GetCascadeCount() << " static layers rendered in the last frame, "
+			<< shadowCascades->GetStaticLayerRenderCount() << " since startup.\n";
+		cout << "Occlusion culling " << (useOcclusionCulling ? "on" : "off") << ": " << occludedCount << " objects hidden, "
+			<< occlusionCuller->GetOccludersRendered() << " occluders and " << occlusionCuller->GetTrianglesRendered() << " triangles rasterized.\n";
+		streamingBuffer->PrintStatistics();
+		textureManager->PrintStatistics();
+		cout << "Depth pre-pass " << (useDepthPrePass ? "on" : "off") << ", " << shaderQualityNames[shaderQuality] << " shader quality.\n";
+		cout << "Mesh LODs " << (useMeshLods ? "on" : "off") << ", canopies and bushes drawn per level:";
+		for (int lod = 0; lod < MeshCache::SphereLodCount; lod++)
+			cout << " " << lodDrawCounts[0][lod] << "/" << lodDrawCounts[1][lod];
+		cout << ".\n";
+		cout << "Impostors " << (useImpostors ? "on" : "off") << ", " << impostorDrawCount << " trees drawn as impostors by the camera, "
+			<< impostorAtlas->GetVariantCount() << " variants baked.\n";
+		gpuProfiler->PrintSummary();
+	}
+
+	// Press 'Z' to toggle the depth pre-pass. The GPU timers restart so both modes can be compared.
+	if (previousZPress == GLFW_RELEASE && glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS)
+	{
+		useDepthPrePass = !useDepthPrePass;
+		gpuProfiler->Reset();
+	}
+
+	// Press 'Q' to cycle through the shader quality levels. The GPU timers restart to compare them.
+	if (previousQPress == GLFW_RELEASE && glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
+	{
+		shaderQuality = (EShaderQuality)((shaderQuality + 1) % ShaderQualityCount);
+		texturedShaderProgram = texturedShaderPrograms[shaderQuality];
+		groundShaderProgram = groundShaderPrograms[shaderQuality];
+		gpuProfiler->Reset();
+		cout << "Shader quality: " << shaderQualityNames[shaderQuality] << ".\n";
+	}
+
+	// Press 'B' to cycle the texture memory budget. Shrunk textures stay shrunk when the budget grows again.
+	if (previousBPress == GLFW_RELEASE && glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS)
+	{
+		textureBudget = (textureBudget + 1) % TEXTURE_BUDGET_COUNT;
+		textureManager->SetBudget(textureBudgets[textureBudget]);
+		cout << "Texture budget: " << (textureBudgets[textureBudget] >> 20) << " MiB.\n";
+	}
+
+	// Press 'N' to toggle the mesh levels of detail. The GPU timers restart to compare both modes.
+	if (previousNPress == GLFW_RELEASE && glfwGetKey(window, GLFW_KEY_N) == GLFW_PRESS)
+	{
+		useMeshLods = !useMeshLods;
+		shadowCascades->InvalidateStaticLayers();
+		gpuProfiler->Reset();
+		cout << "Mesh LODs " << (useMeshLods ? "on" : "off") << ".\n";
+	}
+
+	// Press 'I' to toggle the tree impostors. The GPU timers restart to compare both modes.
+	if (previousIPress == GLFW_RELEASE && glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS)
+	{
+		useImpostors = !useImpostors;
+		shadowCascades->InvalidateStaticLayers();
+		gpuProfiler->Reset();
+		cout << "Impostors " << (useImpostors ? "on" : "off") << ".\n";
+	}
+
+	// Press 'V' to show the level of detail distribution in the window title.
+	if (previousVPress == GLFW_RELEASE && glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS)
+	{
+		showLodOverlay = !showLodOverlay;
+		lodOverlayUpdateTime = 0.0;
+		if (!showLodOverlay)
+			glfwSetWindowTitle(window, WINDOW_TITLE);
+	}
+
+	// Press 'O' to toggle occlusion culling.
+	if (previousOPress == GLFW_RELEASE && glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS)
+	{
+		useOcclusionCulling = !useOcclusionCulling;
+	}
+
+	// Press 'C' to toggle frustum culling.
+	if (previousCPress == GLFW_RELEASE && glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS)
+	{
+		useFrustumCulling = !useFrustumCulling;
 	}
 
 	// Close the window if Escape is pressed.
@@ -1226,6 +1963,8 @@ void handleInputs()
 
 void Update(float delta)
 {
+	PROFILE_ZONE("Update");
+
 	// applying gravity to the camera
 	if (cameraType == FirstPerson) cameraPosition += gravityVector;
 
@@ -1265,21 +2004,33 @@ void Update(float delta)
 		}
 	}
 
-	// Update quads to billboards
-	for (QuadModel* quad : quads)
-	{
-		vec3 lookAtDiff{ quad->GetPosition() - cameraPosition };
-		float yRotation{ atan2(lookAtDiff.x, lookAtDiff.z) };
+	// Spin the moon about the center of the ground.
+	spinning += 10.0f * delta;
+	mat4 center = translate(mat4(1.0f), vec3(0.0f)) * rotate(mat4(1.0f), radians(spinning), VECTOR_UP);
 
-		float xRotation{ 0.0f };
-		if (quadXRotation)
+	moon->UpdateRotation(vec3(0.0f, radians(1.0f), 0.0f));
+	moon->SetParent(center);
+	sceneBounds.Update(moonBounds, moon->GetWorldMatrix(), sphereBoundsCenter, sphereBoundsRadius);
+
+	// Update quads to billboards, every quad is independent so they are spread over the workers
+	jobSystem->ParallelFor((unsigned int)quads.size(), 256, [](unsigned int begin, unsigned int end)
 		{
-			xRotation = atan2(lookAtDiff.y, sqrt(lookAtDiff.x * lookAtDiff.x + lookAtDiff.z * lookAtDiff.z));
-			xRotation = std::max(0.0f, std::min(20.0f, xRotation));
-		}
+			for (unsigned int i = begin; i < end; i++)
+			{
+				QuadModel* quad = quads[i];
+				vec3 lookAtDiff{ quad->GetPosition() - cameraPosition };
+				float yRotation{ atan2(lookAtDiff.x, lookAtDiff.z) };
 
-		quad->SetRotation(vec3(xRotation, yRotation, 0.0f));
-	}
+				float xRotation{ 0.0f };
+				if (quadXRotation)
+				{
+					xRotation = atan2(lookAtDiff.y, sqrt(lookAtDiff.x * lookAtDiff.x + lookAtDiff.z * lookAtDiff.z));
+					xRotation = std::max(0.0f, std::min(20.0f, xRotation));
+				}
+
+				quad->SetRotation(vec3(xRotation, yRotation, 0.0f));
+			}
+		});
 
 	// Update models
 	//for (Model* model : objects)
@@ -1318,28 +2069,18 @@ void userInputRequest()
 	std::cout << "Please enter the terrain's desired dimension in Z:\n";
 	std::cin >> groundSizeZ;
 
-	maxObjCount = (int(groundSizeX/6)-2) * (int(groundSizeZ / 6)-2);
+	maxObjCount = maximumObjectCount();
 
 	int density;
 	do
 	{
 		std::cout << "Please enter the desired grass density for the world, type 1 for low, 2 for medium, 3 for high density:\n";
 		std::cin >> density;
-		switch (density)
+		grassCount = grassCountForDensity(density);
+		if (grassCount < 0)
 		{
-		case 1:
-			grassCount = ((groundSizeX - 2) * (groundSizeZ - 2))/7;
-			break;
-		case 2:
-			grassCount = ((groundSizeX - 2) * (groundSizeZ - 2)) / 6;
-			break;
-		case 3:
-			grassCount = ((groundSizeX - 2) * (groundSizeZ - 2)) / 5;
-			break;
-		default:
 			std::cout << "the value you entered is invalid, please try again\n";
 			density = 0;
-			break;
 		}
 	} 
 	while (density == 0);
@@ -1359,3 +2100,255 @@ void userInputRequest()
 	while (treeCount + bushCount > maxObjCount);
 	
 }
+
+// Trees and bushes sit on a 6 unit grid, away from the edges of the ground.
+int maximumObjectCount()
+{
+	return (int(groundSizeX / 6) - 2) * (int(groundSizeZ / 6) - 2);
+}
+
+// Grass blades for a density of 1 (low) to 3 (high), or -1 for any other density.
+int grassCountForDensity(int density)
+{
+	switch (density)
+	{
+	case 1:
+		return ((groundSizeX - 2) * (groundSizeZ - 2)) / 7;
+	case 2:
+		return ((groundSizeX - 2) * (groundSizeZ - 2)) / 6;
+	case 3:
+		return ((groundSizeX - 2) * (groundSizeZ - 2)) / 5;
+	default:
+		return -1;
+	}
+}
+
+// Read the run options. Any scene parameter, or --headless, skips the console questions: the ones not given take their defaults.
+bool parseCommandLine(int argc, char* argv[])
+{
+	const char* usage = "usage: project [--headless] [--frames N] [--dump-dir DIR] [--dump-every N] [--resolution W H] [--gpu-profile FILE] [--cpu-trace FILE]\n"
+		"               [--bench] [--camera-path FILE] [--bench-output FILE] [--warmup N]\n"
+		"               [--seed N] [--size X Z] [--density 1-3] [--trees N] [--bushes N]\n";
+
+	seed = 0;
+	int density = 2;
+	treeCount = -1;
+	bushCount = -1;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string option = argv[i];
+		// Number of values the option takes, all integers.
+		int valueCount = 1;
+		if (option == "--headless" || option == "--bench" || option == "--help")
+			valueCount = 0;
+		else if (option == "--size" || option == "--resolution")
+			valueCount = 2;
+
+		// Options taking a path.
+		string* path = option == "--dump-dir" ? &frameDumpDirectory : option == "--gpu-profile" ? &gpuProfilePath : option == "--cpu-trace" ? &cpuTracePath
+			: option == "--camera-path" ? &cameraPathFile : option == "--bench-output" ? &benchmarkOutputPath : nullptr;
+		if (path)
+		{
+			if (i + 1 >= argc)
+			{
+				std::cerr << option << " needs a path\n" << usage;
+				return false;
+			}
+			*path = argv[++i];
+			continue;
+		}
+
+		long values[2] = { 0, 0 };
+		for (int v = 0; v < valueCount; v++)
+		{
+			char* end = nullptr;
+			values[v] = i + 1 < argc ? strtol(argv[i + 1], &end, 10) : 0;
+			if (i + 1 >= argc || *end != '\0' || values[v] < 0)
+			{
+				std::cerr << option << " needs " << valueCount << " positive integer" << (valueCount > 1 ? "s" : "") << "\n" << usage;
+				return false;
+			}
+			i++;
+		}
+
+		if (option == "--headless")
+			headless = true;
+		else if (option == "--bench")
+			benchmark = true;
+		else if (option == "--warmup")
+			benchmarkWarmupFrames = (int)values[0];
+		else if (option == "--frames")
+			fixedFrameCount = std::max((int)values[0], 1);
+		else if (option == "--dump-every")
+			frameDumpInterval = (int)values[0];
+		else if (option == "--resolution")
+		{
+			windowWidth = std::max((int)values[0], 1);
+			windowHeigth = std::max((int)values[1], 1);
+		}
+		else if (option == "--seed")
+			seed = (unsigned)values[0];
+		else if (option == "--size")
+		{
+			groundSizeX = (GLuint)values[0];
+			groundSizeZ = (GLuint)values[1];
+		}
+		else if (option == "--density")
+			density = (int)values[0];
+		else if (option == "--trees")
+			treeCount = (int)values[0];
+		else if (option == "--bushes")
+			bushCount = (int)values[0];
+		else
+		{
+			std::cerr << (option == "--help" ? "" : "unknown option " + option + "\n") << usage;
+			return false;
+		}
+
+		if (option != "--frames" && option != "--dump-every" && option != "--resolution" && option != "--warmup")
+			sceneFromCommandLine = true;
+	}
+
+	fixedRun = headless || benchmark;
+
+	if (!sceneFromCommandLine)
+		return true;
+
+	if (groundSizeX < 18 || groundSizeZ < 18)
+	{
+		std::cerr << "--size must be at least 18 by 18\n";
+		return false;
+	}
+
+	grassCount = grassCountForDensity(density);
+	if (grassCount < 0)
+	{
+		std::cerr << "--density must be 1, 2 or 3\n";
+		return false;
+	}
+
+	// By default half the spots get a tree and a quarter a bush.
+	int maxObjCount = maximumObjectCount();
+	if (treeCount < 0)
+		treeCount = maxObjCount / 2;
+	if (bushCount < 0)
+		bushCount = std::min(maxObjCount / 4, maxObjCount - treeCount);
+	if (treeCount + bushCount > maxObjCount)
+	{
+		std::cerr << "The total count of trees and bushes must not excel a total of: " << maxObjCount << endl;
+		return false;
+	}
+
+	if (benchmark)
+	{
+		// Without a path, circle the terrain in 20 seconds, high enough to see all of it.
+		if (cameraPathFile.empty())
+			cameraPath = CameraPath::Orbit(vec3(0.0f), 0.6f * std::max(groundSizeX, groundSizeZ), 20.0f, 20.0f);
+		else if (!cameraPath.Load(cameraPathFile))
+			return false;
+
+		if (fixedFrameCount == 0)
+			fixedFrameCount = benchmarkWarmupFrames + (int)ceil(cameraPath.GetDuration() / FIXED_FRAME_TIME) + 1;
+
+		// Streaming would make the first measured frames depend on decode timing.
+		streamTextures = false;
+	}
+
+	if (fixedFrameCount == 0)
+		fixedFrameCount = 300;
+
+	return true;
+}
+
+// Write the offscreen frame as frame_00042.ppm in the dump directory.
+void dumpFrame(int frame)
+{
+	std::error_code error;
+	std::filesystem::create_directories(frameDumpDirectory, error);
+
+	char name[32];
+	snprintf(name, sizeof(name), "frame_%05d.ppm", frame);
+	string path = (std::filesystem::path(frameDumpDirectory) / name).string();
+	if (!offscreenTarget->SaveFrame(path))
+		cout << "Could not write " << path << ".\n";
+}
+
+// Place the camera on the bench path. The view is set here since handleInputs, which sets it otherwise, is not called.
+// The path starts after the warm up frames, which hold its first keyframe.
+void applyCameraPath(float time)
+{
+	cameraType = Static;
+	cameraPath.Sample(time - benchmarkWarmupFrames * FIXED_FRAME_TIME, cameraPosition, cameraLookAt);
+	viewMatrix = lookAt(cameraPosition, cameraLookAt, VECTOR_UP);
+	setViewMatrix(viewMatrix);
+}
+
+// Nearest rank percentile of sorted values.
+double percentile(const vector<double>& sortedValues, double percent)
+{
+	if (sortedValues.empty())
+		return 0.0;
+	size_t rank = (size_t)ceil(percent / 100.0 * sortedValues.size());
+	return sortedValues[std::clamp(rank, (size_t)1, sortedValues.size()) - 1];
+}
+
+// Text as a JSON string, quotes included. Paths may hold backslashes and quotes.
+string jsonString(const string& text)
+{
+	string quoted = "\"";
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+			quoted += '\\';
+		quoted += c;
+	}
+	return quoted + "\"";
+}
+
+// One JSON object, written to --bench-output or to the console, with the parameters needed to run the same bench again.
+bool writeBenchmarkReport(const vector<double>& frameMilliseconds, double drawsPerFrame, double trianglesPerFrame)
+{
+	vector<double> sorted = frameMilliseconds;
+	std::sort(sorted.begin(), sorted.end());
+	double totalMilliseconds = 0.0;
+	for (double milliseconds : sorted)
+		totalMilliseconds += milliseconds;
+	double averageMilliseconds = sorted.empty() ? 0.0 : totalMilliseconds / sorted.size();
+
+	std::ostringstream report;
+	report << "{\n"
+		<< "\t\"seed\": " << seed << ",\n"
+		<< "\t\"size\": [" << groundSizeX << ", " << groundSizeZ << "],\n"
+		<< "\t\"trees\": " << treeCount << ",\n"
+		<< "\t\"bushes\": " << bushCount << ",\n"
+		<< "\t\"grass\": " << grassCount << ",\n"
+		<< "\t\"resolution\": [" << windowWidth << ", " << windowHeigth << "],\n"
+		<< "\t\"headless\": " << (headless ? "true" : "false") << ",\n"
+		<< "\t\"camera_path\": " << jsonString(cameraPathFile.empty() ? "orbit" : cameraPathFile) << ",\n"
+		<< "\t\"warmup_frames\": " << benchmarkWarmupFrames << ",\n"
+		<< "\t\"frames\": " << sorted.size() << ",\n"
+		<< "\t\"average_fps\": " << (averageMilliseconds > 0.0 ? 1000.0 / averageMilliseconds : 0.0) << ",\n"
+		<< "\t\"frame_ms\": { \"average\": " << averageMilliseconds << ", \"min\": " << (sorted.empty() ? 0.0 : sorted.front())
+		<< ", \"p50\": " << percentile(sorted, 50.0) << ", \"p95\": " << percentile(sorted, 95.0) << ", \"p99\": " << percentile(sorted, 99.0)
+		<< ", \"max\": " << (sorted.empty() ? 0.0 : sorted.back()) << " },\n"
+		<< "\t\"draws_per_frame\": " << drawsPerFrame << ",\n"
+		<< "\t\"triangles_per_frame\": " << trianglesPerFrame << "\n"
+		<< "}\n";
+
+	if (benchmarkOutputPath.empty())
+	{
+		cout << report.str();
+		return true;
+	}
+
+	std::ofstream file(benchmarkOutputPath, std::ios::trunc);
+	file << report.str();
+	if (!file)
+	{
+		cout << "Could not write " << benchmarkOutputPath << ".\n";
+		return false;
+	}
+	cout << "Bench report written to " << benchmarkOutputPath << ".\n";
+	return true;
+}
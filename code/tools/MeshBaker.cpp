@@ -0,0 +1,127 @@
+//
+// Mesh baker.
+//
+// Builds the primitive meshes of the game, optimized for the vertex cache, and writes each as a mesh container,
+// which the game maps and uploads instead of building and optimizing them at startup.
+//
+// Usage: mesh_baker [--sphere RADIUS OFFSET RADIAL VERTICAL] [--terrain SEED X Z] [directory]
+//   Writes to assets/meshes/ by default: the cube, the quad and every level of detail of the game's sphere
+//   (radius 1, offset 0.5, 24x24 subdivisions), or of the sphere given instead.
+//   --terrain also writes the terrain of a seed and size, as the game generates it, as terrain_SEED_XxZ.mesh.
+//
+
+#include "GroundModel.h"
+#include "MeshCache.h"
+#include "MeshContainer.h"
+
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Texture repetitions over the terrain, as in the game.
+static const float GROUND_UV_TILING = 8.0f;
+
+int main(int argc, char* argv[])
+{
+	float sphereRadius = 1.0f;
+	float sphereOffset = 0.5f;
+	int sphereRadialSubdivisions = 24;
+	int sphereVerticalSubdivisions = 24;
+	bool terrain = false;
+	unsigned int seed = 0;
+	unsigned int sizeX = 0;
+	unsigned int sizeZ = 0;
+	string directory = "assets/meshes/";
+
+	for (int i = 1; i < argc; i++)
+	{
+		string argument = argv[i];
+		if (argument == "--sphere" && i + 4 < argc)
+		{
+			sphereRadius = stof(argv[i + 1]);
+			sphereOffset = stof(argv[i + 2]);
+			sphereRadialSubdivisions = stoi(argv[i + 3]);
+			sphereVerticalSubdivisions = stoi(argv[i + 4]);
+			i += 4;
+		}
+		else if (argument == "--terrain" && i + 3 < argc)
+		{
+			terrain = true;
+			seed = (unsigned int)stoul(argv[i + 1]);
+			sizeX = (unsigned int)stoul(argv[i + 2]);
+			sizeZ = (unsigned int)stoul(argv[i + 3]);
+			i += 3;
+		}
+		else if (argument.rfind("--", 0) != 0)
+			directory = argument;
+		else
+		{
+			cerr << "Usage: " << argv[0] << " [--sphere RADIUS OFFSET RADIAL VERTICAL] [--terrain SEED X Z] [directory]\n";
+			return 1;
+		}
+	}
+
+	if (directory.back() != '/' && directory.back() != '\\')
+		directory += '/';
+	error_code error;
+	filesystem::create_directories(directory, error);
+
+	int failures = 0;
+	auto bake = [&](const string& name, function<bool()> write)
+	{
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		if (!write())
+		{
+			cerr << "Could not write " << name << "\n";
+			failures++;
+			return;
+		}
+		double milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		cout << name << ": " << milliseconds << " ms\n";
+	};
+
+	bake("cube", [&]() { return MeshCache::BakeCube(directory); });
+	bake("quad", [&]() { return MeshCache::BakeQuad(directory); });
+	for (int lod = 0; lod < MeshCache::SphereLodCount; lod++)
+	{
+		int radial = MeshCache::LodSubdivisions(sphereRadialSubdivisions, lod);
+		int vertical = MeshCache::LodSubdivisions(sphereVerticalSubdivisions, lod);
+		bake("sphere " + to_string(radial) + "x" + to_string(vertical),
+			[&]() { return MeshCache::BakeSphere(directory, sphereRadius, sphereOffset, radial, vertical); });
+	}
+
+	if (terrain)
+	{
+		string path = directory + "terrain_" + to_string(seed) + "_" + to_string(sizeX) + "x" + to_string(sizeZ) + MeshContainer::Extension;
+		bake(path, [&]()
+			{
+				// Generated and optimized without buffers, so no GL context is needed.
+				GroundModel ground(sizeX, sizeZ, GROUND_UV_TILING, false, seed);
+				return MeshCache::WriteMesh(path, ground.GetVertices(), ground.GetIndices());
+			});
+	}
+
+	// What the game will find: every container in the directory, read back.
+	for (const filesystem::directory_entry& entry : filesystem::directory_iterator(directory, error))
+	{
+		if (entry.path().extension() != MeshContainer::Extension)
+			continue;
+
+		MeshContainer container;
+		if (!container.Open(entry.path().string()))
+		{
+			cerr << entry.path().string() << " is not a valid mesh container\n";
+			failures++;
+			continue;
+		}
+		cout << entry.path().string() << ": " << container.GetVertexCount() << " vertices, " << container.GetIndexCount() / 3 << " triangles, "
+			<< container.GetIndexSize() * 8 << " bit indices, " << (container.GetVertexDataSize() + container.GetIndexDataSize()) / 1024 << " KiB\n";
+	}
+
+	return failures > 0 ? 1 : 0;
+}
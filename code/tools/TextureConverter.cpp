@@ -0,0 +1,92 @@
+//
+// Texture converter.
+//
+// Decodes images and writes each next to its source as a texture container with the full mip chain,
+// which the game maps and uploads instead of decoding the image and generating mipmaps at startup.
+//
+// Usage: texture_converter [--compress] image...
+//   --compress stores opaque (3 component) images as BC1, a sixth of their size. Normal and height maps are never
+//   compressed: BC1 blocks would bend their normals and terrace their heights.
+//
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "TextureContainer.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Normal and height maps by the names the assets use: "_N", "Normal" or "Depth" at the end of the file name.
+static bool isDataTexture(const string& image)
+{
+	size_t directory = image.find_last_of("/\\");
+	string name = image.substr(directory == string::npos ? 0 : directory + 1);
+	name = name.substr(0, name.find_last_of('.'));
+	for (const string& suffix : { string("_N"), string("Normal"), string("Depth") })
+	{
+		if (name.size() >= suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0)
+			return true;
+	}
+	return false;
+}
+
+int main(int argc, char* argv[])
+{
+	bool compress = false;
+	vector<string> images;
+	for (int i = 1; i < argc; i++)
+	{
+		string argument = argv[i];
+		if (argument == "--compress")
+			compress = true;
+		else
+			images.push_back(argument);
+	}
+
+	if (images.empty())
+	{
+		cerr << "Usage: " << argv[0] << " [--compress] image...\n";
+		return 1;
+	}
+
+	int failures = 0;
+	for (const string& image : images)
+	{
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+		int width, height, components;
+		unsigned char* pixels = stbi_load(image.c_str(), &width, &height, &components, 0);
+		if (!pixels)
+		{
+			cerr << "Could not decode " << image << ": " << stbi_failure_reason() << "\n";
+			failures++;
+			continue;
+		}
+
+		// Two component images have no GL format in the game's loader either.
+		string container = TextureContainer::GetContainerPath(image);
+		bool written = components != 2 && TextureContainer::Write(container, pixels, width, height, components, compress && !isDataTexture(image));
+		stbi_image_free(pixels);
+
+		if (!written)
+		{
+			cerr << "Could not write " << container << "\n";
+			failures++;
+			continue;
+		}
+
+		TextureContainer result;
+		result.Open(container);
+		double milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		cout << image << " -> " << container << ": " << width << "x" << height << ", " << result.GetLevelCount() << " levels, "
+			<< (result.IsCompressed() ? "BC1" : to_string(components) + " components") << ", " << result.GetTotalSize() / 1024 << " KiB, "
+			<< milliseconds << " ms\n";
+	}
+
+	return failures > 0 ? 1 : 0;
+}